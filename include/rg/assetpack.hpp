@@ -0,0 +1,69 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Read only archive of asset files ("<name>.rgpack") that is memory mapped as a whole, so loading from it costs one
+// open and no reads, and the data of every file can be used in place. Layout:
+//   header | file data (every file 16 byte aligned) | index entries sorted by path | path strings
+// Paths are relative to the project root in the form FileSystem::normalizePath produces. Every entry also records
+// the size and modification time the file had when it was packed, so freshness checks (mesh cache, cooked textures)
+// work the same inside a pack as on loose files.
+const uint32_t ASSET_PACK_VERSION = 1;
+
+class AssetPack
+{
+  public:
+    struct Entry
+    {
+        uint64_t offset;
+        uint64_t size;
+        int64_t modified; // nanoseconds since epoch
+        uint32_t pathOffset;
+        uint32_t pathLength;
+    };
+
+    ~AssetPack();
+
+    AssetPack(const AssetPack &) = delete;
+    AssetPack &operator=(const AssetPack &) = delete;
+
+    // maps the pack, returns nullptr (and prints why) if it can't be read or isn't a valid pack
+    static std::shared_ptr<AssetPack> open(const std::string &packPath);
+
+    // packs the files under the given (already normalized) paths into a new pack, returns false on failure
+    static bool write(const std::string &packPath, const std::vector<std::string> &paths);
+
+    // binary search in the index, nullptr if the path isn't in the pack
+    const Entry *find(const std::string &path) const;
+
+    const unsigned char *getData(const Entry &entry) const
+    {
+        return base + entry.offset;
+    }
+    std::string getPath(const Entry &entry) const;
+
+    size_t getEntryCount() const
+    {
+        return entryCount;
+    }
+    const std::string &getPackPath() const
+    {
+        return packPath;
+    }
+
+  private:
+    std::string packPath;
+    const unsigned char *base = nullptr;
+    size_t mappingSize = 0;
+    const Entry *entries = nullptr;
+    size_t entryCount = 0;
+    const char *strings = nullptr;
+
+    AssetPack() = default;
+};
+
+#endif // !ASSETPACK_H
@@ -0,0 +1,74 @@
+#ifndef ASSETREGISTRY_H
+#define ASSETREGISTRY_H
+
+#include <rg/model.hpp>
+#include <rg/shader.hpp>
+#include <rg/texture.hpp>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class AssetStreamer;
+
+// Process wide cache of loaded assets. Every asset is loaded once per key (canonical path plus the options that
+// change the result) and shared through std::shared_ptr handles. The registry itself only holds weak references, so
+// the GPU memory is released as soon as the last user drops its handle and a later request loads the asset again.
+// Only to be used on the GL thread.
+class AssetRegistry
+{
+  public:
+    static AssetRegistry &global();
+
+    AssetRegistry(const AssetRegistry &) = delete;
+    AssetRegistry &operator=(const AssetRegistry &) = delete;
+
+    // when set, new models and textures are loaded through the streamer instead of synchronously
+    void setStreamer(AssetStreamer *streamer)
+    {
+        this->streamer = streamer;
+    }
+
+    // consumers that read the mesh data back (picking, baking, ...) ask for MeshRetention::KeepCpuData and get a
+    // model of their own, everyone else shares the one without CPU copies
+    std::shared_ptr<Model> getModel(const std::string &path, bool gamma = false,
+                                    VertexFormat format = VertexFormat::Full,
+                                    MeshRetention retention = MeshRetention::GpuOnly);
+    std::shared_ptr<TextureObject> getTexture(const std::string &path);
+    // faces in +X, -X, +Y, -Y, +Z, -Z order
+    std::shared_ptr<TextureObject> getCubemap(const std::vector<std::string> &faces);
+    std::shared_ptr<Shader> getShader(const char *vertexPath, const char *fragmentPath,
+                                      const char *geometryPath = nullptr,
+                                      const std::vector<std::string> &defines = std::vector<std::string>());
+
+    // for loaders that create textures themselves (model materials), key comes from getTextureKey
+    std::shared_ptr<TextureObject> findTexture(const std::string &key) const;
+    void addTexture(const std::string &key, const std::shared_ptr<TextureObject> &texture);
+    static std::string getTextureKey(const std::string &path);
+
+    // number of assets that are currently alive
+    size_t getModelCount() const;
+    size_t getTextureCount() const;
+    size_t getShaderCount() const;
+
+  private:
+    template <typename T> using Table = std::unordered_map<std::string, std::weak_ptr<T>>;
+
+    AssetStreamer *streamer = nullptr;
+    Table<Model> models;
+    Table<TextureObject> textures;
+    Table<Shader> shaders;
+
+    AssetRegistry() = default;
+
+    // resolves symlinks and relative components so different spellings of a path share one entry
+    static std::string canonicalPath(const std::string &path);
+
+    template <typename T> static std::shared_ptr<T> find(const Table<T> &table, const std::string &key);
+    // drops the entries of released assets, then inserts the new one
+    template <typename T> static void insert(Table<T> &table, const std::string &key, const std::shared_ptr<T> &asset);
+    template <typename T> static size_t countAlive(const Table<T> &table);
+};
+
+#endif // !ASSETREGISTRY_H
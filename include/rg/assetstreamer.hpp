@@ -0,0 +1,130 @@
+#ifndef ASSETSTREAMER_H
+#define ASSETSTREAMER_H
+
+#include <glad/glad.h>
+
+#include <rg/image.hpp>
+#include <rg/model.hpp>
+#include <rg/mpscqueue.hpp>
+#include <rg/texture.hpp>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Asynchronous asset loading. Loads return handles immediately, decoding/importing happens on the global thread
+// pool and the finished CPU data is handed to the GL thread through a lock-free queue. update() (called once per
+// frame on the GL thread) then uploads it, textures through a pixel buffer object, spending at most uploadBudget
+// bytes per frame so loading new assets mid-session doesn't cause frame spikes.
+class AssetStreamer
+{
+  public:
+    explicit AssetStreamer(size_t uploadBudget = 4 * 1024 * 1024);
+    ~AssetStreamer();
+
+    AssetStreamer(const AssetStreamer &) = delete;
+    AssetStreamer &operator=(const AssetStreamer &) = delete;
+
+    // the model is empty (and Draw is a no-op) until all of its meshes and textures are uploaded.
+    // The returned textures show a 1x1 placeholder until their data has been uploaded.
+    // These always load, deduplication happens one level up in the AssetRegistry.
+    std::shared_ptr<Model> loadModel(const std::string &path, VertexFormat format = VertexFormat::Full,
+                                     MeshRetention retention = MeshRetention::GpuOnly);
+    std::shared_ptr<TextureObject> loadTexture(const std::string &path);
+    // faces in +X, -X, +Y, -Y, +Z, -Z order
+    std::shared_ptr<TextureObject> loadCubemap(const std::vector<std::string> &faces);
+
+    // processes finished loads and uploads data within the per-frame budget, call once per frame on the GL thread
+    void update();
+
+    void setUploadBudget(size_t bytes)
+    {
+        uploadBudget = bytes;
+    }
+    size_t getUploadBudget() const
+    {
+        return uploadBudget;
+    }
+
+    // number of assets that are still being loaded or uploaded
+    unsigned int getPendingCount() const
+    {
+        return inFlight;
+    }
+
+  private:
+    // bookkeeping of a model that is being streamed, it becomes ready when nothing is left
+    struct ModelLoad
+    {
+        std::shared_ptr<Model> model;
+        unsigned int remaining = 0;
+        // keeps the model's textures registered until its meshes have picked them up
+        std::vector<std::shared_ptr<TextureObject>> textures;
+    };
+
+    // produced on worker threads, consumed by update()
+    struct Job
+    {
+        std::shared_ptr<Model> model;
+        std::vector<MeshData> meshes;
+        // unique texture references of a model and their images, or just the images of a texture load
+        std::vector<Texture> textures;
+        std::vector<std::shared_ptr<const Image>> images;
+        std::shared_ptr<TextureObject> texture;
+    };
+
+    // GL thread work items, processed in order within the budget
+    struct TextureUpload
+    {
+        std::shared_ptr<TextureObject> texture;
+        std::vector<std::shared_ptr<const Image>> layers; // 1 for 2D textures, 6 for cubemaps, 1 for cooked cubemaps
+        unsigned int layer = 0;
+        int row = 0; // of a cooked image: the next (level, face) pair, level * faces + face
+        std::shared_ptr<ModelLoad> owner;
+    };
+
+    struct MeshUpload
+    {
+        std::shared_ptr<ModelLoad> owner;
+        MeshData data;
+    };
+
+    size_t uploadBudget;
+    unsigned int inFlight = 0;
+    std::shared_ptr<MPSCQueue<std::unique_ptr<Job>>> finished;
+    std::deque<TextureUpload> textureUploads;
+    std::deque<MeshUpload> meshUploads;
+
+    unsigned int placeholder2D = 0;
+    unsigned int placeholderCubemap = 0;
+    unsigned int pixelBuffer = 0;
+    size_t pixelBufferSize = 0;
+
+    // a range of rows (or a whole compressed level) staged in the pixel buffer, copied into the texture once the
+    // buffer is unmapped
+    struct RowCopy
+    {
+        GLenum target;
+        unsigned int textureID;
+        GLenum face;
+        const Image *image;
+        unsigned int level;
+        int row;
+        int rowCount;
+        size_t offset;
+        size_t size;
+    };
+
+    void acceptJob(Job &job);
+    std::shared_ptr<TextureObject> createTexture(GLenum target);
+    void finishModelPart(const std::shared_ptr<ModelLoad> &owner);
+
+    // copies as many rows as fit into the mapped pixel buffer, returns the new staging offset
+    size_t stageRows(TextureUpload &upload, unsigned char *staging, size_t offset, size_t capacity,
+                     std::vector<RowCopy> &copies);
+    bool isComplete(const TextureUpload &upload) const;
+    void finishTexture(TextureUpload &upload);
+};
+
+#endif // !ASSETSTREAMER_H
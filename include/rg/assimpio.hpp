@@ -0,0 +1,51 @@
+#ifndef ASSIMPIO_H
+#define ASSIMPIO_H
+
+#include <rg/filesystem.hpp>
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+
+#include <string>
+#include <vector>
+
+// lets ASSIMP read the model and the files it references (materials, ...) through FileSystem, so models load from
+// mounted asset packs without a copy and loose files keep working. Streams are read only.
+class FileSystemIOStream : public Assimp::IOStream
+{
+  public:
+    explicit FileSystemIOStream(const FileView &file) : file(file)
+    {
+    }
+
+    size_t Read(void *buffer, size_t size, size_t count) override;
+    size_t Write(const void *buffer, size_t size, size_t count) override;
+    aiReturn Seek(size_t offset, aiOrigin origin) override;
+    size_t Tell() const override;
+    size_t FileSize() const override;
+    void Flush() override;
+
+  private:
+    FileView file;
+    size_t position = 0;
+};
+
+class FileSystemIOSystem : public Assimp::IOSystem
+{
+  public:
+    bool Exists(const char *path) const override;
+    char getOsSeparator() const override;
+    Assimp::IOStream *Open(const char *path, const char *mode = "rb") override;
+    void Close(Assimp::IOStream *stream) override;
+
+    // every file ASSIMP tried to open (the model, its material libraries, ...), also those that weren't there, once
+    const std::vector<std::string> &getOpenedPaths() const
+    {
+        return openedPaths;
+    }
+
+  private:
+    std::vector<std::string> openedPaths;
+};
+
+#endif // !ASSIMPIO_H
@@ -0,0 +1,23 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <rg/vertexformat.hpp>
+
+#include <string>
+#include <vector>
+
+struct VertexFormatBenchmarkResult
+{
+    VertexFormat format;
+    size_t gpuMemory;  // vertex and index bytes of the model
+    size_t cpuMemory;  // mesh bytes the model keeps in CPU memory
+    double cpuFrameMs; // wall clock per frame, waiting for the GPU to finish
+    double gpuFrameMs; // GL_TIME_ELAPSED per frame
+};
+
+// Draws copies instances of the model for frames frames, once in each vertex format, into the currently bound
+// framebuffer, then prints and returns the frame times and memory use of both. Needs a current GL context.
+std::vector<VertexFormatBenchmarkResult> runVertexFormatBenchmark(const std::string &modelPath, int copies,
+                                                                  int frames);
+
+#endif // !BENCHMARK_H
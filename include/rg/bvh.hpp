@@ -0,0 +1,128 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <rg/frustum.hpp>
+
+#include <cstdint>
+#include <future>
+#include <vector>
+
+// nearest item box a ray hits
+struct BvhRayHit
+{
+    unsigned int item = 0;
+    // along the ray direction, in units of its length
+    float distance = 0.0f;
+};
+
+// Bounding volume hierarchy over the world space boxes of scene items (model instances, lights...). Items are
+// numbered in the order they were added, queries return those numbers.
+//
+// The tree is built top down, splitting at the cheapest of a few candidate planes per axis by the surface area
+// heuristic (binned SAH). Moving an item only refits the boxes on its path to the root, which keeps queries correct
+// but lets the tree degrade. update() measures that (SAH cost against the cost right after the build) and rebuilds
+// on a worker of the ThreadPool once it got too bad, swapping the new tree in when it's done.
+class SceneBvh
+{
+  public:
+    // items a leaf holds at most
+    static const unsigned int MAX_LEAF_ITEMS = 4;
+    // rebuild once the cost grew by this factor since the last build
+    float rebuildThreshold = 1.5f;
+
+    SceneBvh() = default;
+    // waits for a running rebuild
+    ~SceneBvh();
+
+    SceneBvh(const SceneBvh &) = delete;
+    SceneBvh &operator=(const SceneBvh &) = delete;
+
+    // returns the item's number, the tree is rebuilt on the next update()
+    unsigned int addItem(const BoundingBox &bounds);
+    // drops all items
+    void clear();
+    // moves an item, refitting the tree up from its leaf
+    void setBounds(unsigned int item, const BoundingBox &bounds);
+    const BoundingBox &getBounds(unsigned int item) const
+    {
+        return bounds[item];
+    }
+
+    // once per frame: builds the tree if items were added, takes a finished background rebuild and starts one if
+    // the tree degraded
+    void update();
+    // builds the tree right away
+    void build();
+
+    // items whose boxes intersect the frustum, appended to items
+    void queryFrustum(const Frustum &frustum, std::vector<unsigned int> &items) const;
+    // items whose boxes overlap the box
+    void queryOverlap(const BoundingBox &box, std::vector<unsigned int> &items) const;
+    // items whose boxes the ray from origin along direction hits within maxDistance
+    void queryRay(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+                  std::vector<unsigned int> &items) const;
+    // the nearest item box the ray hits, false if none
+    bool intersectRay(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, BvhRayHit &hit) const;
+
+    size_t getItemCount() const
+    {
+        return bounds.size();
+    }
+    size_t getNodeCount() const
+    {
+        return tree.nodes.size();
+    }
+    // SAH cost of the tree now and right after it was built
+    float getCost() const;
+    float getBuildCost() const
+    {
+        return buildCost;
+    }
+    bool isRebuilding() const
+    {
+        return rebuild.valid();
+    }
+
+  private:
+    struct Node
+    {
+        BoundingBox bounds;
+        // inner nodes: index of the first child, the second one follows it. Leaves: first entry of items.
+        uint32_t first;
+        // items of a leaf, 0 for inner nodes
+        uint32_t count;
+        uint32_t parent;
+    };
+
+    struct Tree
+    {
+        // the root is the first node, children always come after their parent
+        std::vector<Node> nodes;
+        // item numbers in leaf order
+        std::vector<unsigned int> items;
+        // leaf of every item
+        std::vector<uint32_t> leafOf;
+    };
+
+    std::vector<BoundingBox> bounds;
+    Tree tree;
+    float buildCost = 0.0f;
+    // items were added or removed since the tree was built
+    bool structureChanged = false;
+    // items moved since the cost was last checked
+    bool refitted = false;
+    // valid while a rebuild runs
+    std::future<Tree> rebuild;
+
+    // pure function of the boxes, runs on a worker thread for background rebuilds
+    static Tree buildTree(const std::vector<BoundingBox> &bounds);
+    static float computeCost(const Tree &tree);
+    // recomputes the box of a node from its items or children
+    void refitNode(uint32_t node);
+    // recomputes every box from the current item boxes
+    void refitAll();
+};
+
+#endif // !BVH_H
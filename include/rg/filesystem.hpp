@@ -2,9 +2,56 @@
 #define FILESYSTEM_H
 
 #include <string>
+#include <cstdint>
 #include <cstdlib>
-#include "root_directory.h" // This is a configuration file generated by CMake.
+#include <memory>
 
+// Read only bytes of a file: a zero copy view into a mounted asset pack or into a memory mapped loose file. Copies
+// share the underlying mapping, which stays alive as long as any view of it does.
+class FileView
+{
+  public:
+    FileView() = default;
+    FileView(const unsigned char *bytes, size_t length, std::shared_ptr<const void> storage)
+        : bytes(bytes), length(length), storage(std::move(storage))
+    {
+    }
+
+    const unsigned char *data() const
+    {
+        return bytes;
+    }
+    size_t size() const
+    {
+        return length;
+    }
+    // false if the file doesn't exist or couldn't be read
+    bool isValid() const
+    {
+        return storage != nullptr;
+    }
+    std::string toString() const
+    {
+        return length > 0 ? std::string(reinterpret_cast<const char *>(bytes), length) : std::string();
+    }
+
+  private:
+    const unsigned char *bytes = nullptr;
+    size_t length = 0;
+    std::shared_ptr<const void> storage;
+};
+
+struct FileInfo
+{
+    uint64_t size = 0;
+    int64_t modified = 0; // nanoseconds since epoch
+};
+
+// Path resolution plus a small virtual file system: asset packs (see AssetPack) are mounted once and every read of a
+// file they contain is served from the mapping. Files that aren't in any pack are read from disk. For development
+// the loose files can be put in front of the packs (RG_LOOSE_FILES=1), then an edited shader or texture on disk
+// shadows its packed version without rebuilding the pack.
+// All paths are the ones the loaders already use (FileSystem::getPath results or relative to the working directory).
 class FileSystem
 {
   private:
@@ -17,14 +64,26 @@ class FileSystem
         return (*pathBuilder)(path);
     }
 
+    // maps the pack and adds it to the lookup, later mounts take precedence. Returns false if it can't be used.
+    static bool mountPack(const std::string &packPath);
+    static void unmountAll();
+
+    // whether loose files shadow packed ones (the default is pack first, loose files only for what isn't packed)
+    static void setLooseFilesFirst(bool looseFirst);
+
+    static FileView readFile(const std::string &path);
+    static bool getFileInfo(const std::string &path, FileInfo &info);
+    static bool exists(const std::string &path);
+    // whether a mounted pack contains the file (regardless of loose files)
+    static bool isPacked(const std::string &path);
+
+    // the key of a path inside a pack: relative to the root, '/' separated, without "." and ".." components
+    static std::string normalizePath(const std::string &path);
+
   private:
-    static std::string const &getRoot()
-    {
-        static char const *envRoot = getenv("LOGL_ROOT_PATH");
-        static char const *givenRoot = (envRoot != nullptr ? envRoot : logl_root);
-        static std::string root = (givenRoot != nullptr ? givenRoot : "");
-        return root;
-    }
+    // defined next to the VFS, the only place that includes the root_directory.h CMake generates (it defines a
+    // global, so it can't be included by more than one translation unit)
+    static std::string const &getRoot();
 
     // static std::string(*foo (std::string const &)) getPathBuilder()
     static Builder getPathBuilder()
@@ -0,0 +1,95 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// axis aligned box, the default one is empty (minimum above maximum) and grows with expand
+struct BoundingBox
+{
+    glm::vec3 minimum = glm::vec3(FLT_MAX);
+    glm::vec3 maximum = glm::vec3(-FLT_MAX);
+
+    BoundingBox() = default;
+    BoundingBox(const glm::vec3 &minimum, const glm::vec3 &maximum) : minimum(minimum), maximum(maximum)
+    {
+    }
+
+    bool isEmpty() const
+    {
+        return minimum.x > maximum.x || minimum.y > maximum.y || minimum.z > maximum.z;
+    }
+    glm::vec3 getCenter() const
+    {
+        return (minimum + maximum) * 0.5f;
+    }
+    float getSurfaceArea() const;
+    bool overlaps(const BoundingBox &other) const;
+
+    void expand(const BoundingBox &other);
+    void expand(const glm::vec3 &point);
+
+    // the world space box around this box transformed by the matrix
+    BoundingBox transformed(const glm::mat4 &transform) const;
+};
+
+// how a box lies relative to a frustum
+enum class FrustumTest
+{
+    Outside,
+    Intersects,
+    Inside
+};
+
+// the six planes of a view frustum, (a, b, c, d) with a point p inside of a plane if dot(abc, p) + d >= 0
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    // everything is inside
+    Frustum();
+    // extracts the planes of projection * view (Gribb/Hartmann), they bound the world space volume the camera sees
+    explicit Frustum(const glm::mat4 &viewProjection);
+
+    bool intersectsSphere(const glm::vec3 &center, float radius) const;
+    bool intersectsBox(const glm::vec3 &minimum, const glm::vec3 &maximum) const;
+    // like intersectsBox, but also tells boxes that are completely inside apart
+    FrustumTest classifyBox(const BoundingBox &box) const;
+};
+
+// Axis aligned boxes in structure of arrays layout (centers and half extents), the culling kernel tests four or
+// eight of them per instruction. Filled anew for every batch, the arrays keep their capacity.
+class BoundingBoxes
+{
+  public:
+    void clear();
+    void add(const glm::vec3 &minimum, const glm::vec3 &maximum);
+    // adds the world space box around the model space box transformed by the matrix
+    void add(const glm::vec3 &minimum, const glm::vec3 &maximum, const glm::mat4 &transform);
+
+    size_t size() const
+    {
+        return centerX.size();
+    }
+
+    // writes 1 for every box intersecting the frustum and 0 for every other one, returns the number of 1s. Uses AVX
+    // if the CPU has it, SSE2 otherwise (and plain C++ off x86).
+    size_t cull(const Frustum &frustum, std::vector<uint8_t> &visible) const;
+
+  private:
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+};
+
+// what culling kept and dropped
+struct CullingStats
+{
+    unsigned int visible = 0;
+    unsigned int culled = 0;
+};
+
+#endif // !FRUSTUM_H
@@ -0,0 +1,103 @@
+#ifndef GEOMETRYBUFFER_H
+#define GEOMETRYBUFFER_H
+
+#include <glad/glad.h>
+
+#include <rg/vertexformat.hpp>
+
+#include <cstddef>
+#include <map>
+
+// first fit allocator of [offset, offset + size) ranges, adjacent free ranges are merged
+class RangeAllocator
+{
+  public:
+    // returns false if no free range is large enough
+    bool allocate(unsigned int size, unsigned int &offset);
+    void free(unsigned int offset, unsigned int size);
+    // appends [capacity, newCapacity) to the free ranges
+    void grow(unsigned int newCapacity);
+    void reset();
+
+    unsigned int getCapacity() const
+    {
+        return capacity;
+    }
+
+  private:
+    // offset -> size
+    std::map<unsigned int, unsigned int> freeRanges;
+    unsigned int capacity = 0;
+};
+
+// the part of a GeometryBuffer a mesh occupies. Indices are relative to the mesh, the draw adds baseVertex.
+struct GeometryAllocation
+{
+    unsigned int baseVertex = 0;
+    unsigned int vertexCount = 0;
+    unsigned int firstIndex = 0;
+    unsigned int indexCount = 0;
+};
+
+// Megabuffer of static meshes: one VBO and one EBO per vertex format that meshes are suballocated from, with a
+// single VAO over them. Meshes in it are drawn with glDrawElementsBaseVertex, so going from one mesh to the next
+// needs no VAO or buffer switch. The buffers grow by copying into larger ones, the VAO stays the same.
+// Full meshes use 32 bit indices, Compact ones 16 bit indices (meshes that need 32 bit ones keep own buffers).
+class GeometryBuffer
+{
+  public:
+    // the shared buffer of the format, its GL objects are created with the first allocation
+    static GeometryBuffer &get(VertexFormat format);
+
+    // whether meshes created from now on go into the shared buffers (off by default)
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    // deletes the GL objects of all shared buffers, must run while the context is still current
+    static void releaseAll();
+
+    GeometryBuffer(const GeometryBuffer &) = delete;
+    GeometryBuffer &operator=(const GeometryBuffer &) = delete;
+
+    // copies the vertices (in the layout of the format) and indices (of getIndexType) into the buffer
+    GeometryAllocation allocate(const void *vertices, unsigned int vertexCount, const void *indices,
+                                unsigned int indexCount);
+    void free(const GeometryAllocation &allocation);
+
+    unsigned int getVAO() const
+    {
+        return VAO;
+    }
+    GLenum getIndexType() const
+    {
+        return indexType;
+    }
+
+    unsigned int getAllocationCount() const
+    {
+        return allocationCount;
+    }
+    // bytes of vertex and index data in use and allocated
+    size_t getUsedMemory() const;
+    size_t getGpuMemory() const;
+
+  private:
+    VertexFormat format;
+    GLenum indexType;
+    size_t vertexSize;
+    size_t indexSize;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    RangeAllocator vertexRanges;
+    RangeAllocator indexRanges;
+    unsigned int usedVertices = 0;
+    unsigned int usedIndices = 0;
+    unsigned int allocationCount = 0;
+
+    explicit GeometryBuffer(VertexFormat format);
+
+    void release();
+    // reallocates the VBO/EBO with room for at least the given counts, keeping their contents
+    void reserve(unsigned int vertexCapacity, unsigned int indexCapacity);
+};
+
+#endif // !GEOMETRYBUFFER_H
@@ -0,0 +1,69 @@
+#ifndef GLEXTENSIONS_H
+#define GLEXTENSIONS_H
+
+#include <glad/glad.h>
+
+// whether the current context advertises the extension (e.g. "GL_EXT_texture_compression_s3tc"). glad is generated
+// for core 3.3 without extensions, so optional features are detected through this. Needs a current GL context.
+bool hasGLExtension(const char *name);
+
+// whether the context's version is at least major.minor
+bool hasGLVersion(int major, int minor);
+
+// GL 4.1 / ARB_get_program_binary
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void(APIENTRYP PFNRGGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length,
+                                                  GLenum *binaryFormat, void *binary);
+typedef void(APIENTRYP PFNRGPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary,
+                                               GLsizei length);
+typedef void(APIENTRYP PFNRGPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+// KHR_parallel_shader_compile (ARB_parallel_shader_compile has the same enums)
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+typedef void(APIENTRYP PFNRGMAXSHADERCOMPILERTHREADSPROC)(GLuint count);
+
+// GL 4.3 compute shaders, shader storage buffers and multi draw indirect (GpuCuller)
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+typedef void(APIENTRYP PFNRGDISPATCHCOMPUTEPROC)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+typedef void(APIENTRYP PFNRGMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void(APIENTRYP PFNRGMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect,
+                                                           GLsizei drawCount, GLsizei stride);
+
+// Entry points of optional features that glad doesn't load. A feature's flag is only set if the driver supports it
+// and all of its functions were found, so callers check the flag and nothing else.
+struct GLExtensions
+{
+    bool hasProgramBinary = false;
+    PFNRGGETPROGRAMBINARYPROC getProgramBinary = nullptr;
+    PFNRGPROGRAMBINARYPROC programBinary = nullptr;
+    PFNRGPROGRAMPARAMETERIPROC programParameteri = nullptr;
+
+    bool hasParallelShaderCompile = false;
+    PFNRGMAXSHADERCOMPILERTHREADSPROC maxShaderCompilerThreads = nullptr;
+
+    bool hasGpuCulling = false;
+    PFNRGDISPATCHCOMPUTEPROC dispatchCompute = nullptr;
+    PFNRGMEMORYBARRIERPROC memoryBarrier = nullptr;
+    PFNRGMULTIDRAWELEMENTSINDIRECTPROC multiDrawElementsIndirect = nullptr;
+};
+
+extern GLExtensions glExtensions;
+
+// fills glExtensions, call once after gladLoadGLLoader with the same loader
+void loadGLExtensions(GLADloadproc load);
+
+#endif // !GLEXTENSIONS_H
@@ -0,0 +1,80 @@
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <glad/glad.h>
+
+// GL calls that reached the driver and calls dropped because they wouldn't have changed anything
+struct GLStateStats
+{
+    unsigned int issued = 0;
+    unsigned int filtered = 0;
+};
+
+// Shadow copy of the GL state the renderer changes all the time: program, vertex array, texture bindings, blend,
+// depth and cull state. A call that sets what the context already has is dropped before it reaches the driver.
+// The copy is only right if everything binds, deletes and toggles these through here; after code that doesn't (like
+// ImGui's renderer) call invalidate().
+class GLState
+{
+  public:
+    // the state of the one context the program renders with
+    static GLState &global();
+
+    GLState();
+
+    GLState(const GLState &) = delete;
+    GLState &operator=(const GLState &) = delete;
+
+    void useProgram(GLuint program);
+    void bindVertexArray(GLuint vertexArray);
+    // makes the unit active and binds the texture to it
+    void bindTexture(unsigned int unit, GLenum target, GLuint texture);
+    // binds to whatever unit is active, for uploads
+    void bindTexture(GLenum target, GLuint texture);
+
+    void setBlend(bool enabled);
+    void setBlendFunc(GLenum source, GLenum destination);
+    void setDepthTest(bool enabled);
+    void setDepthFunc(GLenum function);
+    void setCullFace(bool enabled);
+    void setCullFaceMode(GLenum mode);
+
+    // GL unbinds deleted objects and may hand out their names again, so deleting goes through here as well
+    void deleteProgram(GLuint program);
+    void deleteVertexArray(GLuint vertexArray);
+    void deleteTexture(GLuint texture);
+
+    // forgets everything, the next call of each kind is issued
+    void invalidate();
+
+    // calls since the last call
+    GLStateStats takeStats();
+
+  private:
+    // bindings of these units are tracked, binding to higher ones is always issued
+    static const unsigned int TRACKED_TEXTURE_UNITS = 16;
+    // GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP
+    static const unsigned int TRACKED_TEXTURE_TARGETS = 2;
+
+    // ~0 for names and enums, -1 for flags: not known, the next call is issued
+    GLuint program;
+    GLuint vertexArray;
+    GLuint activeUnit;
+    GLuint textures[TRACKED_TEXTURE_UNITS][TRACKED_TEXTURE_TARGETS];
+    int blend;
+    GLenum blendSource;
+    GLenum blendDestination;
+    int depthTest;
+    GLenum depthFunction;
+    int cullFace;
+    GLenum cullFaceMode;
+
+    GLStateStats stats;
+
+    // whether cached has to change to value, updates it and the counters
+    template <typename T> bool changes(T &cached, T value);
+    void activeTexture(unsigned int unit);
+    void setCapability(GLenum capability, int &cached, bool enabled);
+};
+
+#endif
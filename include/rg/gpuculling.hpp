@@ -0,0 +1,119 @@
+#ifndef GPUCULLING_H
+#define GPUCULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/lod.hpp>
+#include <rg/mesh.hpp>
+#include <rg/occlusion.hpp>
+#include <rg/shader.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// what the GPU culler submitted since the last takeStats, it never reads back how many instances survived
+struct GpuCullingStats
+{
+    unsigned int instances = 0;
+    unsigned int dispatches = 0;
+    unsigned int drawCalls = 0;
+};
+
+// GPU driven drawing of many instances of the same meshes, on GL 4.3 contexts (glExtensions.hasGpuCulling).
+//
+// The model matrices, the bounds and level errors of the meshes and the occlusion buffer of an OcclusionCuller go
+// into shader storage buffers. A compute shader (gpu_culling.cs) culls every mesh of every instance against the
+// frustum and the occlusion buffer, picks its level of detail like the LodSelector and appends its matrix to the
+// DrawElementsIndirectCommand of that level. Meshes with placements do that for every copy, so the copies are
+// instances of the same commands. A mesh has room for all of its copies in all instances once, its levels share it:
+// the shader runs three passes, the first culls and counts the copies of every level, the second lays the levels out
+// one after the other in the mesh's range (their base instances, where the instance attributes read the matrices
+// from) and the third writes the InstanceData. Every mesh then goes out in one glMultiDrawElementsIndirect over its
+// levels (textures can't change within a draw), so the CPU cost only depends on the number of meshes, however many
+// instances there are.
+class GpuCuller
+{
+  public:
+    GpuCuller();
+    ~GpuCuller();
+
+    GpuCuller(const GpuCuller &) = delete;
+    GpuCuller &operator=(const GpuCuller &) = delete;
+
+    // whether the context has compute shaders and multi draw indirect
+    static bool isSupported();
+
+    // starts a frame: takes the view projection, the camera of the selector and, if not null, uploads the occlusion
+    // buffer (rendered already) for the draws that follow
+    void begin(const glm::mat4 &viewProjection, const LodSelector &selector, const OcclusionCuller *occlusion);
+    // culls the meshes for every model matrix and draws what's left. The shader has to be compiled with
+    // INSTANCED_DEFINE, its samplers have to be set (see Model::Draw).
+    void draw(Shader &shader, std::vector<Mesh> &meshes, const std::vector<glm::mat4> &models);
+
+    GpuCullingStats takeStats();
+
+  private:
+    // the layout of MeshInfo in gpu_culling.cs (std430)
+    struct MeshInfo
+    {
+        glm::vec4 boxMin;
+        glm::vec4 boxMax;
+        glm::vec4 sphere;
+        uint32_t firstCommand;
+        uint32_t levelCount;
+        uint32_t firstPlacement;
+        uint32_t placementCount;
+    };
+    // as glMultiDrawElementsIndirect reads it
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    enum Binding
+    {
+        INSTANCES,
+        MESHES,
+        LEVEL_ERRORS,
+        COMMANDS,
+        VISIBLE,
+        OCCLUSION_DEPTH,
+        OCCLUSION_HIZ,
+        PLACEMENTS,
+        COPY_LEVELS,
+        BINDING_COUNT
+    };
+
+    std::unique_ptr<Shader> cullShader;
+    GLuint buffers[BINDING_COUNT] = {};
+    // bytes of the buffers that only the shader writes, they grow but aren't specified anew every frame
+    size_t capacities[BINDING_COUNT] = {};
+    // the frame's values from begin
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    float projectionScale = 1.0f;
+    float lodThreshold = -1.0f;
+    bool occlusion = false;
+    GpuCullingStats stats;
+
+    // filled anew by every draw, members so that their capacity is kept between frames
+    std::vector<MeshInfo> meshInfos;
+    std::vector<float> levelErrors;
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<glm::mat4> placements;
+
+    // replaces the contents of the buffer bound to the binding point
+    void upload(Binding binding, const void *data, size_t size);
+    // makes the buffer bound to the binding point at least size bytes large, its contents are undefined
+    void reserve(Binding binding, size_t size);
+    // runs one pass of the shader over count invocations and waits for its writes to the storage buffers
+    void dispatch(int pass, unsigned int count);
+};
+
+#endif // !GPUCULLING_H
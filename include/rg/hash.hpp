@@ -0,0 +1,47 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// 64-bit FNV-1a. Cheap, good enough for cache keys and hashed lookup tables (not for anything security related).
+const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+const uint64_t FNV_PRIME = 1099511628211ull;
+
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = FNV_OFFSET_BASIS)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// constexpr so that hashes of string literals can be computed at compile time
+constexpr uint64_t hashString(const char *str, uint64_t seed = FNV_OFFSET_BASIS)
+{
+    uint64_t hash = seed;
+    while (*str)
+    {
+        hash ^= static_cast<unsigned char>(*str++);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+inline uint64_t hashString(const std::string &str, uint64_t seed = FNV_OFFSET_BASIS)
+{
+    return hashBytes(str.data(), str.size(), seed);
+}
+
+// mixes a trivially copyable value into an existing hash
+template <typename T> inline uint64_t hashCombine(uint64_t seed, const T &value)
+{
+    return hashBytes(&value, sizeof(T), seed);
+}
+
+#endif // !HASH_H
@@ -0,0 +1,79 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <glad/glad.h>
+
+#include <rg/ktx.hpp>
+
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+// pixel data decoded by stb_image, freed together with the image, or a block compressed texture read from a cooked
+// KTX file (then data stays nullptr and the mip chain is in cooked)
+struct Image
+{
+    std::string path;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    unsigned char *data = nullptr; // nullptr if decoding failed
+    KtxTexture cooked;
+
+    Image() = default;
+    ~Image();
+
+    Image(const Image &) = delete;
+    Image &operator=(const Image &) = delete;
+
+    // GL_RED, GL_RGB or GL_RGBA depending on the number of components
+    GLenum getFormat() const;
+
+    bool isCooked() const
+    {
+        return !cooked.levels.empty();
+    }
+    bool isValid() const
+    {
+        return data || isCooked();
+    }
+};
+
+typedef std::shared_future<std::shared_ptr<const Image>> ImageFuture;
+
+// decodes the image on the global thread pool and returns immediately. Start all decodes first and wait afterwards,
+// that way the images are decoded in parallel while the GL thread does something else.
+ImageFuture loadImageAsync(const std::string &path);
+
+// decodes the image on the calling thread. If the texture cooker has written an up to date <path>.ktx next to it,
+// that is read instead and the image comes with its compressed mip chain.
+std::shared_ptr<const Image> loadImage(const std::string &path);
+
+// cooked textures need GL_EXT_texture_compression_s3tc, without it the source images are always decoded
+void setCookedTexturesEnabled(bool enabled);
+bool isCookedTexturesEnabled();
+
+// where the texture cooker puts the cooked version of a texture, and of a cubemap (next to its first face)
+std::string getCookedTexturePath(const std::string &path);
+std::string getCookedCubemapPath(const std::vector<std::string> &faces);
+
+// whether the cooked file exists and is at least as new as all of its sources
+bool hasCookedTexture(const std::string &cookedPath, const std::vector<std::string> &sources);
+
+// reads a cooked KTX file, the image is invalid if that fails
+std::shared_ptr<const Image> loadCookedImage(const std::string &cookedPath);
+
+// uploads a decoded image (and generates its mipmaps) or a cooked one (with its own mip chain) into the 2D texture,
+// must be called on the GL thread
+void uploadTexture(unsigned int textureID, const Image &image);
+
+// waits for the six faces (+X, -X, +Y, -Y, +Z, -Z) and uploads them into the cubemap, must be called on the GL thread
+void uploadCubemap(unsigned int textureID, const std::vector<ImageFuture> &faces);
+// uploads a cooked cubemap (all six faces in one image) into the cubemap
+void uploadCubemap(unsigned int textureID, const Image &cooked);
+
+// sets the sampling parameters of a cubemap, with trilinear filtering if it has mipmaps
+void setCubemapParameters(bool mipmaps);
+
+#endif // !IMAGE_H
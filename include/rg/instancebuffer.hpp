@@ -0,0 +1,81 @@
+#ifndef INSTANCEBUFFER_H
+#define INSTANCEBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// the model matrix of an instance takes four vec4 attributes from this location on, after the vertex attributes
+const unsigned int INSTANCE_MATRIX_LOCATION = 5;
+// and its normal matrix three vec3 attributes from this one on
+const unsigned int INSTANCE_NORMAL_MATRIX_LOCATION = 9;
+// shaders compiled with it read the model matrix from the instance attributes instead of the model uniform
+const char *const INSTANCED_DEFINE = "INSTANCED";
+
+// transforms normals like the model matrix transforms positions (the transposed inverse of its linear part), set
+// next to the model matrix so that vertex shaders don't invert it per vertex
+inline glm::mat3 getNormalMatrix(const glm::mat4 &model)
+{
+    return glm::transpose(glm::inverse(glm::mat3(model)));
+}
+
+// what the instance attributes read per instance, the columns of the normal matrix are padded to vec4 (the std430
+// layout of the instances GpuCuller writes)
+struct InstanceData
+{
+    glm::mat4 model;
+    glm::vec4 normalMatrix[3];
+
+    InstanceData() = default;
+    explicit InstanceData(const glm::mat4 &model) : model(model)
+    {
+        glm::mat3 normal = getNormalMatrix(model);
+        for (int column = 0; column < 3; column++)
+            normalMatrix[column] = glm::vec4(normal[column], 0.0f);
+    }
+};
+
+// Per instance model matrices for instanced draws, written anew every frame: begin() orphans the buffer, append()
+// adds the matrices of one draw behind the ones already in it. GL 3.3 has no base instance, so instead of passing the
+// index of the first matrix to the draw, bindAttributes points the instance attributes of the bound VAO at it. The
+// normal matrix of every instance is computed once as it is appended.
+class InstanceBuffer
+{
+  public:
+    InstanceBuffer() = default;
+    ~InstanceBuffer();
+
+    InstanceBuffer(const InstanceBuffer &) = delete;
+    InstanceBuffer &operator=(const InstanceBuffer &) = delete;
+
+    // starts a frame, the matrices of the last one are dropped
+    void begin();
+    // returns the index of the first of the matrices
+    unsigned int append(const glm::mat4 *matrices, size_t count);
+    unsigned int append(const std::vector<glm::mat4> &matrices)
+    {
+        return append(matrices.data(), matrices.size());
+    }
+
+    // sets up the instance attributes of the bound vertex array to start at the matrix first
+    void bindAttributes(unsigned int first) const;
+    // the same for a buffer of InstanceData someone else fills (see GpuCuller)
+    static void bindAttributes(GLuint buffer, unsigned int first);
+
+    // matrices appended since begin()
+    size_t getCount() const
+    {
+        return matrices.size();
+    }
+
+  private:
+    GLuint buffer = 0;
+    // in instances
+    size_t capacity = 0;
+    // copy of the frame's instances, the buffer is filled from it again when it has to grow
+    std::vector<InstanceData> matrices;
+};
+
+#endif // !INSTANCEBUFFER_H
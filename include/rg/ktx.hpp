@@ -0,0 +1,54 @@
+#ifndef KTX_H
+#define KTX_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// S3TC is an extension (GL_EXT_texture_compression_s3tc) in every desktop driver, RGTC is core since GL 3.0
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+struct KtxLevel
+{
+    unsigned int width;
+    unsigned int height;
+    // bytes of one face, the faces of a level are stored back to back starting at offset
+    size_t faceSize;
+    size_t offset;
+};
+
+// A block compressed texture as stored in a KTX 1.1 file (https://registry.khronos.org/KTX/specs/1.0/ktxspec.v1.html):
+// a full or partial mip chain of a 2D texture or of all six faces of a cubemap (+X, -X, +Y, -Y, +Z, -Z).
+// Only compressed formats are supported, which is all the texture cooker writes.
+struct KtxTexture
+{
+    GLenum internalFormat = 0;
+    // GL_RED, GL_RG, GL_RGB or GL_RGBA
+    GLenum baseInternalFormat = 0;
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int faces = 1;
+    std::vector<KtxLevel> levels;
+    std::vector<unsigned char> data;
+
+    const unsigned char *getFace(unsigned int level, unsigned int face) const
+    {
+        return data.data() + levels[level].offset + face * levels[level].faceSize;
+    }
+    size_t getSize() const
+    {
+        return data.size();
+    }
+};
+
+// parses a KTX file held in memory, returns false (and prints why) if it is malformed or not supported
+bool parseKtx(const unsigned char *bytes, size_t size, KtxTexture &texture, const std::string &name);
+bool readKtx(const std::string &path, KtxTexture &texture);
+bool writeKtx(const std::string &path, const KtxTexture &texture);
+
+#endif // !KTX_H
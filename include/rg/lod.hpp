@@ -0,0 +1,64 @@
+#ifndef LOD_H
+#define LOD_H
+
+#include <glm/glm.hpp>
+
+#include <rg/camera.hpp>
+#include <rg/mesh.hpp>
+
+#include <vector>
+
+// level of detail every mesh of a model was drawn with last frame, selection continues from there
+struct LodState
+{
+    // per mesh, the finest level of its instances for instanced draws
+    std::vector<unsigned int> levels;
+    // per mesh, the level of every copy (instance times placement) of instanced draws, so that every instance keeps
+    // its own hysteresis
+    std::vector<std::vector<unsigned int>> copyLevels;
+    // triangles drawn with the selected levels
+    unsigned int triangles = 0;
+};
+
+// Picks the coarsest LOD of a mesh whose simplification error, projected onto the screen, stays below
+// pixelThreshold pixels. To keep meshes at a distance close to a switch point from popping back and forth, a mesh
+// only goes to a coarser level once that level's error is below (1 - hysteresis) times the threshold.
+class LodSelector
+{
+  public:
+    float pixelThreshold = 1.0f;
+    float hysteresis = 0.25f;
+    // when disabled every mesh is drawn at full detail
+    bool enabled = true;
+
+    // takes the camera position and field of view (Zoom) for the frame
+    void update(const Camera &camera, float viewportHeight);
+
+    // error of the mesh's LOD in pixels when drawn with the model matrix
+    float getScreenError(const Mesh &mesh, const glm::mat4 &model, unsigned int lod) const;
+
+    unsigned int select(const Mesh &mesh, const glm::mat4 &model, unsigned int current) const;
+    // for copies drawn at one level (the placements of a mesh in one model): the level of the copy the error is the
+    // largest for (the nearest one), so no copy is drawn coarser than it would be on its own
+    unsigned int select(const Mesh &mesh, const glm::mat4 *models, size_t count, unsigned int current) const;
+
+    // what update took, for selections made elsewhere (see GpuCuller)
+    const glm::vec3 &getCameraPosition() const
+    {
+        return cameraPosition;
+    }
+    float getProjectionScale() const
+    {
+        return projectionScale;
+    }
+
+  private:
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    // pixels covered by one model unit at distance 1
+    float projectionScale = 1.0f;
+
+    // pixels per model unit of error for the mesh drawn with the model matrix
+    float getErrorScale(const Mesh &mesh, const glm::mat4 &model) const;
+};
+
+#endif // !LOD_H
@@ -0,0 +1,88 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <rg/shader.hpp>
+#include <rg/texture.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// what a material texture is used for, the shaders name its samplers after getTextureTypeName
+enum class TextureType : uint8_t
+{
+    Diffuse,
+    Specular,
+    Normal,
+    Height
+};
+const unsigned int TEXTURE_TYPE_COUNT = 4;
+// samplers of one type a shader can have, texture_diffuse1 .. texture_diffuse4
+const unsigned int MAX_TEXTURES_PER_TYPE = 4;
+
+// "texture_diffuse", ... as in the shaders and the mesh cache
+const char *getTextureTypeName(TextureType type);
+// the inverse of getTextureTypeName, false for unknown names
+bool parseTextureType(const std::string &name, TextureType &type);
+
+// every sampler has a fixed texture unit: the n-th (from 0) texture of a type goes to type * MAX_TEXTURES_PER_TYPE + n.
+// So the sampler uniforms of a program never change and are set only once (see MaterialSamplers).
+inline unsigned int getMaterialTextureUnit(TextureType type, unsigned int n)
+{
+    return static_cast<unsigned int>(type) * MAX_TEXTURES_PER_TYPE + n;
+}
+
+struct Texture
+{
+    // shared with every other mesh/model that uses the same file, null for unresolved references
+    std::shared_ptr<TextureObject> object;
+    TextureType type = TextureType::Diffuse;
+    std::string path;
+};
+
+// The textures of a mesh with their units, assigned once when the mesh is created. Drawing only binds them.
+class Material
+{
+  public:
+    Material() = default;
+    // textures are numbered per type in the order given, beyond MAX_TEXTURES_PER_TYPE they're dropped
+    explicit Material(std::vector<Texture> &&textures);
+
+    // binds every texture to its unit (through the GLState, units that already have it are skipped)
+    void bind() const;
+
+    const std::vector<Texture> &getTextures() const
+    {
+        return textures;
+    }
+    // equal for materials with the same textures on the same units, what the RenderQueue groups draws by
+    uint16_t getSortKey() const
+    {
+        return sortKey;
+    }
+
+  private:
+    std::vector<Texture> textures;
+    uint16_t sortKey = 0;
+    // unit of each texture
+    std::vector<unsigned int> units;
+};
+
+// The sampler names of a shader prefix ("material." + "texture_diffuse" + N), hashed once. apply() points the
+// samplers of a program at their units, the first time the program is drawn with this prefix.
+class MaterialSamplers
+{
+  public:
+    explicit MaterialSamplers(const std::string &prefix = std::string());
+
+    // makes the program current if it has to set the samplers, so it can be called while building a RenderQueue
+    void apply(Shader &shader) const;
+
+  private:
+    // identifies the assignment, stored in Shader::samplerLayout
+    uint64_t layout;
+    uint64_t hashes[TEXTURE_TYPE_COUNT][MAX_TEXTURES_PER_TYPE];
+};
+
+#endif
@@ -6,8 +6,15 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <rg/frustum.hpp>
+#include <rg/geometrybuffer.hpp>
+#include <rg/instancebuffer.hpp>
+#include <rg/material.hpp>
+#include <rg/occlusion.hpp>
 #include <rg/shader.hpp>
+#include <rg/vertexformat.hpp>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -25,42 +32,262 @@ struct Vertex
     glm::vec3 Bitangent;
 };
 
-struct Texture
+// a level of detail: a range of the mesh's index buffer, all levels share the vertices
+struct MeshLod
 {
-    unsigned int id;
-    std::string type;
-    std::string path;
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    // largest deviation from the full mesh in model units
+    float error;
+};
+
+// a cluster of the first level's triangles (see buildMeshlets), a range of the index buffer with bounds to cull it by
+struct Meshlet
+{
+    unsigned int indexOffset;
+    unsigned int indexCount;
+    // bounding sphere in model space
+    glm::vec3 center;
+    float radius;
+    // the normals of all triangles lie in the cone around the axis, cutoff is the sine of its half angle. 1 for
+    // clusters whose triangles face too many ways to ever all face away from the camera.
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+// CPU side mesh data as produced by an import, doesn't touch any GL state so it can be built on a worker thread
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    // texture references (type and path relative to the model directory), objects get resolved when the Mesh is created
+    std::vector<Texture> textures;
+    // levels of detail, finest first, their indices are stored back to back in indices. Empty for a single level.
+    std::vector<MeshLod> lods;
+    // clusters of the first level, empty unless they were built
+    std::vector<Meshlet> meshlets;
+    // model space transforms of the copies the mesh stands for (see deduplicateMeshes), the first one is the mesh
+    // itself. Empty for a mesh that is drawn once as it is.
+    std::vector<glm::mat4> placements;
+};
+
+// what a Mesh keeps in CPU memory once its data is uploaded
+enum class MeshRetention
+{
+    // only the texture references, vertices and indices live on the GPU alone
+    GpuOnly,
+    // vertices and indices as well, for consumers that read them back (picking, baking, collision, ...)
+    KeepCpuData
 };
 
 class Mesh
 {
   public:
-    // mesh Data
+    // coarsest levels with more triangles than this get no occluder, rasterizing them would cost more than it saves.
+    // An occluder must never cover more than the mesh does, or visible meshes behind its silhouette get culled. An
+    // exact level (error 0) is used as it is. A simplified one can reach past the original surface by up to its
+    // error, so it is only used pulled inward by that much (shrinkOccluder), and meshes where that isn't safe (open,
+    // too sharp or too thin) get no occluder.
+    static const unsigned int MAX_OCCLUDER_TRIANGLES = 512;
+
+    // mesh Data, vertices and indices are empty unless the mesh was created with MeshRetention::KeepCpuData
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
+    // the textures with their units, only bound when drawing. The samplers are set per program by the model.
+    Material material;
 
-    unsigned int VAO;
-    std::string glslIdentifierPrefix;
-    // constructor
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+    unsigned int VAO = 0;
+    // constructor, takes over the data instead of copying it
+    Mesh(std::vector<Vertex> &&vertices, std::vector<unsigned int> &&indices, std::vector<Texture> &&textures,
+         VertexFormat format = VertexFormat::Full, std::vector<MeshLod> &&lods = std::vector<MeshLod>(),
+         MeshRetention retention = MeshRetention::GpuOnly)
+        : vertices(std::move(vertices)), indices(std::move(indices)), material(std::move(textures)), format(format),
+          retention(retention), lods(std::move(lods))
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
+        setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
+        if (retention == MeshRetention::GpuOnly)
+            releaseCpuData();
+    }
+
+    // constructor for already processed data (e.g. a mapped mesh cache), uploads it straight to the GPU and copies
+    // it only if it has to be retained
+    Mesh(const Vertex *vertices, unsigned int vertexCount, const unsigned int *indices, unsigned int indexCount,
+         std::vector<Texture> &&textures, VertexFormat format = VertexFormat::Full,
+         std::vector<MeshLod> &&lods = std::vector<MeshLod>(), MeshRetention retention = MeshRetention::GpuOnly)
+        : material(std::move(textures)), format(format), retention(retention), lods(std::move(lods))
+    {
+        if (retention == MeshRetention::KeepCpuData)
+        {
+            this->vertices.assign(vertices, vertices + vertexCount);
+            this->indices.assign(indices, indices + indexCount);
+        }
+        setupMesh(vertices, vertexCount, indices, indexCount);
     }
 
-    // render the mesh
-    void Draw(Shader &shader);
+    // the mesh owns its GL buffers, they are released with it
+    ~Mesh();
+    Mesh(Mesh &&other) noexcept;
+    Mesh &operator=(Mesh &&other) noexcept;
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+
+    // render the mesh at the given level of detail, binds only its textures (see MaterialSamplers for the samplers)
+    void Draw(Shader &shader, unsigned int lod = 0);
+    // renders count instances with the model matrices of the instance buffer from first on, the shader has to be
+    // compiled with INSTANCED_DEFINE
+    void DrawInstanced(Shader &shader, const InstanceBuffer &instances, unsigned int first, unsigned int count,
+                       unsigned int lod = 0);
+
+    // draws index ranges of the first level in one glMultiDrawElements, e.g. the meshlets that survived cullMeshlets.
+    // With an instance buffer every vertex reads the matrix of instance first (the draw itself isn't instanced).
+    void DrawRanges(Shader &shader, const GLsizei *counts, const void *const *offsets, unsigned int rangeCount,
+                    const InstanceBuffer *instances = nullptr, unsigned int first = 0);
+
+    // draws drawCount DrawElementsIndirectCommands of the bound GL_DRAW_INDIRECT_BUFFER from indirect on in one
+    // glMultiDrawElementsIndirect, instances read their model matrix from matrixBuffer at their base instance. The
+    // commands of a shared mesh address the whole GeometryBuffer (see getAllocation and GpuCuller).
+    void DrawIndirect(Shader &shader, GLuint matrixBuffer, const void *indirect, unsigned int drawCount);
+
+    // takes over the clusters of the first level
+    void setMeshlets(std::vector<Meshlet> &&meshlets);
+    const std::vector<Meshlet> &getMeshlets() const
+    {
+        return meshlets;
+    }
+    // Writes the index ranges of the meshlets that may be visible with the model matrix into counts and offsets (room
+    // for one range per meshlet), meshlets next to each other in the index buffer share a range. Meshlets outside
+    // the frustum are left out, and so are those whose triangles would all be discarded by face culling: cullFace
+    // (GL_FRONT or GL_BACK, 0 for none) and frontFace (GL_CCW or GL_CW) as they are set for the draw. Returns the
+    // number of ranges.
+    unsigned int cullMeshlets(const Frustum &frustum, const glm::mat4 &model, const glm::vec3 &cameraPosition,
+                              GLenum cullFace, GLenum frontFace, GLsizei *counts, const void **offsets,
+                              CullingStats &stats) const;
+
+    unsigned int getLodCount() const
+    {
+        return lods.size();
+    }
+    const MeshLod &getLod(unsigned int lod) const
+    {
+        return lods[lod];
+    }
+
+    // takes over the placements of the copies, see MeshData::placements
+    void setPlacements(std::vector<glm::mat4> &&placements);
+    // how often the mesh is drawn per model, at least once
+    unsigned int getPlacementCount() const
+    {
+        return placements.empty() ? 1 : static_cast<unsigned int>(placements.size());
+    }
+    // transform of a copy in model space, the identity for a mesh without placements
+    glm::mat4 getPlacement(unsigned int placement) const
+    {
+        return placements.empty() ? glm::mat4(1.0f) : placements[placement];
+    }
+
+    // bounding sphere in model space (of the mesh itself, not of its placed copies)
+    const glm::vec3 &getBoundingCenter() const
+    {
+        return boundingCenter;
+    }
+    float getBoundingRadius() const
+    {
+        return boundingRadius;
+    }
+    // axis aligned bounding box in model space
+    const glm::vec3 &getBoundingBoxMin() const
+    {
+        return boundingBoxMin;
+    }
+    const glm::vec3 &getBoundingBoxMax() const
+    {
+        return boundingBoxMax;
+    }
+
+    // the coarsest level of detail as an occluder in model space, empty if it has too many triangles
+    const OccluderMesh &getOccluder() const
+    {
+        return occluder;
+    }
+
+    // whether the mesh is suballocated from the GeometryBuffer of its format
+    bool isShared() const
+    {
+        return shared;
+    }
+
+    // the range of the GeometryBuffer the mesh lives in, only meaningful if it's shared
+    const GeometryAllocation &getAllocation() const
+    {
+        return allocation;
+    }
+
+    VertexFormat getVertexFormat() const
+    {
+        return format;
+    }
+
+    // bytes of vertex and index data in GPU memory
+    size_t getGpuMemory() const
+    {
+        return gpuMemory;
+    }
+    // bytes of mesh data held in CPU memory
+    size_t getCpuMemory() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) +
+               lods.capacity() * sizeof(MeshLod) + occluder.vertices.capacity() * sizeof(glm::vec3) +
+               occluder.indices.capacity() * sizeof(uint32_t) + meshlets.capacity() * sizeof(Meshlet) +
+               placements.capacity() * sizeof(glm::mat4);
+    }
+
+    MeshRetention getRetention() const
+    {
+        return retention;
+    }
+    // whether vertices and indices are available on the CPU
+    bool hasCpuData() const
+    {
+        return !vertices.empty();
+    }
+    // frees the CPU copies of vertices and indices, the mesh can still be drawn
+    void releaseCpuData();
 
   private:
     // render data
-    unsigned int VBO, EBO;
+    unsigned int VBO = 0, EBO = 0;
+    VertexFormat format = VertexFormat::Full;
+    MeshRetention retention = MeshRetention::GpuOnly;
+    GLenum indexType = GL_UNSIGNED_INT;
+    size_t gpuMemory = 0;
+    // always holds at least one level
+    std::vector<MeshLod> lods;
+    glm::vec3 boundingCenter = glm::vec3(0.0f);
+    float boundingRadius = 0.0f;
+    glm::vec3 boundingBoxMin = glm::vec3(0.0f);
+    glm::vec3 boundingBoxMax = glm::vec3(0.0f);
+    OccluderMesh occluder;
+    std::vector<Meshlet> meshlets;
+    // allocation.baseVertex once per meshlet, glMultiDrawElementsBaseVertex takes one per range
+    std::vector<GLint> meshletBaseVertices;
+    std::vector<glm::mat4> placements;
+    // decode of compact positions: positionOffset + position * positionScale
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
+
+    void release();
+    // binds the textures and the vertex array and sets the uniforms of the format
+    void bind(Shader &shader);
+    // Draw and DrawInstanced, instances is null for a plain draw
+    void draw(Shader &shader, unsigned int lod, const InstanceBuffer *instances, unsigned int first,
+              unsigned int count);
+
+    // the range of the format's GeometryBuffer the mesh lives in, if shared (VAO, VBO and EBO are 0 then)
+    bool shared = false;
+    GeometryAllocation allocation;
 
-    // initializes all the buffer objects/arrays
-    void setupMesh();
+    // initializes all the buffer objects/arrays, or suballocates them from the GeometryBuffer in megabuffer mode
+    void setupMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount);
 };
 #endif
@@ -0,0 +1,72 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <rg/filesystem.hpp>
+#include <rg/mesh.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Versioned binary cache of an imported model, written next to the source asset as "<asset>.rgcache".
+// It holds the final Vertex and index arrays of every mesh plus its LOD ranges, meshlets, placements and texture
+// references, so warm starts can map the file (or use it in place from an asset pack) and upload straight to the
+// VBO/EBO without running ASSIMP.
+// A cache is ignored (and later overwritten) when the source file size or modification time, the import flags, the
+// mesh optimizer passes, the Vertex layout or MESH_CACHE_VERSION don't match what was recorded in it. The same goes
+// for the size and modification time of every other file the import read (material libraries), or whether it exists.
+const uint32_t MESH_CACHE_VERSION = 6;
+
+struct CachedMesh
+{
+    // point into the mapped file, valid as long as the MeshCache is open
+    const Vertex *vertices;
+    unsigned int vertexCount;
+    const unsigned int *indices;
+    unsigned int indexCount;
+    const MeshLod *lods;
+    unsigned int lodCount;
+    const Meshlet *meshlets;
+    unsigned int meshletCount;
+    const glm::mat4 *placements;
+    unsigned int placementCount;
+    // texture references (type and path relative to the model directory), objects are not set
+    std::vector<Texture> textures;
+};
+
+class MeshCache
+{
+  public:
+    MeshCache() = default;
+    ~MeshCache();
+
+    MeshCache(const MeshCache &) = delete;
+    MeshCache &operator=(const MeshCache &) = delete;
+
+    // maps the cache belonging to the asset, returns false if there is none or if it is stale
+    bool open(const std::string &assetPath, unsigned int importFlags, unsigned int optimizeFlags);
+    void close();
+
+    const std::vector<CachedMesh> &getMeshes() const
+    {
+        return meshes;
+    }
+
+    // writes the cache for the asset, returns false on failure (e.g. read-only asset directory). dependencies are the
+    // other files the import read or looked for, see FileSystemIOSystem::getOpenedPaths.
+    static bool write(const std::string &assetPath, unsigned int importFlags, unsigned int optimizeFlags,
+                      const std::vector<MeshData> &meshes,
+                      const std::vector<std::string> &dependencies = std::vector<std::string>());
+
+    // reads the cache into owned arrays, for callers that can't keep the mapping alive
+    static bool read(const std::string &assetPath, unsigned int importFlags, unsigned int optimizeFlags,
+                     std::vector<MeshData> &meshes);
+
+    static std::string getCachePath(const std::string &assetPath);
+
+  private:
+    FileView file;
+    std::vector<CachedMesh> meshes;
+};
+
+#endif // !MESHCACHE_H
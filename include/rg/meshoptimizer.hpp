@@ -0,0 +1,78 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <rg/mesh.hpp>
+
+#include <string>
+#include <vector>
+
+// passes of optimizeMeshes, part of the mesh cache key
+const unsigned int MESH_OPTIMIZE_VERTEX_CACHE = 1 << 0;
+const unsigned int MESH_OPTIMIZE_OVERDRAW = 1 << 1; // needs MESH_OPTIMIZE_VERTEX_CACHE
+const unsigned int MESH_OPTIMIZE_VERTEX_FETCH = 1 << 2;
+const unsigned int MESH_OPTIMIZE_GENERATE_LODS = 1 << 3; // see generateLods
+const unsigned int MESH_OPTIMIZE_MESHLETS = 1 << 4;       // see buildMeshlets
+const unsigned int MESH_OPTIMIZE_DEDUPLICATE = 1 << 5;     // see deduplicateMeshes
+
+// limits of a meshlet, the sizes commonly used for mesh shader clusters
+const unsigned int MESHLET_MAX_VERTICES = 64;
+const unsigned int MESHLET_MAX_TRIANGLES = 124;
+
+// size of the simulated post-transform cache (FIFO) the orderings are optimized for and measured with
+const unsigned int MESH_OPTIMIZER_CACHE_SIZE = 16;
+
+// result of running an index buffer through the simulated post-transform cache
+struct VertexCacheStatistics
+{
+    unsigned int triangles = 0;
+    unsigned int vertices = 0; // referenced vertices
+    unsigned int misses = 0;   // vertex shader invocations
+
+    // average cache miss ratio, vertex shader invocations per triangle (0.5 at best, 3 at worst)
+    float getACMR() const
+    {
+        return triangles ? float(misses) / triangles : 0.0f;
+    }
+    // average transformed vertex ratio, vertex shader invocations per vertex (1 at best)
+    float getATVR() const
+    {
+        return vertices ? float(misses) / vertices : 0.0f;
+    }
+};
+
+VertexCacheStatistics analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                         unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE);
+
+// reorders the triangles for post-transform cache hits (Tipsify, Sander et al. 2007)
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount,
+                         unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE);
+
+// works on a cache optimized order: cuts it into clusters that start with a cold cache, allowing each cluster to
+// cost up to threshold times the ACMR it had in place, and sorts them so outward facing ones are drawn first, which
+// lets the depth test reject more of what lies behind them
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices,
+                      float threshold = 1.05f, unsigned int cacheSize = MESH_OPTIMIZER_CACHE_SIZE);
+
+// renumbers the vertices in the order the index buffer first references them, so vertex fetches walk the buffer
+// sequentially. Unreferenced vertices are dropped.
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices);
+
+// cuts the first LOD into meshlets of at most maxVertices vertices and maxTriangles triangles, each with a bounding
+// sphere and a normal cone (Meshlet). A meshlet grows from the first triangle left in the current order into the
+// neighbour adding the fewest vertices, which keeps it compact and its normals close together, then its triangles are
+// reordered for the vertex cache. The first LOD's triangles end up grouped by meshlet.
+void buildMeshlets(MeshData &mesh, unsigned int maxVertices = MESHLET_MAX_VERTICES,
+                   unsigned int maxTriangles = MESHLET_MAX_TRIANGLES);
+
+// Merges meshes that are copies of each other under a rotation and a translation (rotor blades, wheels, missiles...)
+// into the first of them, which gets a placement per copy (MeshData::placements). Candidates are found by a hash of
+// what a rigid transform leaves alone (indices, texture coordinates and textures), then the transform is solved from
+// two reference vertices and every position, normal, tangent and bitangent is checked against it. Meant to run on
+// the meshes straight from the import, while copies still have their vertices and triangles in the same order.
+void deduplicateMeshes(std::vector<MeshData> &meshes);
+
+// runs the passes given in flags over every mesh and prints the ACMR/ATVR of the whole set (first LOD) before and
+// after each
+void optimizeMeshes(std::vector<MeshData> &meshes, unsigned int flags, const std::string &name);
+
+#endif // !MESHOPTIMIZER_H
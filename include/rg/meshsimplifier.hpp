@@ -0,0 +1,20 @@
+#ifndef MESHSIMPLIFIER_H
+#define MESHSIMPLIFIER_H
+
+#include <rg/mesh.hpp>
+
+#include <vector>
+
+// Simplifies a triangle list by quadric error edge collapses (Garland & Heckbert 1997). Collapses move a vertex onto
+// one of its neighbours, so the result indexes the same vertex array and all LODs of a mesh can share one vertex
+// buffer. Vertices on UV/normal seams only collapse along the seam (together with their twin on the other side) and
+// vertices on open borders only along the border, so neither tears. Returns the new index list, error receives the
+// largest collapse error as a distance in model units.
+std::vector<unsigned int> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                                       size_t targetIndexCount, float &error);
+
+// appends simplified versions of the mesh's first LOD until maxLods levels exist or the simplification stalls. Every
+// level targets ratio times the triangles of the previous one.
+void generateLods(MeshData &mesh, unsigned int maxLods = 4, float ratio = 0.5f);
+
+#endif // !MESHSIMPLIFIER_H
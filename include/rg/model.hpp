@@ -10,7 +10,13 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <rg/gpuculling.hpp>
+#include <rg/image.hpp>
+#include <rg/lod.hpp>
 #include <rg/mesh.hpp>
+#include <rg/meshoptimizer.hpp>
+#include <rg/occlusion.hpp>
+#include <rg/renderqueue.hpp>
 #include <rg/shader.hpp>
 
 #include <string>
@@ -18,6 +24,7 @@
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 
 unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma = false);
@@ -25,37 +32,138 @@ unsigned int TextureFromFile(const char *path, const std::string &directory, boo
 class Model
 {
   public:
-    // model data
-    std::vector<Texture> textures_loaded; // stores all the textures loaded so far, optimization to make sure textures
-                                          // aren't loaded more than once.
+    // post processing applied on import, part of the mesh cache key. Without JoinIdenticalVertices every face corner
+    // of an OBJ would be a vertex of its own, leaving nothing for the vertex cache to reuse.
+    static const unsigned int ImportFlags = aiProcess_Triangulate | aiProcess_JoinIdenticalVertices |
+                                            aiProcess_GenSmoothNormals | aiProcess_FlipUVs |
+                                            aiProcess_CalcTangentSpace;
+    // mesh optimizer passes run after the import, part of the mesh cache key as well
+    // Copies of a mesh are merged into placements of one (MESH_OPTIMIZE_DEDUPLICATE), every draw below draws a mesh
+    // at all of its placements.
+    static const unsigned int OptimizeFlags = MESH_OPTIMIZE_DEDUPLICATE | MESH_OPTIMIZE_VERTEX_CACHE |
+                                              MESH_OPTIMIZE_OVERDRAW | MESH_OPTIMIZE_MESHLETS |
+                                              MESH_OPTIMIZE_GENERATE_LODS | MESH_OPTIMIZE_VERTEX_FETCH;
+
+    // model data (textures are shared process wide through the AssetRegistry, so they aren't loaded more than once)
     std::vector<Mesh> meshes;
     std::string directory;
     bool gammaCorrection;
+    // layout the meshes are uploaded in, set before they are added
+    VertexFormat vertexFormat = VertexFormat::Full;
+    // whether the meshes keep their vertices and indices in CPU memory after the upload, set before they are added
+    MeshRetention retention = MeshRetention::GpuOnly;
+    // whether megabuffer mode (GeometryBuffer) was on when the model was created
+    bool sharedGeometry = GeometryBuffer::isEnabled();
+    // false while an AssetStreamer is still uploading the model, Draw skips it until then
+    bool ready = true;
 
     // constructor, expects a filepath to a 3D model.
-    Model(std::string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(std::string const &path, bool gamma = false, VertexFormat format = VertexFormat::Full,
+          MeshRetention retention = MeshRetention::GpuOnly)
+        : gammaCorrection(gamma), vertexFormat(format), retention(retention)
     {
         loadModel(path);
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader);
+    // constructs an empty model, meshes are added later through addMesh (see AssetStreamer)
+    Model() : gammaCorrection(false)
+    {
+    }
+
+    // draws the model, and thus all its meshes, setting the model uniform to the model matrix of every placement
+    void Draw(Shader &shader, const glm::mat4 &model);
+    // draws every mesh at the level of detail the selector picks for it, state carries the levels between frames
+    void Draw(Shader &shader, const LodSelector &selector, const glm::mat4 &model, LodState &state);
+    // the same selection as the Draw above, but every mesh becomes a packet of the queue culling cullFace (0 for none)
+    void submit(RenderQueue &queue, Shader &shader, const LodSelector &selector, const glm::mat4 &model,
+                LodState &state, GLenum cullFace = 0);
+
+    // draws every mesh once for all model matrices, as an instanced draw. The shader has to be compiled with
+    // INSTANCED_DEFINE.
+    void Draw(Shader &shader, InstanceBuffer &instances, const std::vector<glm::mat4> &models);
+    // the instanced Draw as packets of the queue, every instance of a mesh gets its own level of detail and the
+    // instances are drawn in one packet per level
+    void submit(RenderQueue &queue, Shader &shader, const LodSelector &selector, InstanceBuffer &instances,
+                const std::vector<glm::mat4> &models, LodState &state, GLenum cullFace = 0);
+    // draws the model for all model matrices with the culling and level selection done on the GPU, see GpuCuller.
+    // The shader has to be compiled with INSTANCED_DEFINE.
+    void Draw(Shader &shader, GpuCuller &culler, const std::vector<glm::mat4> &models);
 
     void SetShaderTextureNamePrefix(std::string prefix);
 
+    // model space box around all meshes, empty until the meshes are loaded
+    BoundingBox getBoundingBox() const;
+    // adds the occluders of all meshes (their coarsest levels of detail) placed with the model matrix
+    void addOccluders(OcclusionCuller &culler, const glm::mat4 &model) const;
+
+    // bytes of vertex and index data of all meshes in GPU memory
+    size_t getGpuMemory() const;
+    // bytes of mesh data of all meshes kept in CPU memory
+    size_t getCpuMemory() const;
+
+    // CPU side of loading: fills data from the mesh cache or, if that is stale, from ASSIMP (refreshing the cache).
+    // Touches no GL state, so it can run on a worker thread.
+    static bool readMeshData(std::string const &path, std::vector<MeshData> &data);
+
+    // creates the GPU side of a mesh and appends it to the model, its texture references are resolved through
+    // the AssetRegistry. The data is moved out of the MeshData. Must be called on the GL thread.
+    void addMesh(MeshData &data);
+
   private:
+    // sampler names of the texture name prefix, applied to the program in Draw
+    MaterialSamplers samplers;
+
+    // results of cull and its scratch space, members so that their capacity is kept between frames
+    BoundingBoxes cullingBoxes;
+    std::vector<uint8_t> cullingResults;
+    std::vector<glm::mat4> visibleModels;
+    // index of every visible instance in the model matrices passed to cull
+    std::vector<size_t> visibleIndices;
+    std::vector<uint8_t> meshVisible;
+    // the visible copies of meshes with placements, the range of mesh i starts at placedFirst[i]
+    std::vector<glm::mat4> placedModels;
+    std::vector<size_t> placedFirst;
+    // which copy every one of placedModels is: instance index times placement count plus placement
+    std::vector<size_t> placedCopies;
+    // the copies of a mesh drawn at every level of detail, scratch of the instanced submit
+    std::vector<std::vector<glm::mat4>> lodBuckets;
+
+    // frustum culls the instances (by the box around all meshes) and then the meshes of the visible ones against the
+    // queue's frustum. Leaves the visible instances in visibleModels (their indices in visibleIndices) and whether a
+    // mesh is visible in any of them in meshVisible, the counts go to the queue's statistics. The visible copies of a
+    // mesh with placements (model matrix times placement) go to its range of placedModels and placedCopies.
+    void cull(RenderQueue &queue, const glm::mat4 *models, size_t count);
+    // model matrices of the mesh's copies in the instances, appended to placed instance by instance
+    static void placeModels(const Mesh &mesh, const glm::mat4 *models, size_t count, std::vector<glm::mat4> &placed);
+
+    // textures whose images are still being decoded on a worker thread
+    std::vector<std::pair<std::shared_ptr<TextureObject>, ImageFuture>> pendingTextures;
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(std::string const &path);
 
+    // imports the model via ASSIMP, optimizes it and writes the mesh cache for the next run
+    void importModel(std::string const &path);
+    static bool importMeshData(std::string const &path, std::vector<MeshData> &data);
+
+    // builds the meshes from the binary mesh cache next to the asset, returns false if the cache is missing or stale
+    bool loadFromCache(std::string const &path);
+
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this
     // process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene);
+    static void processNode(aiNode *node, const aiScene *scene, std::vector<MeshData> &data);
+
+    static MeshData processMesh(aiMesh *mesh, const aiScene *scene);
+
+    // collects all material textures of a given type, the required info is returned as Texture references.
+    static std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureType typeName);
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene);
+    // returns the texture at the given path (relative to the model directory), loading it only if no other model
+    // has it loaded already. The image is decoded asynchronously, the data arrives in uploadPendingTextures.
+    Texture loadTexture(const std::string &path, TextureType typeName);
 
-    // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName);
+    // waits for the outstanding decodes and uploads them on the GL thread
+    void uploadPendingTextures();
 };
 
 unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma);
@@ -0,0 +1,59 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <utility>
+
+// Unbounded lock-free multi producer / single consumer queue (Vyukov style linked list).
+// push may be called from any thread, pop only from a single consumer thread (in practice the GL thread).
+template <typename T> class MPSCQueue
+{
+  public:
+    MPSCQueue() : head(new Node()), tail(head.load(std::memory_order_relaxed))
+    {
+    }
+
+    ~MPSCQueue()
+    {
+        T value;
+        while (pop(value))
+            ;
+        delete tail;
+    }
+
+    MPSCQueue(const MPSCQueue &) = delete;
+    MPSCQueue &operator=(const MPSCQueue &) = delete;
+
+    void push(T value)
+    {
+        Node *node = new Node();
+        node->value = std::move(value);
+        // publish the node: swing head first, then link the previous head to it
+        Node *previous = head.exchange(node, std::memory_order_acq_rel);
+        previous->next.store(node, std::memory_order_release);
+    }
+
+    // returns false if the queue is empty (or a producer is halfway through a push)
+    bool pop(T &value)
+    {
+        Node *next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        value = std::move(next->value);
+        delete tail;
+        tail = next; // next becomes the new stub node
+        return true;
+    }
+
+  private:
+    struct Node
+    {
+        std::atomic<Node *> next{nullptr};
+        T value;
+    };
+
+    std::atomic<Node *> head; // last pushed node, shared by the producers
+    Node *tail;               // stub node owned by the consumer
+};
+
+#endif // !MPSCQUEUE_H
@@ -0,0 +1,127 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <rg/frustum.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+// Low poly stand-in of something that hides what's behind it, in model space. Meshes make one from their coarsest
+// level of detail, simple shapes (walls, floors) can be put together by hand.
+struct OccluderMesh
+{
+    std::vector<glm::vec3> vertices;
+    std::vector<uint32_t> indices;
+
+    bool isEmpty() const
+    {
+        return indices.empty();
+    }
+};
+
+// Pulls the occluder inward so that every face plane moves back by at least distance, for a simplified level whose
+// vertices lie up to distance off the original surface (MeshLod::error). Every vertex moves along its area weighted
+// normal by distance over the smallest cosine between that normal and its faces. Returns false, leaving the occluder
+// as it was, if that isn't safe: the occluder isn't closed (after welding equal positions), a vertex is too sharp
+// for the move to stay small, or a triangle turns over (a part thinner than the move crossing itself).
+bool shrinkOccluder(OccluderMesh &occluder, float distance);
+
+// work and results of the occlusion culler since the last takeStats
+struct OcclusionStats
+{
+    unsigned int occluderTriangles = 0;
+    unsigned int tested = 0;
+    unsigned int occluded = 0;
+};
+
+// Software occlusion culling: occluders are rasterized on the CPU into a small depth buffer, then bounding boxes are
+// tested against it before anything is submitted, so there is no GPU readback and no frame of latency.
+//
+// The buffer holds 1/w (w is the view space depth), which unlike w interpolates linearly across a triangle on
+// screen, and is 0 where nothing was drawn. Triangles are binned into screen tiles, which the calling thread and
+// the workers of the culler's own ThreadPool take one at a time and rasterize four pixels at a time with SSE2. The
+// pool isn't the global one, so the frame never waits behind streaming jobs (imports, mesh optimization) there.
+// A box is occluded if at every pixel it covers an occluder is nearer than the box's nearest corner. The test goes
+// through a Hi-Z level (the farthest depth of every 8x8 block) first and only looks at single pixels in blocks where
+// that isn't enough.
+class OcclusionCuller
+{
+  public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+    static const int TILE_WIDTH = 64;
+    static const int TILE_HEIGHT = 32;
+    static const int BLOCK_SIZE = 8;
+    static const int BLOCKS_X = WIDTH / BLOCK_SIZE;
+    static const int BLOCKS_Y = HEIGHT / BLOCK_SIZE;
+
+    OcclusionCuller();
+    ~OcclusionCuller();
+
+    OcclusionCuller(const OcclusionCuller &) = delete;
+    OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+    // starts a frame: clears the buffer and the occluders, they are projected with viewProjection
+    void begin(const glm::mat4 &viewProjection);
+    // projects the triangles of the occluder, those crossing the near plane are left out
+    void addOccluder(const OccluderMesh &occluder, const glm::mat4 &model);
+    // rasterizes the occluders added since begin and builds the Hi-Z level, waits for all tiles
+    void render();
+
+    // whether anything of the world space box may be visible. Boxes reaching behind the near plane or off the
+    // screen count as visible, frustum culling is a separate step.
+    bool testBox(const BoundingBox &box);
+
+    OcclusionStats takeStats();
+
+    // the rendered buffer, row by row from the bottom, and its Hi-Z level (BLOCKS_X * BLOCKS_Y), e.g. to test boxes
+    // on the GPU
+    const std::vector<float> &getDepth() const
+    {
+        return depth;
+    }
+    const std::vector<float> &getHiZ() const
+    {
+        return hiZ;
+    }
+
+  private:
+    static const int TILES_X = WIDTH / TILE_WIDTH;
+    static const int TILES_Y = HEIGHT / TILE_HEIGHT;
+
+    // a projected occluder triangle set up for rasterization, in pixels
+    struct ScreenTriangle
+    {
+        // edge functions a * x + b * y + c, all three non-negative inside
+        float edgeA[3], edgeB[3], edgeC[3];
+        // plane of 1/w over the screen
+        float depthA, depthB, depthC;
+        // pixel bounds, clamped to the screen
+        int minX, minY, maxX, maxY;
+    };
+
+    glm::mat4 viewProjection;
+    std::vector<ScreenTriangle> triangles;
+    // triangles overlapping every tile
+    std::vector<uint32_t> bins[TILES_X * TILES_Y];
+    std::vector<float> depth;
+    // smallest (farthest) depth of every block
+    std::vector<float> hiZ;
+    OcclusionStats stats;
+    // helps the calling thread rasterize, null on single core machines where it does all tiles itself
+    std::unique_ptr<ThreadPool> workers;
+    // the next tile of render() nobody has taken yet
+    std::atomic<int> nextTile;
+
+    // rasterizes tiles until none are left
+    void rasterizeTiles();
+    void rasterizeTile(int tile);
+};
+
+#endif // !OCCLUSION_H
@@ -0,0 +1,43 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk cache of linked shader programs (glGetProgramBinary), one "<key>.bin" file per program in the cache
+// directory. The key hashes the final source of every stage, the defines and the driver's vendor, renderer and
+// version strings, so any change to one of them simply misses. Drivers may still reject a binary (e.g. after an
+// update that kept the version string), then load() fails and the caller compiles from source as if there had been
+// no cache. Needs the program binary entry points (glExtensions.hasProgramBinary), without them it never hits.
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+class ProgramCache
+{
+  public:
+    // where the binaries go, created on the first store (default "shader_cache" in the working directory)
+    static void setDirectory(const std::string &directory);
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+
+    // needs a current GL context for the driver strings
+    static uint64_t computeKey(const std::vector<std::string> &sources, const std::vector<std::string> &defines);
+
+    // replaces the program's contents with the cached binary, returns false (leaving the program unlinked) if there
+    // is none or the driver rejected it
+    static bool load(uint64_t key, GLuint program);
+    // call before linking a program that is going to be stored, some drivers only keep binaries when asked to
+    static void prepare(GLuint program);
+    // saves the linked program, returns false on failure (e.g. a read-only directory)
+    static bool store(uint64_t key, GLuint program);
+
+    static std::string getCachePath(uint64_t key);
+
+    // programs loaded from the cache and compiled from source since the start
+    static unsigned int getHitCount();
+    static unsigned int getMissCount();
+};
+
+#endif // !PROGRAMCACHE_H
@@ -1,8 +1,14 @@
 #ifndef PROGRAMSTATE_H
 #define PROGRAMSTATE_H
 
+#include <rg/lod.hpp>
 #include <rg/pointlight.hpp>
 #include <rg/camera.hpp>
+#include <rg/glstate.hpp>
+#include <rg/gpuculling.hpp>
+#include <rg/occlusion.hpp>
+#include <rg/renderqueue.hpp>
+#include <rg/shader.hpp>
 #include <glm/glm.hpp>
 
 #include <string>
@@ -18,9 +24,36 @@ class ProgramState
     // objects positions
     glm::vec3 objectPosition = glm::vec3(0.f);
     float objectScale = 1.f;
+    // helicopters drawn (instanced) in a grid starting at objectPosition
+    int helicopterCount = 1;
     bool blinn = false;
     bool hdr = false;
     float exposure = 1.f;
+    // asset streaming upload budget
+    int uploadBudgetKB = 4096;
+    // draw the model with the quantized vertex format (VertexFormat::Compact)
+    bool compactVertices = false;
+    // suballocate static meshes from the shared GeometryBuffer (megabuffer) of their vertex format
+    bool sharedGeometry = false;
+    // level of detail selection of the model and the levels it was drawn with
+    LodSelector lodSelector;
+    LodState helicopterLod;
+    // test the helicopters against the nearest ones and the plate rasterized on the CPU (OcclusionCuller)
+    bool occlusionCulling = true;
+    // draw only the meshlets that face the camera and intersect the frustum (RenderQueue::cullMeshlets)
+    bool meshletCulling = true;
+    // cull the helicopters and pick their levels in a compute shader (GpuCuller), only if the context supports it
+    bool gpuCulling = true;
+    // uniform calls of the last frame
+    UniformStats uniformStats;
+    // GL state changes of the last frame
+    GLStateStats glStateStats;
+    // draw packets of the last frame
+    RenderQueueStats renderQueueStats;
+    // occlusion culling of the last frame
+    OcclusionStats occlusionStats;
+    // GPU culling of the last frame
+    GpuCullingStats gpuCullingStats;
 
     ProgramState() : camera(glm::vec3(0.f, 0.f, 3.f)) {}
 
@@ -0,0 +1,207 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <rg/frustum.hpp>
+#include <rg/instancebuffer.hpp>
+#include <rg/material.hpp>
+#include <rg/mesh.hpp>
+#include <rg/shader.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for data that lives for one frame. Allocating is a pointer bump, reset() frees everything at once.
+// If a frame needed more than the first block, the blocks are merged into one on reset, so after a few frames the
+// arena doesn't allocate at all.
+class FrameArena
+{
+  public:
+    explicit FrameArena(size_t blockSize = 64 * 1024);
+    ~FrameArena();
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    void *allocate(size_t size, size_t alignment);
+    // destructors are never run, so only trivially destructible types
+    template <typename T> T *allocate()
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "frame arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T();
+    }
+
+    void reset();
+
+    // bytes handed out since the last reset
+    size_t getUsed() const
+    {
+        return used;
+    }
+
+  private:
+    struct Block
+    {
+        unsigned char *data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    // block the next allocation comes from and the offset into it
+    size_t current = 0;
+    size_t offset = 0;
+    size_t used = 0;
+
+    void addBlock(size_t size);
+};
+
+// what the packets of a layer are sorted for, layers are executed in this order
+enum class RenderLayer : uint8_t
+{
+    // grouped by program and material, front to back within a group
+    Opaque,
+    // back to front, blended over everything drawn before them
+    Transparent
+};
+const unsigned int RENDER_LAYER_COUNT = 2;
+
+// an int uniform a packet sets before its draw (e.g. which light it's lit by), the program keeps every other value
+struct PacketUniform
+{
+    uint64_t name;
+    int value;
+};
+const unsigned int MAX_PACKET_UNIFORMS = 2;
+
+// Everything needed to draw one mesh, filled by RenderQueue::submit. Plain data in the frame arena, nothing in it
+// owns anything and it's gone after the frame.
+struct DrawPacket
+{
+    Shader *shader;
+    Mesh *mesh;
+    // bound in addition to the mesh's own material, null for none (e.g. a texture for a bare quad)
+    const Material *material;
+    // ignored by instanced packets, their matrices are in the instance buffer
+    glm::mat4 transform;
+    // set for an instanced draw of instanceCount instances from firstInstance on
+    const InstanceBuffer *instances;
+    unsigned int firstInstance;
+    unsigned int instanceCount;
+    unsigned int lod;
+    // index ranges of the meshlets that survived RenderQueue::cullMeshlets, drawn instead of the whole level. Null
+    // if the packet wasn't culled by meshlets.
+    GLsizei *rangeCounts;
+    const void **rangeOffsets;
+    unsigned int rangeCount;
+    // distance from the camera along the view direction, see RenderQueue::getViewDepth
+    float depth;
+    RenderLayer layer;
+    // face to cull, 0 to draw both sides
+    GLenum cullFace;
+    PacketUniform uniforms[MAX_PACKET_UNIFORMS];
+    unsigned int uniformCount;
+
+    // sets an int uniform of the program right before the draw
+    void setInt(UniformName name, int value)
+    {
+        if (uniformCount < MAX_PACKET_UNIFORMS)
+            uniforms[uniformCount++] = PacketUniform{name.hash, value};
+    }
+};
+
+// draw packets of the last frame and how much state executing them changed
+struct RenderQueueStats
+{
+    unsigned int packets = 0;
+    unsigned int programChanges = 0;
+    unsigned int materialChanges = 0;
+    // what frustum culling kept out of the queue, meshes count once per instance
+    CullingStats meshes;
+    CullingStats instances;
+    // meshlets kept and culled by cullMeshlets
+    CullingStats meshlets;
+};
+
+// Collects the draws of a frame and executes them sorted by a 64-bit key, so that draws sharing a program and a
+// material follow each other (fewer state changes) and opaque geometry goes front to back (less overdraw). Layout of
+// the key, from the most significant bit:
+//   opaque:      layer (2) | program (12) | material (16) | depth (24) | unused (10)
+//   transparent: layer (2) | inverted depth (24) | program (12) | material (16) | unused (10)
+// Submitting only writes a packet, no GL calls are made until execute().
+class RenderQueue
+{
+  public:
+    // whether cullMeshlets culls, packets are drawn whole if not
+    bool meshletCulling = true;
+    // the winding of front faces set with glFrontFace, cullMeshlets culls the meshlets face culling would discard
+    GLenum frontFace = GL_CCW;
+
+    // starts a frame: drops the packets of the last one, depths are measured with this view matrix and submitters
+    // cull against the frustum of view and projection
+    void begin(const glm::mat4 &view, const glm::mat4 &projection);
+
+    const Frustum &getFrustum() const
+    {
+        return frustum;
+    }
+    // adds to the culling counts of the frame
+    void addCullingStats(const CullingStats &meshes, const CullingStats &instances);
+
+    // returns a packet for the caller to fill, with no material, no culling and no uniforms
+    DrawPacket &submit(Shader &shader, Mesh &mesh, const glm::mat4 &transform, RenderLayer layer = RenderLayer::Opaque);
+
+    // Culls the meshlets of a packet drawn with the model matrix at the first level, the packet then only draws the
+    // ranges that may be visible. Meshlets are only culled by facing if the packet culls faces. Packets of more
+    // than one instance are left alone, their instances would each need ranges of their own.
+    void cullMeshlets(DrawPacket &packet, const glm::mat4 &model);
+
+    // view space depth of a point, for packets whose depth isn't their mesh's bounding sphere center
+    float getViewDepth(const glm::vec3 &position) const;
+
+    // sorts the packets, has to be called after the last submit and before execute
+    void sort();
+    // draws the packets of a layer in key order
+    void execute(RenderLayer layer);
+    // draws all layers
+    void execute();
+
+    // packets of the frame so far
+    size_t getPacketCount() const
+    {
+        return entries.size();
+    }
+    // arena memory of the frame so far
+    size_t getArenaUsed() const
+    {
+        return arena.getUsed();
+    }
+    // statistics since the last call
+    RenderQueueStats takeStats();
+
+    static uint64_t makeKey(RenderLayer layer, unsigned int program, uint16_t material, float depth);
+
+  private:
+    struct Entry
+    {
+        uint64_t key;
+        DrawPacket *packet;
+    };
+
+    FrameArena arena;
+    // kept between frames, so that their capacity is too
+    std::vector<Entry> entries;
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::vec3 cameraPosition = glm::vec3(0.0f);
+    Frustum frustum;
+    bool sorted = false;
+    RenderQueueStats stats;
+
+    void draw(const DrawPacket &packet, const Shader *&program, const Material *&material);
+};
+
+#endif // !RENDERQUEUE_H
@@ -4,43 +4,293 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <rg/hash.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
+
+// name of a uniform, only its hash is kept. String literals convert implicitly and can be hashed at compile time,
+// so setMat4("model", ...) doesn't build a std::string anymore.
+struct UniformName
+{
+    uint64_t hash;
+
+    constexpr UniformName(const char *name) : hash(hashString(name))
+    {
+    }
+    UniformName(const std::string &name) : hash(hashString(name))
+    {
+    }
+    // for names hashed ahead of time
+    explicit constexpr UniformName(uint64_t hash) : hash(hash)
+    {
+    }
+};
+
+// GL type of the uniforms a UniformHandle<T> can set (samplers are set as int)
+template <typename T> struct UniformType;
+template <> struct UniformType<int>
+{
+    enum : GLenum
+    {
+        value = GL_INT
+    };
+};
+template <> struct UniformType<bool>
+{
+    enum : GLenum
+    {
+        value = GL_BOOL
+    };
+};
+template <> struct UniformType<float>
+{
+    enum : GLenum
+    {
+        value = GL_FLOAT
+    };
+};
+template <> struct UniformType<glm::vec2>
+{
+    enum : GLenum
+    {
+        value = GL_FLOAT_VEC2
+    };
+};
+template <> struct UniformType<glm::vec3>
+{
+    enum : GLenum
+    {
+        value = GL_FLOAT_VEC3
+    };
+};
+template <> struct UniformType<glm::vec4>
+{
+    enum : GLenum
+    {
+        value = GL_FLOAT_VEC4
+    };
+};
+template <> struct UniformType<glm::mat2>
+{
+    enum : GLenum
+    {
+        value = GL_FLOAT_MAT2
+    };
+};
+template <> struct UniformType<glm::mat3>
+{
+    enum : GLenum
+    {
+        value = GL_FLOAT_MAT3
+    };
+};
+template <> struct UniformType<glm::mat4>
+{
+    enum : GLenum
+    {
+        value = GL_FLOAT_MAT4
+    };
+};
+
+// glUniform* calls made and skipped because the program already had the value
+struct UniformStats
+{
+    unsigned int uploaded = 0;
+    unsigned int skipped = 0;
+};
+
+class Shader;
+
+// a uniform resolved once with Shader::getUniform, setting it is a plain index into the program's uniform table.
+// Like the set* functions it needs its program to be in use. Handles of uniforms the program doesn't have are
+// invalid and setting them does nothing.
+template <typename T> class UniformHandle
+{
+  public:
+    UniformHandle() = default;
+
+    bool isValid() const
+    {
+        return shader != nullptr;
+    }
+    void set(const T &value) const;
+
+  private:
+    friend class Shader;
+    UniformHandle(const Shader *shader, unsigned int index) : shader(shader), index(index)
+    {
+    }
+
+    const Shader *shader = nullptr;
+    unsigned int index = 0;
+};
 
 class Shader
 {
   public:
     unsigned int ID;
+    // which sampler to texture unit assignment the program has (see MaterialSamplers), 0 for none yet
+    uint64_t samplerLayout = 0;
+
+    // constructor generates the shader on the fly, every define is inserted as "#define <define>" after the #version
+    // line of each stage. Linked programs are kept in the ProgramCache, later runs load them instead of compiling.
+    // Compile and link are only submitted here, their errors are checked (and reported) on the first use().
+    Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr,
+           const std::vector<std::string> &defines = std::vector<std::string>());
+    // a compute program, built the same way. Needs a GL 4.3 context (see glExtensions.hasGpuCulling).
+    explicit Shader(const char *computePath, const std::vector<std::string> &defines = std::vector<std::string>());
+    // deletes the program
+    ~Shader();
 
-    // constructor generates the shader on the fly
-    Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath = nullptr);
+    Shader(const Shader &) = delete;
+    Shader &operator=(const Shader &) = delete;
+
+    // whether the driver is done compiling and linking, never blocks. Only known with KHR_parallel_shader_compile,
+    // without it this is always true.
+    bool isReady() const;
+    // waits for compile and link, reports their errors and returns whether the program linked
+    bool finish();
 
     // activate the shader
     void use();
 
-    // utility uniform functions
-    void setBool(const std::string &name, bool value) const;
-    void setInt(const std::string &name, int value) const;
-    void setFloat(const std::string &name, float value) const;
+    // resolves a uniform for repeated sets, waits for the program if it's still building. Returns an invalid handle
+    // (and reports a type mismatch) if the program has no such uniform of type T.
+    template <typename T> UniformHandle<T> getUniform(UniformName name);
+
+    // utility uniform functions, they look the name up in the uniform table of the program and skip the glUniform*
+    // call if the uniform already has the value
+    void setBool(UniformName name, bool value) const;
+    void setInt(UniformName name, int value) const;
+    void setFloat(UniformName name, float value) const;
 
-    void setVec2(const std::string &name, const glm::vec2 &value) const;
-    void setVec2(const std::string &name, float x, float y) const;
+    void setVec2(UniformName name, const glm::vec2 &value) const;
+    void setVec2(UniformName name, float x, float y) const;
 
-    void setVec3(const std::string &name, const glm::vec3 &value) const;
-    void setVec3(const std::string &name, float x, float y, float z) const;
+    void setVec3(UniformName name, const glm::vec3 &value) const;
+    void setVec3(UniformName name, float x, float y, float z) const;
 
-    void setVec4(const std::string &name, const glm::vec4 &value) const;
-    void setVec4(const std::string &name, float x, float y, float z, float w);
+    void setVec4(UniformName name, const glm::vec4 &value) const;
+    void setVec4(UniformName name, float x, float y, float z, float w);
 
-    void setMat2(const std::string &name, const glm::mat2 &mat) const;
-    void setMat3(const std::string &name, const glm::mat3 &mat) const;
-    void setMat4(const std::string &name, const glm::mat4 &mat) const;
+    void setMat2(UniformName name, const glm::mat2 &mat) const;
+    void setMat3(UniformName name, const glm::mat3 &mat) const;
+    void setMat4(UniformName name, const glm::mat4 &mat) const;
+
+    // uniform calls of all programs since the last call
+    static UniformStats takeUniformStats();
 
   private:
-    // utility function for checking shader compilation/linking errors.
+    template <typename T> friend class UniformHandle;
+
+    // an active uniform (every element of an array is one), reflected once the program is linked
+    struct Uniform
+    {
+        uint64_t hash;
+        GLint location;
+        GLenum type;
+        bool hasValue;
+        // the last value set, big enough for a mat4
+        unsigned char value[sizeof(glm::mat4)];
+    };
+
+    // sorted by hash. Mutable since the values are only a cache of the program's state.
+    mutable std::vector<Uniform> uniforms;
+    static UniformStats uniformStats;
+
+    void reflectUniforms();
+    // binds the blocks the program shares with the others (SHARED_UNIFORM_BLOCKS) to their binding points
+    void bindUniformBlocks();
+    // index into uniforms, -1 if the program has no such uniform
+    int findUniform(uint64_t hash) const;
+    // findUniform for getUniform, finishes the program first and checks that the uniform can be set as type
+    int resolveUniform(uint64_t hash, GLenum type);
+
+    template <typename T> void setUniform(unsigned int index, const T &value) const;
+    void setUniform(unsigned int index, bool value) const
+    {
+        setUniform(index, static_cast<int>(value));
+    }
+    template <typename T> void setUniform(UniformName name, const T &value) const
+    {
+        int index = findUniform(name.hash);
+        if (index >= 0)
+            setUniform(static_cast<unsigned int>(index), value);
+    }
+    static void upload(GLint location, int value);
+    static void upload(GLint location, float value);
+    static void upload(GLint location, const glm::vec2 &value);
+    static void upload(GLint location, const glm::vec3 &value);
+    static void upload(GLint location, const glm::vec4 &value);
+    static void upload(GLint location, const glm::mat2 &value);
+    static void upload(GLint location, const glm::mat3 &value);
+    static void upload(GLint location, const glm::mat4 &value);
+
+    // vertex, fragment and geometry shader until finish() (0 if not used), a compute program only has the first
+    unsigned int stages[3] = {0, 0, 0};
+    bool compute = false;
+    uint64_t cacheKey = 0;
+    bool pending = false;
+    bool linked = false;
+
+    void deleteStages();
+
+    // utility function for checking shader compilation/linking errors, returns whether there were none.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type);
+    bool checkCompileErrors(GLuint shader, std::string type);
+};
+
+template <typename T> void UniformHandle<T>::set(const T &value) const
+{
+    if (shader)
+        shader->setUniform(index, value);
+}
+
+template <typename T> UniformHandle<T> Shader::getUniform(UniformName name)
+{
+    int index = resolveUniform(name.hash, UniformType<T>::value);
+    return index < 0 ? UniformHandle<T>() : UniformHandle<T>(this, static_cast<unsigned int>(index));
+}
+
+template <typename T> void Shader::setUniform(unsigned int index, const T &value) const
+{
+    static_assert(sizeof(T) <= sizeof(Uniform::value), "uniform value too big");
+    Uniform &uniform = uniforms[index];
+    if (uniform.hasValue && std::memcmp(uniform.value, &value, sizeof(T)) == 0)
+    {
+        uniformStats.skipped++;
+        return;
+    }
+    std::memcpy(uniform.value, &value, sizeof(T));
+    uniform.hasValue = true;
+    uniformStats.uploaded++;
+    upload(uniform.location, value);
+}
+
+// Programs that are built together. Since a Shader only submits its compile and link, creating all programs before
+// using any of them lets the driver build them at once (on its own threads with KHR_parallel_shader_compile) while
+// the caller goes on with other work, e.g. kicking off asset loads. finish() then reports all errors in one place.
+class ShaderBatch
+{
+  public:
+    ShaderBatch() = default;
+    explicit ShaderBatch(std::vector<std::shared_ptr<Shader>> shaders);
+
+    void add(const std::shared_ptr<Shader> &shader);
+
+    // programs the driver is still working on, never blocks
+    size_t getPendingCount() const;
+    // waits for all programs, returns false if any of them failed to build
+    bool finish();
+
+  private:
+    std::vector<std::shared_ptr<Shader>> shaders;
 };
 #endif
@@ -0,0 +1,62 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <glad/glad.h>
+
+#include <rg/glstate.hpp>
+
+// OpenGL texture owned through a std::shared_ptr, the GL texture is deleted together with the last handle.
+// Loaders hand it out before its data has been uploaded, until then getId() returns a placeholder (if one was
+// given) so it can be bound right away.
+class TextureObject
+{
+  public:
+    explicit TextureObject(GLenum target = GL_TEXTURE_2D, unsigned int placeholderID = 0)
+        : target(target), placeholderID(placeholderID)
+    {
+        glGenTextures(1, &textureID);
+    }
+
+    ~TextureObject()
+    {
+        GLState::global().deleteTexture(textureID);
+    }
+
+    TextureObject(const TextureObject &) = delete;
+    TextureObject &operator=(const TextureObject &) = delete;
+
+    // the texture to bind for drawing
+    unsigned int getId() const
+    {
+        return ready ? textureID : placeholderID;
+    }
+
+    // the real texture name, for the loader to upload into
+    unsigned int getTextureID() const
+    {
+        return textureID;
+    }
+
+    GLenum getTarget() const
+    {
+        return target;
+    }
+
+    bool isReady() const
+    {
+        return ready;
+    }
+
+    void setReady()
+    {
+        ready = true;
+    }
+
+  private:
+    GLenum target;
+    unsigned int textureID = 0;
+    unsigned int placeholderID;
+    bool ready = false;
+};
+
+#endif // !TEXTURE_H
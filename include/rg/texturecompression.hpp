@@ -0,0 +1,39 @@
+#ifndef TEXTURECOMPRESSION_H
+#define TEXTURECOMPRESSION_H
+
+#include <rg/ktx.hpp>
+
+#include <vector>
+
+// block compression formats of cooked textures, all encode 4x4 pixel blocks
+enum class BlockFormat
+{
+    BC1, // S3TC DXT1, opaque RGB, 8 bytes per block
+    BC3, // S3TC DXT5, RGB + interpolated alpha, 16 bytes per block
+    BC4, // RGTC1, single channel, 8 bytes per block
+    BC5  // RGTC2, two channels (e.g. normal map xy, without z), 16 bytes per block
+};
+
+// picks the format for an image with the given number of components. Opaque RGBA images get BC1.
+BlockFormat chooseBlockFormat(const unsigned char *pixels, int width, int height, int components);
+
+size_t getBlockSize(BlockFormat format);
+GLenum getCompressedInternalFormat(BlockFormat format);
+size_t getCompressedSize(BlockFormat format, unsigned int width, unsigned int height);
+
+// compresses a tightly packed RGBA8 image, partial blocks at the right and bottom edge repeat the last pixels
+std::vector<unsigned char> compressImage(const unsigned char *rgba, unsigned int width, unsigned int height,
+                                         BlockFormat format);
+
+// halves both dimensions (down to 1) with a box filter, RGBA8 in and out
+std::vector<unsigned char> downsampleImage(const unsigned char *rgba, unsigned int width, unsigned int height);
+
+// expands 1 to 4 component pixels to RGBA8 the way GL would sample them (GL_RED: (r, 0, 0, 1) etc.)
+std::vector<unsigned char> expandToRGBA(const unsigned char *pixels, unsigned int width, unsigned int height,
+                                        int components);
+
+// compresses the faces (1 or 6, RGBA8 of the same size) and, if mipmaps is set, their full mip chains
+KtxTexture cookTexture(const std::vector<const unsigned char *> &faces, unsigned int width, unsigned int height,
+                       BlockFormat format, bool mipmaps);
+
+#endif // !TEXTURECOMPRESSION_H
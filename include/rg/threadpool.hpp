@@ -0,0 +1,59 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads for CPU-bound background work (image decoding, mesh processing...).
+// Tasks must not touch OpenGL, the context is only current on the main thread.
+class ThreadPool
+{
+  public:
+    // threadCount == 0 picks one thread per hardware core
+    explicit ThreadPool(unsigned int threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // schedules the task and returns a future for its result
+    template <typename F> auto submit(F &&task) -> std::future<decltype(task())>
+    {
+        typedef decltype(task()) Result;
+        // packaged_task is move-only while std::function needs a copyable target, hence the shared_ptr
+        std::shared_ptr<std::packaged_task<Result()>> packaged =
+            std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push([packaged]() { (*packaged)(); });
+        }
+        wakeUp.notify_one();
+        return result;
+    }
+
+    unsigned int getThreadCount() const
+    {
+        return static_cast<unsigned int>(workers.size());
+    }
+
+    // pool shared by the whole program
+    static ThreadPool &global();
+
+  private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    void workerLoop();
+};
+
+#endif // !THREADPOOL_H
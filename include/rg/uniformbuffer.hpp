@@ -0,0 +1,116 @@
+#ifndef UNIFORMBUFFER_H
+#define UNIFORMBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <vector>
+
+// binding points of the uniform blocks all programs share. GLSL 3.30 can't say layout(binding = N), so Shader binds
+// every block named in SHARED_UNIFORM_BLOCKS to its point after link.
+enum UniformBlockBinding : GLuint
+{
+    CAMERA_BLOCK_BINDING = 0,
+    LIGHTS_BLOCK_BINDING = 1
+};
+
+struct SharedUniformBlock
+{
+    const char *name;
+    GLuint binding;
+};
+
+const SharedUniformBlock SHARED_UNIFORM_BLOCKS[] = {{"Camera", CAMERA_BLOCK_BINDING},
+                                                    {"Lights", LIGHTS_BLOCK_BINDING}};
+
+// the blocks below mirror the std140 layout of the declarations in resources/shaders, vec3s are padded to 16 bytes
+
+// layout (std140) uniform Camera
+struct CameraBlock
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPosition;
+    float padding0;
+};
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock doesn't match the std140 layout");
+
+// struct PointLight in fragment_shader.fs, constant fills the padding after ambient
+struct PointLightBlock
+{
+    glm::vec3 position;
+    float padding0;
+    glm::vec3 specular;
+    float padding1;
+    glm::vec3 diffuse;
+    float padding2;
+    glm::vec3 ambient;
+    float constant;
+    float linear;
+    float quadratic;
+    float padding3[2];
+};
+static_assert(sizeof(PointLightBlock) == 80, "PointLightBlock doesn't match the std140 layout");
+
+// struct DirLight in plate.fs
+struct DirLightBlock
+{
+    glm::vec3 direction;
+    float padding0;
+    glm::vec3 ambient;
+    float padding1;
+    glm::vec3 diffuse;
+    float padding2;
+    glm::vec3 specular;
+    float padding3;
+};
+static_assert(sizeof(DirLightBlock) == 64, "DirLightBlock doesn't match the std140 layout");
+
+// directional lights, plate.fs picks one with its dirLightIndex uniform
+enum DirLightIndex
+{
+    DIR_LIGHT_PLATE = 0,
+    DIR_LIGHT_GLASS = 1,
+    DIR_LIGHT_COUNT = 2
+};
+
+// layout (std140) uniform Lights
+struct LightsBlock
+{
+    PointLightBlock pointLight;
+    DirLightBlock dirLights[DIR_LIGHT_COUNT];
+};
+static_assert(sizeof(LightsBlock) == 208, "LightsBlock doesn't match the std140 layout");
+
+// A uniform buffer bound to a fixed binding point. update() writes the whole block once (per frame) for every
+// program that declares it, and does nothing when the contents didn't change.
+class UniformBuffer
+{
+  public:
+    UniformBuffer(GLuint binding, size_t size);
+    ~UniformBuffer();
+
+    UniformBuffer(const UniformBuffer &) = delete;
+    UniformBuffer &operator=(const UniformBuffer &) = delete;
+
+    // also (re)binds the buffer to its binding point
+    void update(const void *data, size_t size);
+    template <typename T> void update(const T &block)
+    {
+        update(&block, sizeof(T));
+    }
+
+    GLuint getId() const
+    {
+        return buffer;
+    }
+
+  private:
+    GLuint buffer = 0;
+    GLuint binding;
+    // what the buffer holds
+    std::vector<unsigned char> contents;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef VERTEXFORMAT_H
+#define VERTEXFORMAT_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Vertex;
+
+// GPU side layout of mesh vertices and indices
+enum class VertexFormat
+{
+    // Vertex as is (56 bytes) with 32 bit indices
+    Full,
+    // CompactVertex (20 bytes) with 16 bit indices for meshes of less than 65536 vertices.
+    // Shaders have to decode it, they are compiled with COMPACT_VERTEX defined for that.
+    Compact
+};
+
+struct CompactVertex
+{
+    // unorm16 position relative to the mesh bounds, w holds the bitangent sign (0 is -1, 1 is +1)
+    uint16_t Position[4];
+    // octahedral encoded unit vectors (snorm16), the bitangent is cross(Normal, Tangent) * sign
+    int16_t Normal[2];
+    int16_t Tangent[2];
+    // half floats, texture coordinates may tile outside of [0, 1]
+    uint16_t TexCoords[2];
+};
+
+// maps the unit vector onto the octahedron and unfolds it into [-1, 1]^2
+glm::vec2 encodeOctahedral(glm::vec3 n);
+glm::vec3 decodeOctahedral(glm::vec2 e);
+
+// compresses the vertices, positionOffset/positionScale receive the bounds used to decode the positions:
+// position = positionOffset + Position.xyz * positionScale
+std::vector<CompactVertex> compressVertices(const Vertex *vertices, size_t count, glm::vec3 &positionOffset,
+                                            glm::vec3 &positionScale);
+
+std::vector<uint16_t> compressIndices(const unsigned int *indices, size_t count);
+
+// bytes per vertex of the format in GPU memory
+size_t getVertexSize(VertexFormat format);
+
+inline size_t getIndexSize(GLenum indexType)
+{
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+// enables and points the vertex attributes of the bound VAO at the VBO bound to GL_ARRAY_BUFFER
+void setupVertexAttributes(VertexFormat format);
+
+// defines the shaders drawing meshes of the format have to be compiled with
+inline std::vector<std::string> getVertexFormatDefines(VertexFormat format)
+{
+    if (format == VertexFormat::Compact)
+        return std::vector<std::string>{"COMPACT_VERTEX"};
+    return std::vector<std::string>();
+}
+
+// whether the indices of a mesh with vertexCount vertices fit into 16 bits
+inline bool canUseShortIndices(size_t vertexCount)
+{
+    return vertexCount < 65536;
+}
+
+#endif // !VERTEXFORMAT_H
@@ -0,0 +1,238 @@
+#version 430 core
+// see GpuCuller: one invocation per instance, every mesh of the instance is culled against the frustum and the
+// occlusion buffer of the OcclusionCuller, the survivors get a level of detail and are appended to its command. That
+// takes three passes: PASS_CULL culls and counts the copies of every level, PASS_OFFSETS (one invocation per mesh)
+// lays the levels out in the mesh's range of visible matrices and PASS_WRITE writes the matrices of the survivors.
+// OCCLUSION_WIDTH, OCCLUSION_HEIGHT and OCCLUSION_BLOCK_SIZE are defined by GpuCuller
+layout (local_size_x = 64) in;
+
+struct MeshInfo
+{
+    // model space bounding box and sphere
+    vec4 boxMin;
+    vec4 boxMax;
+    vec4 sphere;
+    // the commands (and level errors) of the mesh's levels of detail start at firstCommand
+    uint firstCommand;
+    uint levelCount;
+    // the model space transforms of the mesh's copies start at firstPlacement
+    uint firstPlacement;
+    uint placementCount;
+};
+
+layout (std430, binding = 0) readonly buffer Instances
+{
+    mat4 instances[];
+};
+layout (std430, binding = 1) readonly buffer Meshes
+{
+    MeshInfo meshes[];
+};
+layout (std430, binding = 2) readonly buffer LevelErrors
+{
+    float levelErrors[];
+};
+// DrawElementsIndirectCommand: count, instanceCount, firstIndex, baseVertex, baseInstance
+layout (std430, binding = 3) buffer Commands
+{
+    uint commands[];
+};
+// InstanceData: the model matrix and its normal matrix, computed once for every visible copy
+struct Instance
+{
+    mat4 model;
+    mat3 normalMatrix;
+};
+layout (std430, binding = 4) writeonly buffer Visible
+{
+    Instance visible[];
+};
+layout (std430, binding = 5) readonly buffer OcclusionDepth
+{
+    float occlusionDepth[];
+};
+layout (std430, binding = 6) readonly buffer OcclusionHiZ
+{
+    float occlusionHiZ[];
+};
+layout (std430, binding = 7) readonly buffer Placements
+{
+    mat4 placements[];
+};
+// the level of detail PASS_CULL picked for every copy of a mesh in every instance, NOT_VISIBLE if it was culled. The
+// copies of a mesh start where its range of visible matrices does, instance after instance.
+layout (std430, binding = 8) buffer CopyLevels
+{
+    uint copyLevels[];
+};
+
+uniform mat4 viewProjection;
+uniform vec3 cameraPosition;
+// pixels covered by one unit at distance 1
+uniform float projectionScale;
+// largest error in pixels, negative when every mesh is drawn at full detail
+uniform float lodThreshold;
+uniform int instanceCount;
+uniform int meshCount;
+uniform bool occlusion;
+uniform int cullPass;
+
+// the passes as GpuCuller numbers them
+const int PASS_CULL = 0;
+const int PASS_OFFSETS = 1;
+const int PASS_WRITE = 2;
+const uint NOT_VISIBLE = 0xFFFFFFFFu;
+
+const int OCCLUSION_BLOCKS_X = OCCLUSION_WIDTH / OCCLUSION_BLOCK_SIZE;
+
+bool isInFront(vec4 clip)
+{
+    return clip.w > 0.0 && clip.z >= -clip.w;
+}
+
+// the world space box against the planes of viewProjection, they needn't be normalized for a sign test
+bool isInFrustum(vec4 planes[6], vec3 center, vec3 extent)
+{
+    for (int i = 0; i < 6; i++)
+    {
+        if (dot(planes[i].xyz, center) + planes[i].w < -dot(extent, abs(planes[i].xyz)))
+            return false;
+    }
+    return true;
+}
+
+// OcclusionCuller::testBox
+bool isOccluded(vec3 boxMin, vec3 boxMax)
+{
+    vec2 rectMin = vec2(1e30);
+    vec2 rectMax = vec2(-1e30);
+    float nearest = 0.0;
+    for (int i = 0; i < 8; i++)
+    {
+        vec3 corner = vec3((i & 1) != 0 ? boxMax.x : boxMin.x, (i & 2) != 0 ? boxMax.y : boxMin.y,
+                           (i & 4) != 0 ? boxMax.z : boxMin.z);
+        vec4 clip = viewProjection * vec4(corner, 1.0);
+        if (!isInFront(clip))
+            return false;
+        float depth = 1.0 / clip.w;
+        vec2 screen = (clip.xy * depth * 0.5 + 0.5) * vec2(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+        rectMin = min(rectMin, screen);
+        rectMax = max(rectMax, screen);
+        nearest = max(nearest, depth);
+    }
+    ivec2 first = max(ivec2(floor(rectMin - 0.5)), ivec2(0));
+    ivec2 last = min(ivec2(floor(rectMax + 0.5)), ivec2(OCCLUSION_WIDTH - 1, OCCLUSION_HEIGHT - 1));
+    if (first.x > last.x || first.y > last.y)
+        return false;
+
+    for (int blockY = first.y / OCCLUSION_BLOCK_SIZE; blockY <= last.y / OCCLUSION_BLOCK_SIZE; blockY++)
+    {
+        for (int blockX = first.x / OCCLUSION_BLOCK_SIZE; blockX <= last.x / OCCLUSION_BLOCK_SIZE; blockX++)
+        {
+            if (occlusionHiZ[blockY * OCCLUSION_BLOCKS_X + blockX] > nearest)
+                continue;
+            int yEnd = min(last.y, (blockY + 1) * OCCLUSION_BLOCK_SIZE - 1);
+            int xEnd = min(last.x, (blockX + 1) * OCCLUSION_BLOCK_SIZE - 1);
+            for (int y = max(first.y, blockY * OCCLUSION_BLOCK_SIZE); y <= yEnd; y++)
+            {
+                for (int x = max(first.x, blockX * OCCLUSION_BLOCK_SIZE); x <= xEnd; x++)
+                {
+                    if (occlusionDepth[y * OCCLUSION_WIDTH + x] <= nearest)
+                        return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// culls one copy of the mesh placed with the model matrix, returns its level of detail or NOT_VISIBLE
+uint cullCopy(vec4 planes[6], MeshInfo mesh, mat4 model)
+{
+    mat3 linear = mat3(model);
+    mat3 absolute = mat3(abs(linear[0]), abs(linear[1]), abs(linear[2]));
+    float scale = max(length(linear[0]), max(length(linear[1]), length(linear[2])));
+
+    // the world space box around the transformed one
+    vec3 center = (model * vec4((mesh.boxMin.xyz + mesh.boxMax.xyz) * 0.5, 1.0)).xyz;
+    vec3 extent = absolute * ((mesh.boxMax.xyz - mesh.boxMin.xyz) * 0.5);
+    if (!isInFrustum(planes, center, extent))
+        return NOT_VISIBLE;
+    if (occlusion && isOccluded(center - extent, center + extent))
+        return NOT_VISIBLE;
+
+    // LodSelector::select without the hysteresis, there is no last level to keep per instance
+    uint level = 0u;
+    if (lodThreshold >= 0.0)
+    {
+        vec3 sphereCenter = (model * vec4(mesh.sphere.xyz, 1.0)).xyz;
+        float distance = max(length(sphereCenter - cameraPosition) - mesh.sphere.w * scale, 0.1);
+        float errorScale = scale * projectionScale / distance;
+        while (level + 1u < mesh.levelCount &&
+               levelErrors[mesh.firstCommand + level + 1u] * errorScale <= lodThreshold)
+            level++;
+    }
+    return level;
+}
+
+// the levels of the mesh one after the other from the start of its range (the base instance all of them start with),
+// the instance counts go back to zero for PASS_WRITE to count them again as it writes the matrices
+void placeLevels(MeshInfo mesh)
+{
+    uint base = commands[mesh.firstCommand * 5u + 4u];
+    for (uint level = 0u; level < mesh.levelCount; level++)
+    {
+        uint command = mesh.firstCommand + level;
+        commands[command * 5u + 4u] = base;
+        base += commands[command * 5u + 1u];
+        commands[command * 5u + 1u] = 0u;
+    }
+}
+
+void main()
+{
+    if (cullPass == PASS_OFFSETS)
+    {
+        int mesh = int(gl_GlobalInvocationID.x);
+        if (mesh < meshCount)
+            placeLevels(meshes[mesh]);
+        return;
+    }
+
+    int instance = int(gl_GlobalInvocationID.x);
+    if (instance >= instanceCount)
+        return;
+    mat4 instanceModel = instances[instance];
+
+    // Gribb/Hartmann: left, right, bottom, top, near and far from the rows of the matrix
+    vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    vec4 planes[6] = vec4[6](rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1],
+                             rows[3] + rows[2], rows[3] - rows[2]);
+
+    // every copy of every mesh, the copies of a deduplicated mesh are instances of the same commands. The first
+    // level starts at the mesh's range before and after PASS_OFFSETS.
+    for (int i = 0; i < meshCount; i++)
+    {
+        MeshInfo mesh = meshes[i];
+        uint firstCopy = commands[mesh.firstCommand * 5u + 4u] + uint(instance) * mesh.placementCount;
+        for (uint p = 0u; p < mesh.placementCount; p++)
+        {
+            mat4 model = instanceModel * placements[mesh.firstPlacement + p];
+            if (cullPass == PASS_CULL)
+            {
+                uint level = cullCopy(planes, mesh, model);
+                copyLevels[firstCopy + p] = level;
+                if (level != NOT_VISIBLE)
+                    atomicAdd(commands[(mesh.firstCommand + level) * 5u + 1u], 1u);
+            }
+            else if (copyLevels[firstCopy + p] != NOT_VISIBLE)
+            {
+                uint command = mesh.firstCommand + copyLevels[firstCopy + p];
+                uint slot = atomicAdd(commands[command * 5u + 1u], 1u);
+                visible[commands[command * 5u + 4u] + slot] = Instance(model, transpose(inverse(mat3(model))));
+            }
+        }
+    }
+}
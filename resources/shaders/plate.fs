@@ -19,12 +19,36 @@ struct DirLight
     vec3 specular;
 };
 
+struct PointLight
+{
+    vec3 position;
+    vec3 specular;
+    vec3 diffuse;
+    vec3 ambient;
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+// shared by all programs, see CameraBlock and LightsBlock
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
+
+layout (std140) uniform Lights
+{
+    PointLight pointLight;
+    DirLight dirLights[2];
+};
+
 uniform sampler2D texture_sampler;
 
 uniform Material material;
-uniform DirLight dirLight;
-
-uniform vec3 viewPos;
+// which of dirLights lights this draw (DirLightIndex)
+uniform int dirLightIndex;
 uniform bool blinn;
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
@@ -57,7 +81,7 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 void main()
 {
     vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+    vec3 viewDir = normalize(viewPosition - FragPos);
+    vec3 result = CalcDirLight(dirLights[dirLightIndex], norm, viewDir);
     FragColor = vec4(result, texture(texture_sampler, TexCoords).a);
 }
@@ -7,14 +7,31 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
+#ifdef INSTANCED
+// per instance model and normal matrix from the InstanceBuffer (locations 5 to 8 and 9 to 11)
+layout (location = 5) in mat4 instanceModel;
+layout (location = 9) in mat3 instanceNormalMatrix;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix;
+#endif
+
+// shared by all programs, see CameraBlock
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 model = instanceModel;
+    mat3 normalMatrix = instanceNormalMatrix;
+#endif
     FragPos = vec3(model * vec4(aPos,1.0));
-    Normal = mat3(transpose(inverse(model)))*aNormal;
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords;
     gl_Position = projection* view * vec4(FragPos,1.0f);
 }
@@ -1,20 +1,65 @@
 #version 330 core
+#ifdef COMPACT_VERTEX
+// see CompactVertex: position normalized to the mesh bounds (w = bitangent sign), octahedral normal, half texcoords.
+// The tangent (location 3) is octahedral as well, bitangent = cross(normal, tangent) * (aPos.w * 2.0 - 1.0).
+layout (location = 0) in vec4 aPos;
+layout (location = 1) in vec2 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+vec3 decodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+#else
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#endif
 
 out vec2 TexCoords;
 out vec3 Normal;
 out vec3 FragPos;
 
+#ifdef INSTANCED
+// per instance model and normal matrix from the InstanceBuffer (locations 5 to 8 and 9 to 11)
+layout (location = 5) in mat4 instanceModel;
+layout (location = 9) in mat3 instanceNormalMatrix;
+#else
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix;
+#endif
+
+// shared by all programs, see CameraBlock
+layout (std140) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+    vec3 viewPosition;
+};
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = aNormal;
+#ifdef INSTANCED
+    mat4 model = instanceModel;
+    mat3 normalMatrix = instanceNormalMatrix;
+#endif
+#ifdef COMPACT_VERTEX
+    vec3 position = positionOffset + aPos.xyz * positionScale;
+    vec3 normal = decodeOctahedral(aNormal);
+#else
+    vec3 position = aPos;
+    vec3 normal = aNormal;
+#endif
+    FragPos = vec3(model * vec4(position, 1.0));
+    // the copies of a deduplicated mesh are rotated by their placements
+    Normal = normalMatrix * normal;
     TexCoords = aTexCoords;
     gl_Position = projection * view * vec4(FragPos, 1.0);
 }
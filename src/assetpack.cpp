@@ -0,0 +1,189 @@
+#include <rg/assetpack.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+const char ASSET_PACK_MAGIC[4] = {'R', 'G', 'P', 'K'};
+
+struct AssetPackHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t entryCount;
+    uint64_t indexOffset;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+};
+
+uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// compares the path of an entry in the string table with a path
+int comparePath(const char *strings, const AssetPack::Entry &entry, const std::string &path)
+{
+    size_t length = std::min<size_t>(entry.pathLength, path.size());
+    int result = std::memcmp(strings + entry.pathOffset, path.data(), length);
+    if (result != 0)
+        return result;
+    return entry.pathLength < path.size() ? -1 : (entry.pathLength > path.size() ? 1 : 0);
+}
+} // namespace
+
+AssetPack::~AssetPack()
+{
+    if (base)
+        munmap(const_cast<unsigned char *>(base), mappingSize);
+}
+
+std::shared_ptr<AssetPack> AssetPack::open(const std::string &packPath)
+{
+    int fd = ::open(packPath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(AssetPackHeader))
+    {
+        ::close(fd);
+        std::cout << "ERROR::ASSET_PACK:: " << packPath << ": too small to be a pack" << std::endl;
+        return nullptr;
+    }
+    std::shared_ptr<AssetPack> pack(new AssetPack());
+    pack->packPath = packPath;
+    pack->mappingSize = static_cast<size_t>(st.st_size);
+    void *mapping = mmap(nullptr, pack->mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        std::cout << "ERROR::ASSET_PACK:: " << packPath << ": mmap failed" << std::endl;
+        return nullptr;
+    }
+    pack->base = static_cast<const unsigned char *>(mapping);
+
+    const AssetPackHeader *header = reinterpret_cast<const AssetPackHeader *>(pack->base);
+    if (std::memcmp(header->magic, ASSET_PACK_MAGIC, sizeof(ASSET_PACK_MAGIC)) != 0 ||
+        header->version != ASSET_PACK_VERSION || header->indexOffset % alignof(Entry) != 0 ||
+        header->indexOffset + header->entryCount * sizeof(Entry) > pack->mappingSize ||
+        header->stringsOffset + header->stringsSize > pack->mappingSize)
+    {
+        std::cout << "ERROR::ASSET_PACK:: " << packPath << ": not a valid version " << ASSET_PACK_VERSION << " pack"
+                  << std::endl;
+        return nullptr;
+    }
+    pack->entries = reinterpret_cast<const Entry *>(pack->base + header->indexOffset);
+    pack->entryCount = static_cast<size_t>(header->entryCount);
+    pack->strings = reinterpret_cast<const char *>(pack->base + header->stringsOffset);
+
+    // a damaged index is rejected here once, find() and getData() don't check anything
+    for (size_t i = 0; i < pack->entryCount; i++)
+    {
+        const Entry &entry = pack->entries[i];
+        if (entry.offset + entry.size > pack->mappingSize ||
+            uint64_t(entry.pathOffset) + entry.pathLength > header->stringsSize)
+        {
+            std::cout << "ERROR::ASSET_PACK:: " << packPath << ": entry " << i << " is out of bounds" << std::endl;
+            return nullptr;
+        }
+    }
+    return pack;
+}
+
+const AssetPack::Entry *AssetPack::find(const std::string &path) const
+{
+    const Entry *end = entries + entryCount;
+    const Entry *it = std::lower_bound(entries, end, path, [this](const Entry &entry, const std::string &value) {
+        return comparePath(strings, entry, value) < 0;
+    });
+    if (it == end || comparePath(strings, *it, path) != 0)
+        return nullptr;
+    return it;
+}
+
+std::string AssetPack::getPath(const Entry &entry) const
+{
+    return std::string(strings + entry.pathOffset, entry.pathLength);
+}
+
+bool AssetPack::write(const std::string &packPath, const std::vector<std::string> &paths)
+{
+    std::vector<std::string> sorted(paths);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    // same procedure as the mesh cache: write to a temporary file and rename it into place
+    std::string tmpPath = packPath + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    // the header is written last, once the offsets are known
+    AssetPackHeader header;
+    std::memset(&header, 0, sizeof(header));
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    uint64_t offset = sizeof(header);
+
+    static const char zeros[16] = {};
+    std::vector<Entry> entries;
+    std::string strings;
+    std::vector<char> buffer;
+    for (const std::string &path : sorted)
+    {
+        struct stat st;
+        std::ifstream in(path, std::ios::binary);
+        if (!in || stat(path.c_str(), &st) != 0)
+        {
+            std::cout << "ERROR::ASSET_PACK:: failed to read " << path << std::endl;
+            out.close();
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+        uint64_t aligned = alignOffset(offset, 16);
+        out.write(zeros, aligned - offset);
+        offset = aligned;
+
+        Entry entry;
+        entry.offset = offset;
+        entry.size = buffer.size();
+        entry.modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        entry.pathOffset = static_cast<uint32_t>(strings.size());
+        entry.pathLength = static_cast<uint32_t>(path.size());
+        entries.push_back(entry);
+        strings += path;
+
+        out.write(buffer.data(), buffer.size());
+        offset += buffer.size();
+    }
+
+    uint64_t aligned = alignOffset(offset, 16);
+    out.write(zeros, aligned - offset);
+    std::memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(ASSET_PACK_MAGIC));
+    header.version = ASSET_PACK_VERSION;
+    header.entryCount = entries.size();
+    header.indexOffset = aligned;
+    header.stringsOffset = aligned + entries.size() * sizeof(Entry);
+    header.stringsSize = strings.size();
+    out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+    out.write(strings.data(), strings.size());
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.close();
+    if (!out)
+    {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return std::rename(tmpPath.c_str(), packPath.c_str()) == 0;
+}
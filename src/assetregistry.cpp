@@ -0,0 +1,175 @@
+#include <rg/assetregistry.hpp>
+#include <rg/assetstreamer.hpp>
+#include <rg/filesystem.hpp>
+#include <rg/image.hpp>
+
+#include <climits>
+#include <cstdlib>
+
+AssetRegistry &AssetRegistry::global()
+{
+    static AssetRegistry registry;
+    return registry;
+}
+
+std::string AssetRegistry::canonicalPath(const std::string &path)
+{
+    // packed files have no symlinks to resolve, and realpath would cost a syscall per path component
+    if (FileSystem::isPacked(path))
+        return FileSystem::normalizePath(path);
+    char resolved[PATH_MAX];
+    // missing files keep their spelling, their load fails the same way either way
+    if (!realpath(path.c_str(), resolved))
+        return path;
+    return resolved;
+}
+
+std::string AssetRegistry::getTextureKey(const std::string &path)
+{
+    return canonicalPath(path);
+}
+
+template <typename T> std::shared_ptr<T> AssetRegistry::find(const Table<T> &table, const std::string &key)
+{
+    typename Table<T>::const_iterator it = table.find(key);
+    if (it == table.end())
+        return nullptr;
+    return it->second.lock();
+}
+
+template <typename T>
+void AssetRegistry::insert(Table<T> &table, const std::string &key, const std::shared_ptr<T> &asset)
+{
+    for (typename Table<T>::iterator it = table.begin(); it != table.end();)
+    {
+        if (it->second.expired())
+            it = table.erase(it);
+        else
+            ++it;
+    }
+    table[key] = asset;
+}
+
+template <typename T> size_t AssetRegistry::countAlive(const Table<T> &table)
+{
+    size_t count = 0;
+    for (const typename Table<T>::value_type &entry : table)
+        count += entry.second.expired() ? 0 : 1;
+    return count;
+}
+
+std::shared_ptr<Model> AssetRegistry::getModel(const std::string &path, bool gamma, VertexFormat format,
+                                               MeshRetention retention)
+{
+    // the megabuffer mode is part of the key so toggling it hands out a model whose meshes were set up in that mode
+    std::string key = canonicalPath(path) + '|' + std::to_string(Model::ImportFlags) + '|' + (gamma ? '1' : '0') +
+                      '|' + std::to_string(static_cast<int>(format)) + '|' +
+                      std::to_string(static_cast<int>(retention)) + '|' + (GeometryBuffer::isEnabled() ? '1' : '0');
+    std::shared_ptr<Model> model = find(models, key);
+    if (model)
+        return model;
+
+    if (streamer)
+    {
+        model = streamer->loadModel(path, format, retention);
+        model->gammaCorrection = gamma;
+    }
+    else
+        model = std::make_shared<Model>(path, gamma, format, retention);
+    insert(models, key, model);
+    return model;
+}
+
+std::shared_ptr<TextureObject> AssetRegistry::getTexture(const std::string &path)
+{
+    std::string key = getTextureKey(path);
+    std::shared_ptr<TextureObject> texture = find(textures, key);
+    if (texture)
+        return texture;
+
+    if (streamer)
+        texture = streamer->loadTexture(path);
+    else
+    {
+        texture = std::make_shared<TextureObject>(GL_TEXTURE_2D);
+        uploadTexture(texture->getTextureID(), *loadImage(path));
+        texture->setReady();
+    }
+    insert(textures, key, texture);
+    return texture;
+}
+
+std::shared_ptr<TextureObject> AssetRegistry::getCubemap(const std::vector<std::string> &faces)
+{
+    std::string key = "cubemap";
+    for (const std::string &face : faces)
+        key += '|' + canonicalPath(face);
+    std::shared_ptr<TextureObject> texture = find(textures, key);
+    if (texture)
+        return texture;
+
+    if (streamer)
+        texture = streamer->loadCubemap(faces);
+    else
+    {
+        texture = std::make_shared<TextureObject>(GL_TEXTURE_CUBE_MAP);
+        std::string cookedPath = getCookedCubemapPath(faces);
+        std::shared_ptr<const Image> cooked;
+        if (isCookedTexturesEnabled() && hasCookedTexture(cookedPath, faces))
+            cooked = loadCookedImage(cookedPath);
+        if (cooked && cooked->isCooked() && cooked->cooked.faces == 6)
+            uploadCubemap(texture->getTextureID(), *cooked);
+        else
+        {
+            std::vector<ImageFuture> images;
+            for (const std::string &face : faces)
+                images.push_back(loadImageAsync(face));
+            uploadCubemap(texture->getTextureID(), images);
+        }
+        texture->setReady();
+    }
+    insert(textures, key, texture);
+    return texture;
+}
+
+std::shared_ptr<Shader> AssetRegistry::getShader(const char *vertexPath, const char *fragmentPath,
+                                                 const char *geometryPath, const std::vector<std::string> &defines)
+{
+    std::string key = canonicalPath(vertexPath) + '|' + canonicalPath(fragmentPath);
+    if (geometryPath)
+        key += '|' + canonicalPath(geometryPath);
+    for (const std::string &define : defines)
+        key += "|#" + define;
+    std::shared_ptr<Shader> shader = find(shaders, key);
+    if (shader)
+        return shader;
+
+    shader = std::make_shared<Shader>(vertexPath, fragmentPath, geometryPath, defines);
+    insert(shaders, key, shader);
+    return shader;
+}
+
+std::shared_ptr<TextureObject> AssetRegistry::findTexture(const std::string &key) const
+{
+    return find(textures, key);
+}
+
+void AssetRegistry::addTexture(const std::string &key, const std::shared_ptr<TextureObject> &texture)
+{
+    insert(textures, key, texture);
+}
+
+size_t AssetRegistry::getModelCount() const
+{
+    return countAlive(models);
+}
+
+size_t AssetRegistry::getTextureCount() const
+{
+    return countAlive(textures);
+}
+
+size_t AssetRegistry::getShaderCount() const
+{
+    return countAlive(shaders);
+}
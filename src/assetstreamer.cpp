@@ -0,0 +1,418 @@
+#include <rg/assetstreamer.hpp>
+#include <rg/assetregistry.hpp>
+#include <rg/glstate.hpp>
+#include <rg/threadpool.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+AssetStreamer::AssetStreamer(size_t uploadBudget)
+    : uploadBudget(uploadBudget), finished(std::make_shared<MPSCQueue<std::unique_ptr<Job>>>())
+{
+    // 1x1 placeholders, bound instead of textures whose data hasn't arrived yet
+    const unsigned char white[4] = {255, 255, 255, 255};
+    const unsigned char grey[4] = {128, 128, 128, 255};
+
+    glGenTextures(1, &placeholder2D);
+    GLState::global().bindTexture(GL_TEXTURE_2D, placeholder2D);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &placeholderCubemap);
+    GLState::global().bindTexture(GL_TEXTURE_CUBE_MAP, placeholderCubemap);
+    for (unsigned int i = 0; i < 6; i++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenBuffers(1, &pixelBuffer);
+}
+
+AssetStreamer::~AssetStreamer()
+{
+    // workers that are still running keep the queue alive through their own reference, their results are dropped
+    glDeleteBuffers(1, &pixelBuffer);
+    GLState::global().deleteTexture(placeholder2D);
+    GLState::global().deleteTexture(placeholderCubemap);
+}
+
+std::shared_ptr<TextureObject> AssetStreamer::createTexture(GLenum target)
+{
+    return std::make_shared<TextureObject>(target, target == GL_TEXTURE_CUBE_MAP ? placeholderCubemap : placeholder2D);
+}
+
+std::shared_ptr<Model> AssetStreamer::loadModel(const std::string &path, VertexFormat format,
+                                                MeshRetention retention)
+{
+    std::shared_ptr<Model> model = std::make_shared<Model>();
+    model->ready = false;
+    model->vertexFormat = format;
+    model->retention = retention;
+    model->directory = path.substr(0, path.find_last_of('/'));
+    inFlight++;
+
+    // the worker only passes the model through, it is touched exclusively on the GL thread
+    std::string directory = model->directory;
+    std::shared_ptr<MPSCQueue<std::unique_ptr<Job>>> queue = finished;
+    ThreadPool::global().submit([queue, model, path, directory]() {
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->model = model;
+        Model::readMeshData(path, job->meshes);
+        // the textures are decoded in parallel and collected by one more task, like the faces of a cubemap. The
+        // decodes are queued before the collecting task, so they are always picked up before it.
+        std::vector<ImageFuture> images;
+        for (const MeshData &mesh : job->meshes)
+        {
+            for (const Texture &ref : mesh.textures)
+            {
+                bool known = std::any_of(job->textures.begin(), job->textures.end(),
+                                         [&ref](const Texture &texture) { return texture.path == ref.path; });
+                if (known)
+                    continue;
+                job->textures.push_back(ref);
+                images.push_back(loadImageAsync(directory + '/' + ref.path));
+            }
+        }
+        ThreadPool::global().submit([queue, job, images]() {
+            for (const ImageFuture &image : images)
+                job->images.push_back(image.get());
+            queue->push(std::unique_ptr<Job>(new Job(std::move(*job))));
+        });
+    });
+    return model;
+}
+
+std::shared_ptr<TextureObject> AssetStreamer::loadTexture(const std::string &path)
+{
+    std::shared_ptr<TextureObject> texture = createTexture(GL_TEXTURE_2D);
+    inFlight++;
+
+    std::shared_ptr<MPSCQueue<std::unique_ptr<Job>>> queue = finished;
+    ThreadPool::global().submit([queue, texture, path]() {
+        std::unique_ptr<Job> job(new Job());
+        job->texture = texture;
+        job->images.push_back(loadImage(path));
+        queue->push(std::move(job));
+    });
+    return texture;
+}
+
+std::shared_ptr<TextureObject> AssetStreamer::loadCubemap(const std::vector<std::string> &faces)
+{
+    std::shared_ptr<TextureObject> texture = createTexture(GL_TEXTURE_CUBE_MAP);
+    inFlight++;
+
+    std::shared_ptr<MPSCQueue<std::unique_ptr<Job>>> queue = finished;
+    std::string cookedPath = getCookedCubemapPath(faces);
+    if (isCookedTexturesEnabled() && hasCookedTexture(cookedPath, faces))
+    {
+        // a cooked cubemap is one image that holds all six faces
+        ThreadPool::global().submit([queue, texture, cookedPath]() {
+            std::unique_ptr<Job> job(new Job());
+            job->texture = texture;
+            job->images.push_back(loadCookedImage(cookedPath));
+            queue->push(std::move(job));
+        });
+        return texture;
+    }
+
+    // the faces are decoded in parallel and collected by one more task. The pool is FIFO, so the decodes are always
+    // picked up before the collecting task that waits for them.
+    std::vector<ImageFuture> images;
+    for (const std::string &face : faces)
+        images.push_back(loadImageAsync(face));
+    ThreadPool::global().submit([queue, texture, images]() {
+        std::unique_ptr<Job> job(new Job());
+        job->texture = texture;
+        for (const ImageFuture &image : images)
+            job->images.push_back(image.get());
+        queue->push(std::move(job));
+    });
+    return texture;
+}
+
+void AssetStreamer::acceptJob(Job &job)
+{
+    std::vector<TextureUpload> uploads;
+    std::shared_ptr<ModelLoad> load;
+    if (job.model)
+    {
+        load = std::make_shared<ModelLoad>();
+        load->model = job.model;
+        // textures another asset already loaded (or is loading) are shared, their decoded images are dropped.
+        // The rest is registered right away so addMesh resolves the model's references to them.
+        AssetRegistry &registry = AssetRegistry::global();
+        for (size_t i = 0; i < job.textures.size(); i++)
+        {
+            std::string key = AssetRegistry::getTextureKey(job.model->directory + '/' + job.textures[i].path);
+            std::shared_ptr<TextureObject> texture = registry.findTexture(key);
+            if (!texture)
+            {
+                TextureUpload upload;
+                upload.texture = texture = createTexture(GL_TEXTURE_2D);
+                upload.layers.push_back(job.images[i]);
+                upload.owner = load;
+                uploads.push_back(upload);
+                registry.addTexture(key, texture);
+            }
+            load->textures.push_back(texture);
+        }
+        for (MeshData &mesh : job.meshes)
+        {
+            MeshUpload upload;
+            upload.owner = load;
+            upload.data = std::move(mesh);
+            meshUploads.push_back(std::move(upload));
+        }
+        load->remaining = uploads.size() + job.meshes.size();
+    }
+    else
+    {
+        TextureUpload upload;
+        upload.texture = job.texture;
+        upload.layers = job.images;
+        uploads.push_back(upload);
+    }
+
+    // allocate the storage now, while no pixel buffer is bound, update() only fills in rows
+    for (TextureUpload &upload : uploads)
+    {
+        GLenum target = upload.texture->getTarget();
+        GLState::global().bindTexture(target, upload.texture->getTextureID());
+        for (unsigned int i = 0; i < upload.layers.size(); i++)
+        {
+            const Image &image = *upload.layers[i];
+            if (!image.isValid())
+            {
+                std::cout << "Texture failed to load at path: " << image.path << std::endl;
+                continue;
+            }
+            if (image.isCooked())
+            {
+                // every level of every face the cooker wrote, the faces of a cooked cubemap are all in this image
+                const KtxTexture &cooked = image.cooked;
+                for (unsigned int level = 0; level < cooked.levels.size(); level++)
+                {
+                    for (unsigned int face = 0; face < cooked.faces; face++)
+                    {
+                        GLenum faceTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face
+                                                                          : target;
+                        glCompressedTexImage2D(faceTarget, level, cooked.internalFormat, cooked.levels[level].width,
+                                               cooked.levels[level].height, 0,
+                                               static_cast<GLsizei>(cooked.levels[level].faceSize), nullptr);
+                    }
+                }
+                glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(cooked.levels.size()) - 1);
+                continue;
+            }
+            GLenum face = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + i : target;
+            GLenum format = image.getFormat();
+            glTexImage2D(face, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+        }
+        textureUploads.push_back(upload);
+    }
+
+    if (load && load->remaining == 0)
+    {
+        // nothing to upload (e.g. the import failed)
+        load->model->ready = true;
+        inFlight--;
+    }
+}
+
+void AssetStreamer::finishModelPart(const std::shared_ptr<ModelLoad> &owner)
+{
+    if (--owner->remaining == 0)
+    {
+        owner->model->ready = true;
+        inFlight--;
+    }
+}
+
+bool AssetStreamer::isComplete(const TextureUpload &upload) const
+{
+    return upload.layer >= upload.layers.size();
+}
+
+size_t AssetStreamer::stageRows(TextureUpload &upload, unsigned char *staging, size_t offset, size_t capacity,
+                                std::vector<RowCopy> &copies)
+{
+    while (!isComplete(upload))
+    {
+        const Image &image = *upload.layers[upload.layer];
+        if (image.isCooked())
+        {
+            // compressed data can't be split into rows, each level of each face goes whole. row counts them.
+            const KtxTexture &cooked = image.cooked;
+            unsigned int level = upload.row / cooked.faces, face = upload.row % cooked.faces;
+            if (level >= cooked.levels.size())
+            {
+                upload.layer++;
+                upload.row = 0;
+                continue;
+            }
+            size_t size = cooked.levels[level].faceSize;
+            if (offset + size > capacity)
+                break;
+
+            std::memcpy(staging + offset, cooked.getFace(level, face), size);
+            RowCopy copy;
+            copy.target = upload.texture->getTarget();
+            copy.textureID = upload.texture->getTextureID();
+            copy.face = copy.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : copy.target;
+            copy.image = &image;
+            copy.level = level;
+            copy.row = 0;
+            copy.rowCount = static_cast<int>(cooked.levels[level].height);
+            copy.offset = offset;
+            copy.size = size;
+            copies.push_back(copy);
+
+            offset += size;
+            upload.row++;
+            continue;
+        }
+        if (!image.data || upload.row >= image.height)
+        {
+            upload.layer++;
+            upload.row = 0;
+            continue;
+        }
+
+        size_t rowSize = static_cast<size_t>(image.width) * image.components;
+        int rowCount = std::min(static_cast<int>((capacity - offset) / rowSize), image.height - upload.row);
+        if (rowCount <= 0)
+            break;
+
+        std::memcpy(staging + offset, image.data + upload.row * rowSize, rowCount * rowSize);
+        RowCopy copy;
+        copy.target = upload.texture->getTarget();
+        copy.textureID = upload.texture->getTextureID();
+        copy.face = copy.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + upload.layer : copy.target;
+        copy.image = &image;
+        copy.level = 0;
+        copy.row = upload.row;
+        copy.rowCount = rowCount;
+        copy.offset = offset;
+        copy.size = rowCount * rowSize;
+        copies.push_back(copy);
+
+        offset += rowCount * rowSize;
+        upload.row += rowCount;
+    }
+    return offset;
+}
+
+void AssetStreamer::finishTexture(TextureUpload &upload)
+{
+    TextureObject &texture = *upload.texture;
+    const Image &first = *upload.layers[0];
+    GLState::global().bindTexture(texture.getTarget(), texture.getTextureID());
+    if (texture.getTarget() == GL_TEXTURE_CUBE_MAP)
+        setCubemapParameters(first.isCooked() && first.cooked.levels.size() > 1);
+    else if (first.isValid())
+    {
+        // cooked textures come with their mip chain
+        if (!first.isCooked())
+            glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    texture.setReady();
+
+    if (upload.owner)
+        finishModelPart(upload.owner);
+    else
+        inFlight--;
+}
+
+void AssetStreamer::update()
+{
+    std::unique_ptr<Job> job;
+    while (finished->pop(job))
+        acceptJob(*job);
+
+    // meshes go whole (they are small compared to textures), at least one per frame so loading always progresses
+    size_t spent = 0;
+    while (!meshUploads.empty())
+    {
+        MeshUpload &upload = meshUploads.front();
+        // what the mesh uploads in the model's vertex format, compact ones get 16-bit indices where they fit
+        VertexFormat format = upload.owner->model->vertexFormat;
+        size_t vertexCount = upload.data.vertices.size();
+        GLenum indexType = format == VertexFormat::Compact && canUseShortIndices(vertexCount) ? GL_UNSIGNED_SHORT
+                                                                                               : GL_UNSIGNED_INT;
+        size_t size = vertexCount * getVertexSize(format) + upload.data.indices.size() * getIndexSize(indexType);
+        if (spent > 0 && spent + size > uploadBudget)
+            break;
+        std::shared_ptr<ModelLoad> owner = upload.owner;
+        owner->model->addMesh(upload.data);
+        meshUploads.pop_front();
+        spent += size;
+        finishModelPart(owner);
+    }
+    if (textureUploads.empty() || spent >= uploadBudget)
+        return;
+
+    // textures are streamed row by row through the pixel buffer. It is orphaned every frame so the driver never has
+    // to wait for the previous frame's transfer before we can write into it again. It is always big enough for at
+    // least one row of the first pending texture, or its largest level if it is cooked.
+    size_t capacity = uploadBudget - spent;
+    for (const std::shared_ptr<const Image> &image : textureUploads.front().layers)
+    {
+        if (image->isCooked())
+            capacity = std::max(capacity, image->cooked.levels[0].faceSize);
+        else
+            capacity = std::max(capacity, static_cast<size_t>(image->width) * image->components);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+    if (capacity > pixelBufferSize)
+        pixelBufferSize = capacity;
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, pixelBufferSize, nullptr, GL_STREAM_DRAW);
+    unsigned char *staging = static_cast<unsigned char *>(
+        glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, capacity, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (!staging)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+
+    std::vector<RowCopy> copies;
+    size_t offset = 0;
+    for (TextureUpload &upload : textureUploads)
+    {
+        offset = stageRows(upload, staging, offset, capacity, copies);
+        if (!isComplete(upload))
+            break;
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // rows are tightly packed in the staging area
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const RowCopy &copy : copies)
+    {
+        GLState::global().bindTexture(copy.target, copy.textureID);
+        if (copy.image->isCooked())
+        {
+            const KtxLevel &level = copy.image->cooked.levels[copy.level];
+            glCompressedTexSubImage2D(copy.face, copy.level, 0, 0, level.width, level.height,
+                                      copy.image->cooked.internalFormat, static_cast<GLsizei>(copy.size),
+                                      reinterpret_cast<void *>(copy.offset));
+        }
+        else
+            glTexSubImage2D(copy.face, 0, 0, copy.row, copy.image->width, copy.rowCount, copy.image->getFormat(),
+                            GL_UNSIGNED_BYTE, reinterpret_cast<void *>(copy.offset));
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    while (!textureUploads.empty() && isComplete(textureUploads.front()))
+    {
+        finishTexture(textureUploads.front());
+        textureUploads.pop_front();
+    }
+}
@@ -0,0 +1,81 @@
+#include <rg/assimpio.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+size_t FileSystemIOStream::Read(void *buffer, size_t size, size_t count)
+{
+    if (size == 0)
+        return 0;
+    // whole elements only, like fread
+    size_t elements = std::min(count, (file.size() - position) / size);
+    std::memcpy(buffer, file.data() + position, elements * size);
+    position += elements * size;
+    return elements;
+}
+
+size_t FileSystemIOStream::Write(const void *buffer, size_t size, size_t count)
+{
+    return 0;
+}
+
+aiReturn FileSystemIOStream::Seek(size_t offset, aiOrigin origin)
+{
+    // the offset is signed like fseek's, seeking backwards or from the end passes a negative number in the size_t
+    const ptrdiff_t delta = static_cast<ptrdiff_t>(offset);
+    ptrdiff_t target;
+    if (origin == aiOrigin_SET)
+        target = delta;
+    else if (origin == aiOrigin_CUR)
+        target = static_cast<ptrdiff_t>(position) + delta;
+    else
+        target = static_cast<ptrdiff_t>(file.size()) + delta;
+    if (target < 0 || static_cast<size_t>(target) > file.size())
+        return aiReturn_FAILURE;
+    position = static_cast<size_t>(target);
+    return aiReturn_SUCCESS;
+}
+
+size_t FileSystemIOStream::Tell() const
+{
+    return position;
+}
+
+size_t FileSystemIOStream::FileSize() const
+{
+    return file.size();
+}
+
+void FileSystemIOStream::Flush()
+{
+}
+
+bool FileSystemIOSystem::Exists(const char *path) const
+{
+    return FileSystem::exists(path);
+}
+
+char FileSystemIOSystem::getOsSeparator() const
+{
+    return '/';
+}
+
+Assimp::IOStream *FileSystemIOSystem::Open(const char *path, const char *mode)
+{
+    // the pack is read only, and ASSIMP only writes when exporting
+    if (std::strchr(mode, 'w') || std::strchr(mode, 'a') || std::strchr(mode, '+'))
+        return nullptr;
+    // a file that is missing now can still make a difference once it's there
+    if (std::find(openedPaths.begin(), openedPaths.end(), path) == openedPaths.end())
+        openedPaths.push_back(path);
+    FileView file = FileSystem::readFile(path);
+    if (!file.isValid())
+        return nullptr;
+    return new FileSystemIOStream(file);
+}
+
+void FileSystemIOSystem::Close(Assimp::IOStream *stream)
+{
+    delete stream;
+}
@@ -0,0 +1,97 @@
+#include <rg/benchmark.hpp>
+#include <rg/assetregistry.hpp>
+#include <rg/glstate.hpp>
+#include <rg/uniformbuffer.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+// frames rendered before measuring, so shader compilation and first uploads don't count
+const int WARMUP_FRAMES = 10;
+
+VertexFormatBenchmarkResult benchmarkFormat(const std::string &modelPath, VertexFormat format, int copies, int frames)
+{
+    AssetRegistry &assets = AssetRegistry::global();
+    std::shared_ptr<Shader> shader =
+        assets.getShader("resources/shaders/vertex_shader.vs", "resources/shaders/fragment_shader.fs", nullptr,
+                         getVertexFormatDefines(format));
+    std::shared_ptr<Model> model = assets.getModel(modelPath, false, format);
+
+    // copies are laid out on a square grid in front of the camera
+    int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(copies))));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, columns * 2.0f, columns * 6.0f), glm::vec3(0.0f),
+                                 glm::vec3(0.0f, 1.0f, 0.0f));
+    GLState::global().setDepthTest(true);
+    CameraBlock camera = CameraBlock();
+    camera.projection = projection;
+    camera.view = view;
+    camera.viewPosition = glm::vec3(0.0f, columns * 2.0f, columns * 6.0f);
+    UniformBuffer cameraBuffer(CAMERA_BLOCK_BINDING, sizeof(CameraBlock));
+    cameraBuffer.update(camera);
+    // no lights, as before
+    LightsBlock lights = LightsBlock();
+    UniformBuffer lightsBuffer(LIGHTS_BLOCK_BINDING, sizeof(LightsBlock));
+    lightsBuffer.update(lights);
+    shader->use();
+    shader->setFloat("material.shininess", 32.0f);
+
+    unsigned int query;
+    glGenQueries(1, &query);
+    double cpuTotal = 0.0, gpuTotal = 0.0;
+    for (int frame = 0; frame < WARMUP_FRAMES + frames; frame++)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        for (int i = 0; i < copies; i++)
+        {
+            glm::vec3 position((i % columns - columns / 2) * 4.0f, 0.0f, (i / columns - columns / 2) * 4.0f);
+            model->Draw(*shader, glm::translate(glm::mat4(1.0f), position));
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        glFinish();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+        GLuint64 gpuTime = 0;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &gpuTime);
+        if (frame >= WARMUP_FRAMES)
+        {
+            cpuTotal += elapsed.count();
+            gpuTotal += gpuTime / 1.0e6;
+        }
+    }
+    glDeleteQueries(1, &query);
+
+    VertexFormatBenchmarkResult result;
+    result.format = format;
+    result.gpuMemory = model->getGpuMemory();
+    result.cpuMemory = model->getCpuMemory();
+    result.cpuFrameMs = frames > 0 ? cpuTotal / frames : 0.0;
+    result.gpuFrameMs = frames > 0 ? gpuTotal / frames : 0.0;
+    return result;
+}
+} // namespace
+
+std::vector<VertexFormatBenchmarkResult> runVertexFormatBenchmark(const std::string &modelPath, int copies,
+                                                                  int frames)
+{
+    std::vector<VertexFormatBenchmarkResult> results;
+    results.push_back(benchmarkFormat(modelPath, VertexFormat::Full, copies, frames));
+    results.push_back(benchmarkFormat(modelPath, VertexFormat::Compact, copies, frames));
+
+    std::printf("vertex format benchmark: %s, %d copies, %d frames\n", modelPath.c_str(), copies, frames);
+    std::printf("%-8s %14s %14s %14s %14s\n", "format", "GPU memory KB", "CPU memory KB", "CPU ms/frame",
+                "GPU ms/frame");
+    for (const VertexFormatBenchmarkResult &result : results)
+    {
+        std::printf("%-8s %14.1f %14.1f %14.3f %14.3f\n", result.format == VertexFormat::Full ? "full" : "compact",
+                    result.gpuMemory / 1024.0, result.cpuMemory / 1024.0, result.cpuFrameMs, result.gpuFrameMs);
+    }
+    return results;
+}
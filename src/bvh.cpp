@@ -0,0 +1,479 @@
+#include <rg/bvh.hpp>
+#include <rg/threadpool.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+namespace
+{
+const uint32_t NO_PARENT = ~0u;
+// candidate split planes per axis are the borders between bins of item centers
+const unsigned int BIN_COUNT = 12;
+// cost of visiting a node relative to testing an item, for the SAH
+const float TRAVERSAL_COST = 1.0f;
+
+// slab test, distance is where the ray enters the box (0 if it starts inside)
+bool intersectBox(const BoundingBox &box, const glm::vec3 &origin, const glm::vec3 &inverseDirection,
+                  float maxDistance, float &distance)
+{
+    float entry = 0.0f;
+    float exit = maxDistance;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float t0 = (box.minimum[axis] - origin[axis]) * inverseDirection[axis];
+        float t1 = (box.maximum[axis] - origin[axis]) * inverseDirection[axis];
+        if (t0 > t1)
+            std::swap(t0, t1);
+        entry = std::max(entry, t0);
+        exit = std::min(exit, t1);
+        // also false for the NaN of a ray in the plane of a slab border, which counts as a miss
+        if (!(entry <= exit))
+            return false;
+    }
+    distance = entry;
+    return true;
+}
+
+glm::vec3 getInverseDirection(const glm::vec3 &direction)
+{
+    // division by zero gives the infinities the slab test expects
+    return glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+}
+} // namespace
+
+SceneBvh::~SceneBvh()
+{
+    if (rebuild.valid())
+        rebuild.wait();
+}
+
+unsigned int SceneBvh::addItem(const BoundingBox &box)
+{
+    bounds.push_back(box);
+    structureChanged = true;
+    return static_cast<unsigned int>(bounds.size() - 1);
+}
+
+void SceneBvh::clear()
+{
+    bounds.clear();
+    structureChanged = true;
+}
+
+void SceneBvh::setBounds(unsigned int item, const BoundingBox &box)
+{
+    bounds[item] = box;
+    if (structureChanged)
+        return;
+    uint32_t node = tree.leafOf[item];
+    while (true)
+    {
+        refitNode(node);
+        if (tree.nodes[node].parent == NO_PARENT)
+            break;
+        node = tree.nodes[node].parent;
+    }
+    refitted = true;
+}
+
+void SceneBvh::update()
+{
+    if (rebuild.valid() && rebuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        Tree rebuilt = rebuild.get();
+        // any tree over the same item numbers is valid once refitted to where the items are now
+        if (!structureChanged && rebuilt.leafOf.size() == bounds.size())
+        {
+            tree = std::move(rebuilt);
+            refitAll();
+            buildCost = computeCost(tree);
+            refitted = false;
+        }
+    }
+    if (structureChanged)
+    {
+        build();
+        return;
+    }
+    if (refitted && !rebuild.valid())
+    {
+        refitted = false;
+        if (getCost() > buildCost * rebuildThreshold)
+        {
+            std::vector<BoundingBox> snapshot = bounds;
+            rebuild = ThreadPool::global().submit([snapshot]() { return buildTree(snapshot); });
+        }
+    }
+}
+
+void SceneBvh::build()
+{
+    tree = buildTree(bounds);
+    buildCost = computeCost(tree);
+    structureChanged = false;
+    refitted = false;
+}
+
+SceneBvh::Tree SceneBvh::buildTree(const std::vector<BoundingBox> &bounds)
+{
+    Tree tree;
+    uint32_t count = static_cast<uint32_t>(bounds.size());
+    tree.items.resize(count);
+    std::iota(tree.items.begin(), tree.items.end(), 0u);
+    tree.leafOf.resize(count);
+    if (count == 0)
+        return tree;
+
+    std::vector<glm::vec3> centers(count);
+    for (uint32_t i = 0; i < count; i++)
+        centers[i] = bounds[i].getCenter();
+
+    tree.nodes.reserve(2 * count);
+    tree.nodes.push_back(Node{BoundingBox(), 0, count, NO_PARENT});
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty())
+    {
+        uint32_t index = stack.back();
+        stack.pop_back();
+        uint32_t first = tree.nodes[index].first;
+        uint32_t itemCount = tree.nodes[index].count;
+        unsigned int *items = tree.items.data() + first;
+
+        BoundingBox box, centerBox;
+        for (uint32_t i = 0; i < itemCount; i++)
+        {
+            box.expand(bounds[items[i]]);
+            centerBox.expand(centers[items[i]]);
+        }
+        tree.nodes[index].bounds = box;
+        if (itemCount <= 1)
+            continue;
+
+        // the cheapest split between bins over all axes
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        unsigned int bestBin = 0;
+        float area = box.getSurfaceArea();
+        for (int axis = 0; axis < 3 && area > 0.0f; axis++)
+        {
+            float extent = centerBox.maximum[axis] - centerBox.minimum[axis];
+            if (extent <= 0.0f)
+                continue;
+            float scale = BIN_COUNT / extent;
+            BoundingBox binBoxes[BIN_COUNT];
+            unsigned int binCounts[BIN_COUNT] = {};
+            for (uint32_t i = 0; i < itemCount; i++)
+            {
+                unsigned int bin = std::min(
+                    static_cast<unsigned int>((centers[items[i]][axis] - centerBox.minimum[axis]) * scale),
+                    BIN_COUNT - 1);
+                binBoxes[bin].expand(bounds[items[i]]);
+                binCounts[bin]++;
+            }
+            // left sides from the left, then the right sides from the right complete the costs
+            float leftAreas[BIN_COUNT - 1];
+            unsigned int leftCounts[BIN_COUNT - 1];
+            BoundingBox sweep;
+            unsigned int sweepCount = 0;
+            for (unsigned int i = 0; i < BIN_COUNT - 1; i++)
+            {
+                sweep.expand(binBoxes[i]);
+                sweepCount += binCounts[i];
+                leftAreas[i] = sweep.getSurfaceArea();
+                leftCounts[i] = sweepCount;
+            }
+            sweep = BoundingBox();
+            sweepCount = 0;
+            for (unsigned int i = BIN_COUNT - 1; i > 0; i--)
+            {
+                sweep.expand(binBoxes[i]);
+                sweepCount += binCounts[i];
+                if (leftCounts[i - 1] == 0 || sweepCount == 0)
+                    continue;
+                float cost = TRAVERSAL_COST +
+                             (leftAreas[i - 1] * leftCounts[i - 1] + sweep.getSurfaceArea() * sweepCount) / area;
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = i;
+                }
+            }
+        }
+
+        uint32_t leftCount;
+        if (bestAxis >= 0 && (bestCost < itemCount || itemCount > MAX_LEAF_ITEMS))
+        {
+            float minimum = centerBox.minimum[bestAxis];
+            float scale = BIN_COUNT / (centerBox.maximum[bestAxis] - minimum);
+            unsigned int *middle = std::partition(items, items + itemCount, [&](unsigned int item) {
+                unsigned int bin = std::min(static_cast<unsigned int>((centers[item][bestAxis] - minimum) * scale),
+                                            BIN_COUNT - 1);
+                return bin < bestBin;
+            });
+            leftCount = static_cast<uint32_t>(middle - items);
+        }
+        else if (itemCount > MAX_LEAF_ITEMS)
+        {
+            // all centers in one point (or flat boxes), only an even split keeps the leaves small
+            leftCount = itemCount / 2;
+        }
+        else
+        {
+            continue;
+        }
+
+        uint32_t children = static_cast<uint32_t>(tree.nodes.size());
+        tree.nodes.push_back(Node{BoundingBox(), first, leftCount, index});
+        tree.nodes.push_back(Node{BoundingBox(), first + leftCount, itemCount - leftCount, index});
+        tree.nodes[index].first = children;
+        tree.nodes[index].count = 0;
+        stack.push_back(children);
+        stack.push_back(children + 1);
+    }
+
+    for (uint32_t node = 0; node < tree.nodes.size(); node++)
+    {
+        for (uint32_t i = 0; i < tree.nodes[node].count; i++)
+            tree.leafOf[tree.items[tree.nodes[node].first + i]] = node;
+    }
+    return tree;
+}
+
+float SceneBvh::computeCost(const Tree &tree)
+{
+    if (tree.nodes.empty())
+        return 0.0f;
+    float rootArea = tree.nodes[0].bounds.getSurfaceArea();
+    if (rootArea <= 0.0f)
+        return 0.0f;
+    float cost = 0.0f;
+    for (const Node &node : tree.nodes)
+        cost += node.bounds.getSurfaceArea() / rootArea * (node.count == 0 ? TRAVERSAL_COST : node.count);
+    return cost;
+}
+
+float SceneBvh::getCost() const
+{
+    return computeCost(tree);
+}
+
+void SceneBvh::refitNode(uint32_t index)
+{
+    Node &node = tree.nodes[index];
+    BoundingBox box;
+    if (node.count == 0)
+    {
+        box = tree.nodes[node.first].bounds;
+        box.expand(tree.nodes[node.first + 1].bounds);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < node.count; i++)
+            box.expand(bounds[tree.items[node.first + i]]);
+    }
+    node.bounds = box;
+}
+
+void SceneBvh::refitAll()
+{
+    // children come after their parents, so going backwards refits them first
+    for (size_t i = tree.nodes.size(); i > 0; i--)
+        refitNode(static_cast<uint32_t>(i - 1));
+}
+
+void SceneBvh::queryFrustum(const Frustum &frustum, std::vector<unsigned int> &items) const
+{
+    // the tree doesn't know about items added or removed since the last build, their boxes are tested one by one
+    if (structureChanged)
+    {
+        for (unsigned int i = 0; i < bounds.size(); i++)
+        {
+            if (frustum.intersectsBox(bounds[i].minimum, bounds[i].maximum))
+                items.push_back(i);
+        }
+        return;
+    }
+    if (tree.nodes.empty())
+        return;
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty())
+    {
+        const Node &node = tree.nodes[stack.back()];
+        stack.pop_back();
+        FrustumTest test = frustum.classifyBox(node.bounds);
+        if (test == FrustumTest::Outside)
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t i = 0; i < node.count; i++)
+            {
+                unsigned int item = tree.items[node.first + i];
+                if (test == FrustumTest::Inside || frustum.intersectsBox(bounds[item].minimum, bounds[item].maximum))
+                    items.push_back(item);
+            }
+        }
+        else if (test == FrustumTest::Inside)
+        {
+            // a subtree completely inside is taken without testing: its items are the range of its leaves
+            uint32_t leftmost = node.first;
+            while (tree.nodes[leftmost].count == 0)
+                leftmost = tree.nodes[leftmost].first;
+            uint32_t rightmost = node.first + 1;
+            while (tree.nodes[rightmost].count == 0)
+                rightmost = tree.nodes[rightmost].first + 1;
+            uint32_t begin = tree.nodes[leftmost].first;
+            uint32_t end = tree.nodes[rightmost].first + tree.nodes[rightmost].count;
+            items.insert(items.end(), tree.items.begin() + begin, tree.items.begin() + end);
+        }
+        else
+        {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+void SceneBvh::queryOverlap(const BoundingBox &box, std::vector<unsigned int> &items) const
+{
+    if (structureChanged)
+    {
+        for (unsigned int i = 0; i < bounds.size(); i++)
+        {
+            if (bounds[i].overlaps(box))
+                items.push_back(i);
+        }
+        return;
+    }
+    if (tree.nodes.empty())
+        return;
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty())
+    {
+        const Node &node = tree.nodes[stack.back()];
+        stack.pop_back();
+        if (!node.bounds.overlaps(box))
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t i = 0; i < node.count; i++)
+            {
+                unsigned int item = tree.items[node.first + i];
+                if (bounds[item].overlaps(box))
+                    items.push_back(item);
+            }
+        }
+        else
+        {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+void SceneBvh::queryRay(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+                        std::vector<unsigned int> &items) const
+{
+    glm::vec3 inverseDirection = getInverseDirection(direction);
+    float distance;
+    if (structureChanged)
+    {
+        for (unsigned int i = 0; i < bounds.size(); i++)
+        {
+            if (intersectBox(bounds[i], origin, inverseDirection, maxDistance, distance))
+                items.push_back(i);
+        }
+        return;
+    }
+    if (tree.nodes.empty())
+        return;
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty())
+    {
+        const Node &node = tree.nodes[stack.back()];
+        stack.pop_back();
+        if (!intersectBox(node.bounds, origin, inverseDirection, maxDistance, distance))
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t i = 0; i < node.count; i++)
+            {
+                unsigned int item = tree.items[node.first + i];
+                if (intersectBox(bounds[item], origin, inverseDirection, maxDistance, distance))
+                    items.push_back(item);
+            }
+        }
+        else
+        {
+            stack.push_back(node.first);
+            stack.push_back(node.first + 1);
+        }
+    }
+}
+
+bool SceneBvh::intersectRay(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance,
+                            BvhRayHit &hit) const
+{
+    glm::vec3 inverseDirection = getInverseDirection(direction);
+    float nearest = maxDistance;
+    bool found = false;
+    float distance;
+    if (structureChanged)
+    {
+        for (unsigned int i = 0; i < bounds.size(); i++)
+        {
+            if (intersectBox(bounds[i], origin, inverseDirection, nearest, distance))
+            {
+                hit.item = i;
+                hit.distance = nearest = distance;
+                found = true;
+            }
+        }
+        return found;
+    }
+    if (tree.nodes.empty())
+        return false;
+    std::vector<uint32_t> stack(1, 0);
+    while (!stack.empty())
+    {
+        const Node &node = tree.nodes[stack.back()];
+        stack.pop_back();
+        // the bound shrinks with every hit, subtrees behind the nearest hit are skipped
+        if (!intersectBox(node.bounds, origin, inverseDirection, nearest, distance))
+            continue;
+        if (node.count > 0)
+        {
+            for (uint32_t i = 0; i < node.count; i++)
+            {
+                unsigned int item = tree.items[node.first + i];
+                if (intersectBox(bounds[item], origin, inverseDirection, nearest, distance))
+                {
+                    hit.item = item;
+                    hit.distance = nearest = distance;
+                    found = true;
+                }
+            }
+            continue;
+        }
+        // the nearer child goes on top of the stack, its hits prune the farther one
+        float leftDistance = FLT_MAX, rightDistance = FLT_MAX;
+        bool left = intersectBox(tree.nodes[node.first].bounds, origin, inverseDirection, nearest, leftDistance);
+        bool right = intersectBox(tree.nodes[node.first + 1].bounds, origin, inverseDirection, nearest, rightDistance);
+        if (left && right)
+        {
+            bool leftFirst = leftDistance <= rightDistance;
+            stack.push_back(leftFirst ? node.first + 1 : node.first);
+            stack.push_back(leftFirst ? node.first : node.first + 1);
+        }
+        else if (left)
+        {
+            stack.push_back(node.first);
+        }
+        else if (right)
+        {
+            stack.push_back(node.first + 1);
+        }
+    }
+    return found;
+}
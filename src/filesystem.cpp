@@ -0,0 +1,228 @@
+#include <rg/assetpack.hpp>
+#include <rg/filesystem.hpp>
+
+#include "root_directory.h" // This is a configuration file generated by CMake.
+
+#include <mutex>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+struct MountTable
+{
+    std::mutex mutex;
+    std::vector<std::shared_ptr<AssetPack>> packs; // searched from the back, the last mount wins
+    bool looseFirst = false;
+};
+
+MountTable &getMountTable()
+{
+    static MountTable table;
+    return table;
+}
+
+// the newest mounted pack that contains the path
+std::shared_ptr<AssetPack> findPack(const std::string &path, const AssetPack::Entry *&entry)
+{
+    MountTable &table = getMountTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    if (table.packs.empty())
+        return nullptr;
+    std::string key = FileSystem::normalizePath(path);
+    for (auto it = table.packs.rbegin(); it != table.packs.rend(); ++it)
+    {
+        entry = (*it)->find(key);
+        if (entry)
+            return *it;
+    }
+    return nullptr;
+}
+
+bool isLooseFirst()
+{
+    MountTable &table = getMountTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    return table.looseFirst;
+}
+
+// unmaps a loose file when the last view of it is gone
+struct LooseMapping
+{
+    void *address;
+    size_t size;
+
+    ~LooseMapping()
+    {
+        munmap(address, size);
+    }
+};
+
+// mmap instead of read: like a packed file, a loose file is used in place and only the touched pages are read
+FileView mapLooseFile(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return FileView();
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return FileView();
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0)
+    {
+        // nothing to map, but the file exists
+        close(fd);
+        static const unsigned char empty = 0;
+        return FileView(&empty, 0, std::make_shared<int>(0));
+    }
+    void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED)
+        return FileView();
+    std::shared_ptr<LooseMapping> mapping = std::make_shared<LooseMapping>();
+    mapping->address = address;
+    mapping->size = size;
+    return FileView(static_cast<const unsigned char *>(address), size, mapping);
+}
+
+FileView readPackedFile(const std::string &path)
+{
+    const AssetPack::Entry *entry = nullptr;
+    std::shared_ptr<AssetPack> pack = findPack(path, entry);
+    if (!pack)
+        return FileView();
+    return FileView(pack->getData(*entry), static_cast<size_t>(entry->size), pack);
+}
+
+bool getLooseFileInfo(const std::string &path, FileInfo &info)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return false;
+    info.size = static_cast<uint64_t>(st.st_size);
+    info.modified = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+bool getPackedFileInfo(const std::string &path, FileInfo &info)
+{
+    const AssetPack::Entry *entry = nullptr;
+    if (!findPack(path, entry))
+        return false;
+    info.size = entry->size;
+    info.modified = entry->modified;
+    return true;
+}
+} // namespace
+
+std::string const &FileSystem::getRoot()
+{
+    static char const *envRoot = getenv("LOGL_ROOT_PATH");
+    static char const *givenRoot = (envRoot != nullptr ? envRoot : logl_root);
+    static std::string root = (givenRoot != nullptr ? givenRoot : "");
+    return root;
+}
+
+bool FileSystem::mountPack(const std::string &packPath)
+{
+    std::shared_ptr<AssetPack> pack = AssetPack::open(packPath);
+    if (!pack)
+        return false;
+    MountTable &table = getMountTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    table.packs.push_back(pack);
+    return true;
+}
+
+void FileSystem::unmountAll()
+{
+    // views that are still alive keep their pack mapped
+    MountTable &table = getMountTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    table.packs.clear();
+}
+
+void FileSystem::setLooseFilesFirst(bool looseFirst)
+{
+    MountTable &table = getMountTable();
+    std::lock_guard<std::mutex> lock(table.mutex);
+    table.looseFirst = looseFirst;
+}
+
+FileView FileSystem::readFile(const std::string &path)
+{
+    if (isLooseFirst())
+    {
+        FileView loose = mapLooseFile(path);
+        return loose.isValid() ? loose : readPackedFile(path);
+    }
+    FileView packed = readPackedFile(path);
+    return packed.isValid() ? packed : mapLooseFile(path);
+}
+
+bool FileSystem::getFileInfo(const std::string &path, FileInfo &info)
+{
+    if (isLooseFirst())
+        return getLooseFileInfo(path, info) || getPackedFileInfo(path, info);
+    return getPackedFileInfo(path, info) || getLooseFileInfo(path, info);
+}
+
+bool FileSystem::exists(const std::string &path)
+{
+    FileInfo info;
+    return getFileInfo(path, info);
+}
+
+bool FileSystem::isPacked(const std::string &path)
+{
+    const AssetPack::Entry *entry = nullptr;
+    return findPack(path, entry) != nullptr;
+}
+
+std::string FileSystem::normalizePath(const std::string &path)
+{
+    std::string unified = path;
+    for (char &c : unified)
+        c = c == '\\' ? '/' : c;
+    // getPath results start with the root, the pack doesn't know about it
+    const std::string &root = getRoot();
+    bool absolute = !unified.empty() && unified[0] == '/';
+    if (!root.empty() && unified.compare(0, root.size(), root) == 0 &&
+        (unified.size() == root.size() || unified[root.size()] == '/'))
+    {
+        unified.erase(0, root.size());
+        absolute = false;
+    }
+
+    std::vector<std::string> components;
+    size_t start = 0;
+    while (start <= unified.size())
+    {
+        size_t end = unified.find('/', start);
+        if (end == std::string::npos)
+            end = unified.size();
+        std::string component = unified.substr(start, end - start);
+        if (component == "..")
+        {
+            if (!components.empty() && components.back() != "..")
+                components.pop_back();
+            else if (!absolute)
+                components.push_back(component);
+        }
+        else if (!component.empty() && component != ".")
+            components.push_back(component);
+        start = end + 1;
+    }
+
+    std::string result = absolute ? "/" : "";
+    for (size_t i = 0; i < components.size(); i++)
+        result += (i > 0 ? "/" : "") + components[i];
+    return result;
+}
@@ -0,0 +1,287 @@
+#include <rg/frustum.hpp>
+
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RG_CULL_X86 1
+#endif
+
+namespace
+{
+// the planes split into components, plus the absolute values of the normals that project a box's extents
+struct CullPlanes
+{
+    float x[6], y[6], z[6], w[6];
+    float absX[6], absY[6], absZ[6];
+
+    explicit CullPlanes(const Frustum &frustum)
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            x[i] = frustum.planes[i].x;
+            y[i] = frustum.planes[i].y;
+            z[i] = frustum.planes[i].z;
+            w[i] = frustum.planes[i].w;
+            absX[i] = std::fabs(x[i]);
+            absY[i] = std::fabs(y[i]);
+            absZ[i] = std::fabs(z[i]);
+        }
+    }
+};
+
+struct BoxArrays
+{
+    const float *centerX, *centerY, *centerZ;
+    const float *extentX, *extentY, *extentZ;
+};
+
+// A box is outside of a plane if even its corner farthest along the normal is behind it: the distance of the center
+// plus the extents projected onto the normal is negative. Boxes outside of no plane are kept, which keeps a few
+// boxes near the frustum's corners that are outside, never the other way around.
+size_t cullScalar(const CullPlanes &planes, const BoxArrays &boxes, size_t first, size_t count, uint8_t *visible)
+{
+    size_t visibleCount = 0;
+    for (size_t i = first; i < count; i++)
+    {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++)
+        {
+            float distance = planes.x[p] * boxes.centerX[i] + planes.y[p] * boxes.centerY[i] +
+                             planes.z[p] * boxes.centerZ[i] + planes.w[p];
+            float radius = planes.absX[p] * boxes.extentX[i] + planes.absY[p] * boxes.extentY[i] +
+                           planes.absZ[p] * boxes.extentZ[i];
+            inside = distance + radius >= 0.0f;
+        }
+        visible[i] = inside ? 1 : 0;
+        visibleCount += inside ? 1 : 0;
+    }
+    return visibleCount;
+}
+
+#ifdef RG_CULL_X86
+// four boxes at a time, SSE2 is part of every x86-64 CPU
+size_t cullSSE(const CullPlanes &planes, const BoxArrays &boxes, size_t count, uint8_t *visible)
+{
+    size_t i = 0;
+    size_t visibleCount = 0;
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 centerX = _mm_loadu_ps(boxes.centerX + i);
+        __m128 centerY = _mm_loadu_ps(boxes.centerY + i);
+        __m128 centerZ = _mm_loadu_ps(boxes.centerZ + i);
+        __m128 extentX = _mm_loadu_ps(boxes.extentX + i);
+        __m128 extentY = _mm_loadu_ps(boxes.extentY + i);
+        __m128 extentZ = _mm_loadu_ps(boxes.extentZ + i);
+        int mask = 0xF;
+        for (int p = 0; p < 6 && mask != 0; p++)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.x[p]), centerX),
+                                                    _mm_mul_ps(_mm_set1_ps(planes.y[p]), centerY)),
+                                         _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.z[p]), centerZ),
+                                                    _mm_set1_ps(planes.w[p])));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.absX[p]), extentX),
+                                                  _mm_mul_ps(_mm_set1_ps(planes.absY[p]), extentY)),
+                                       _mm_mul_ps(_mm_set1_ps(planes.absZ[p]), extentZ));
+            mask &= _mm_movemask_ps(_mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+        }
+        for (int k = 0; k < 4; k++)
+        {
+            visible[i + k] = (mask >> k) & 1;
+            visibleCount += (mask >> k) & 1;
+        }
+    }
+    return visibleCount + cullScalar(planes, boxes, i, count, visible);
+}
+
+// eight boxes at a time. Compiled for AVX on its own, the rest of the program doesn't require it.
+__attribute__((target("avx"))) size_t cullAVX(const CullPlanes &planes, const BoxArrays &boxes, size_t count,
+                                              uint8_t *visible)
+{
+    size_t i = 0;
+    size_t visibleCount = 0;
+    const __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256 centerX = _mm256_loadu_ps(boxes.centerX + i);
+        __m256 centerY = _mm256_loadu_ps(boxes.centerY + i);
+        __m256 centerZ = _mm256_loadu_ps(boxes.centerZ + i);
+        __m256 extentX = _mm256_loadu_ps(boxes.extentX + i);
+        __m256 extentY = _mm256_loadu_ps(boxes.extentY + i);
+        __m256 extentZ = _mm256_loadu_ps(boxes.extentZ + i);
+        int mask = 0xFF;
+        for (int p = 0; p < 6 && mask != 0; p++)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.x[p]), centerX),
+                                                          _mm256_mul_ps(_mm256_set1_ps(planes.y[p]), centerY)),
+                                            _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.z[p]), centerZ),
+                                                          _mm256_set1_ps(planes.w[p])));
+            __m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.absX[p]), extentX),
+                                                        _mm256_mul_ps(_mm256_set1_ps(planes.absY[p]), extentY)),
+                                          _mm256_mul_ps(_mm256_set1_ps(planes.absZ[p]), extentZ));
+            mask &= _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+        }
+        for (int k = 0; k < 8; k++)
+        {
+            visible[i + k] = (mask >> k) & 1;
+            visibleCount += (mask >> k) & 1;
+        }
+    }
+    return visibleCount + cullScalar(planes, boxes, i, count, visible);
+}
+
+bool hasAVX()
+{
+    static const bool avx = __builtin_cpu_supports("avx");
+    return avx;
+}
+#endif
+} // namespace
+
+Frustum::Frustum()
+{
+    for (glm::vec4 &plane : planes)
+        plane = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::Frustum(const glm::mat4 &viewProjection)
+{
+    // glm is column major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++)
+        rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+    // left, right, bottom, top, near, far
+    planes[0] = rows[3] + rows[0];
+    planes[1] = rows[3] - rows[0];
+    planes[2] = rows[3] + rows[1];
+    planes[3] = rows[3] - rows[1];
+    planes[4] = rows[3] + rows[2];
+    planes[5] = rows[3] - rows[2];
+    // normalized, so that plane distances are world space distances (the sphere test relies on it)
+    for (glm::vec4 &plane : planes)
+        plane /= glm::length(glm::vec3(plane));
+}
+
+float BoundingBox::getSurfaceArea() const
+{
+    if (isEmpty())
+        return 0.0f;
+    glm::vec3 size = maximum - minimum;
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+bool BoundingBox::overlaps(const BoundingBox &other) const
+{
+    return minimum.x <= other.maximum.x && minimum.y <= other.maximum.y && minimum.z <= other.maximum.z &&
+           other.minimum.x <= maximum.x && other.minimum.y <= maximum.y && other.minimum.z <= maximum.z;
+}
+
+void BoundingBox::expand(const BoundingBox &other)
+{
+    minimum = glm::min(minimum, other.minimum);
+    maximum = glm::max(maximum, other.maximum);
+}
+
+void BoundingBox::expand(const glm::vec3 &point)
+{
+    minimum = glm::min(minimum, point);
+    maximum = glm::max(maximum, point);
+}
+
+BoundingBox BoundingBox::transformed(const glm::mat4 &transform) const
+{
+    if (isEmpty())
+        return BoundingBox();
+    // Arvo: the world extent along an axis is the model extents projected onto it through the absolute matrix
+    glm::vec3 center = glm::vec3(transform * glm::vec4(getCenter(), 1.0f));
+    glm::vec3 extent = (maximum - minimum) * 0.5f;
+    glm::mat3 absolute = glm::mat3(glm::abs(glm::vec3(transform[0])), glm::abs(glm::vec3(transform[1])),
+                                   glm::abs(glm::vec3(transform[2])));
+    glm::vec3 worldExtent = absolute * extent;
+    return BoundingBox(center - worldExtent, center + worldExtent);
+}
+
+bool Frustum::intersectsSphere(const glm::vec3 &center, float radius) const
+{
+    for (const glm::vec4 &plane : planes)
+    {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::intersectsBox(const glm::vec3 &minimum, const glm::vec3 &maximum) const
+{
+    glm::vec3 center = (minimum + maximum) * 0.5f;
+    glm::vec3 extent = (maximum - minimum) * 0.5f;
+    for (const glm::vec4 &plane : planes)
+    {
+        glm::vec3 normal = glm::vec3(plane);
+        if (glm::dot(normal, center) + plane.w + glm::dot(glm::abs(normal), extent) < 0.0f)
+            return false;
+    }
+    return true;
+}
+
+FrustumTest Frustum::classifyBox(const BoundingBox &box) const
+{
+    glm::vec3 center = box.getCenter();
+    glm::vec3 extent = (box.maximum - box.minimum) * 0.5f;
+    FrustumTest result = FrustumTest::Inside;
+    for (const glm::vec4 &plane : planes)
+    {
+        glm::vec3 normal = glm::vec3(plane);
+        float distance = glm::dot(normal, center) + plane.w;
+        float radius = glm::dot(glm::abs(normal), extent);
+        if (distance + radius < 0.0f)
+            return FrustumTest::Outside;
+        if (distance - radius < 0.0f)
+            result = FrustumTest::Intersects;
+    }
+    return result;
+}
+
+void BoundingBoxes::clear()
+{
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    extentX.clear();
+    extentY.clear();
+    extentZ.clear();
+}
+
+void BoundingBoxes::add(const glm::vec3 &minimum, const glm::vec3 &maximum)
+{
+    glm::vec3 center = (minimum + maximum) * 0.5f;
+    glm::vec3 extent = (maximum - minimum) * 0.5f;
+    centerX.push_back(center.x);
+    centerY.push_back(center.y);
+    centerZ.push_back(center.z);
+    extentX.push_back(extent.x);
+    extentY.push_back(extent.y);
+    extentZ.push_back(extent.z);
+}
+
+void BoundingBoxes::add(const glm::vec3 &minimum, const glm::vec3 &maximum, const glm::mat4 &transform)
+{
+    BoundingBox box = BoundingBox(minimum, maximum).transformed(transform);
+    add(box.minimum, box.maximum);
+}
+
+size_t BoundingBoxes::cull(const Frustum &frustum, std::vector<uint8_t> &visible) const
+{
+    visible.resize(size());
+    CullPlanes planes(frustum);
+    BoxArrays boxes = {centerX.data(), centerY.data(), centerZ.data(),
+                       extentX.data(), extentY.data(), extentZ.data()};
+#ifdef RG_CULL_X86
+    if (hasAVX())
+        return cullAVX(planes, boxes, size(), visible.data());
+    return cullSSE(planes, boxes, size(), visible.data());
+#else
+    return cullScalar(planes, boxes, 0, size(), visible.data());
+#endif
+}
@@ -0,0 +1,195 @@
+#include <rg/geometrybuffer.hpp>
+#include <rg/glstate.hpp>
+
+#include <algorithm>
+#include <iterator>
+
+namespace
+{
+bool sharedGeometryEnabled = false;
+
+// first reservation, in vertices (indices get three times as many)
+const unsigned int MIN_VERTEX_CAPACITY = 1 << 16;
+
+// moves the contents of the buffer into a new one of newSize bytes, returns the new buffer
+unsigned int growBuffer(unsigned int buffer, size_t size, size_t newSize)
+{
+    unsigned int newBuffer;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+    if (buffer && size)
+    {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+    return newBuffer;
+}
+} // namespace
+
+bool RangeAllocator::allocate(unsigned int size, unsigned int &offset)
+{
+    for (std::map<unsigned int, unsigned int>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it)
+    {
+        if (it->second < size)
+            continue;
+        offset = it->first;
+        unsigned int rest = it->second - size;
+        freeRanges.erase(it);
+        if (rest > 0)
+            freeRanges[offset + size] = rest;
+        return true;
+    }
+    return false;
+}
+
+void RangeAllocator::free(unsigned int offset, unsigned int size)
+{
+    // ranges of a buffer that was reset in the meantime are stale
+    if (size == 0 || offset + size > capacity)
+        return;
+    std::map<unsigned int, unsigned int>::iterator next = freeRanges.lower_bound(offset);
+    if (next != freeRanges.end() && offset + size == next->first)
+    {
+        size += next->second;
+        next = freeRanges.erase(next);
+    }
+    if (next != freeRanges.begin())
+    {
+        std::map<unsigned int, unsigned int>::iterator previous = std::prev(next);
+        if (previous->first + previous->second == offset)
+        {
+            previous->second += size;
+            return;
+        }
+    }
+    freeRanges[offset] = size;
+}
+
+void RangeAllocator::grow(unsigned int newCapacity)
+{
+    if (newCapacity <= capacity)
+        return;
+    unsigned int offset = capacity;
+    capacity = newCapacity;
+    free(offset, newCapacity - offset);
+}
+
+void RangeAllocator::reset()
+{
+    freeRanges.clear();
+    capacity = 0;
+}
+
+GeometryBuffer::GeometryBuffer(VertexFormat format)
+    : format(format), indexType(format == VertexFormat::Compact ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT),
+      vertexSize(getVertexSize(format)), indexSize(getIndexSize(indexType))
+{
+}
+
+GeometryBuffer &GeometryBuffer::get(VertexFormat format)
+{
+    static GeometryBuffer full(VertexFormat::Full);
+    static GeometryBuffer compact(VertexFormat::Compact);
+    return format == VertexFormat::Compact ? compact : full;
+}
+
+void GeometryBuffer::setEnabled(bool enabled)
+{
+    sharedGeometryEnabled = enabled;
+}
+
+bool GeometryBuffer::isEnabled()
+{
+    return sharedGeometryEnabled;
+}
+
+void GeometryBuffer::releaseAll()
+{
+    get(VertexFormat::Full).release();
+    get(VertexFormat::Compact).release();
+}
+
+void GeometryBuffer::release()
+{
+    GLState::global().deleteVertexArray(VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    VAO = VBO = EBO = 0;
+    vertexRanges.reset();
+    indexRanges.reset();
+    usedVertices = usedIndices = allocationCount = 0;
+}
+
+GeometryAllocation GeometryBuffer::allocate(const void *vertices, unsigned int vertexCount, const void *indices,
+                                            unsigned int indexCount)
+{
+    GeometryAllocation allocation;
+    allocation.vertexCount = vertexCount;
+    allocation.indexCount = indexCount;
+    bool hasVertices = vertexRanges.allocate(vertexCount, allocation.baseVertex);
+    if (!hasVertices || !indexRanges.allocate(indexCount, allocation.firstIndex))
+    {
+        if (hasVertices)
+            vertexRanges.free(allocation.baseVertex, vertexCount);
+        // doubling keeps the number of copies logarithmic in the final size
+        unsigned int vertexCapacity = vertexRanges.getCapacity(), indexCapacity = indexRanges.getCapacity();
+        reserve(std::max(std::max(vertexCapacity * 2, vertexCapacity + vertexCount), MIN_VERTEX_CAPACITY),
+                std::max(std::max(indexCapacity * 2, indexCapacity + indexCount), MIN_VERTEX_CAPACITY * 3));
+        vertexRanges.allocate(vertexCount, allocation.baseVertex);
+        indexRanges.allocate(indexCount, allocation.firstIndex);
+    }
+    usedVertices += vertexCount;
+    usedIndices += indexCount;
+    allocationCount++;
+
+    // GL_COPY_WRITE_BUFFER leaves the element buffer binding of whatever VAO is bound alone
+    glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.baseVertex * vertexSize, vertexCount * vertexSize, vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstIndex * indexSize, indexCount * indexSize, indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return allocation;
+}
+
+void GeometryBuffer::free(const GeometryAllocation &allocation)
+{
+    if (allocation.vertexCount == 0 && allocation.indexCount == 0)
+        return;
+    vertexRanges.free(allocation.baseVertex, allocation.vertexCount);
+    indexRanges.free(allocation.firstIndex, allocation.indexCount);
+    usedVertices -= std::min(usedVertices, allocation.vertexCount);
+    usedIndices -= std::min(usedIndices, allocation.indexCount);
+    allocationCount -= std::min(allocationCount, 1u);
+}
+
+void GeometryBuffer::reserve(unsigned int vertexCapacity, unsigned int indexCapacity)
+{
+    if (!VAO)
+        glGenVertexArrays(1, &VAO);
+    VBO = growBuffer(VBO, vertexRanges.getCapacity() * vertexSize, vertexCapacity * vertexSize);
+    EBO = growBuffer(EBO, indexRanges.getCapacity() * indexSize, indexCapacity * indexSize);
+    vertexRanges.grow(vertexCapacity);
+    indexRanges.grow(indexCapacity);
+
+    // the attribute pointers captured the old VBO, point them at the new one
+    GLState::global().bindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    setupVertexAttributes(format);
+    GLState::global().bindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+size_t GeometryBuffer::getUsedMemory() const
+{
+    return usedVertices * vertexSize + usedIndices * indexSize;
+}
+
+size_t GeometryBuffer::getGpuMemory() const
+{
+    return vertexRanges.getCapacity() * vertexSize + indexRanges.getCapacity() * indexSize;
+}
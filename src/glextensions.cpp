@@ -0,0 +1,62 @@
+#include <rg/glextensions.hpp>
+
+#include <cstring>
+
+GLExtensions glExtensions;
+
+bool hasGLExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *extension = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+        if (extension && std::strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool hasGLVersion(int major, int minor)
+{
+    GLint contextMajor = 0, contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+void loadGLExtensions(GLADloadproc load)
+{
+    glExtensions = GLExtensions();
+
+    if (hasGLVersion(4, 1) || hasGLExtension("GL_ARB_get_program_binary"))
+    {
+        glExtensions.getProgramBinary = reinterpret_cast<PFNRGGETPROGRAMBINARYPROC>(load("glGetProgramBinary"));
+        glExtensions.programBinary = reinterpret_cast<PFNRGPROGRAMBINARYPROC>(load("glProgramBinary"));
+        glExtensions.programParameteri = reinterpret_cast<PFNRGPROGRAMPARAMETERIPROC>(load("glProgramParameteri"));
+        // drivers may support the extension but no binary format at all
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        glExtensions.hasProgramBinary = glExtensions.getProgramBinary && glExtensions.programBinary &&
+                                        glExtensions.programParameteri && formats > 0;
+    }
+
+    if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+        glExtensions.maxShaderCompilerThreads =
+            reinterpret_cast<PFNRGMAXSHADERCOMPILERTHREADSPROC>(load("glMaxShaderCompilerThreadsKHR"));
+    else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+        glExtensions.maxShaderCompilerThreads =
+            reinterpret_cast<PFNRGMAXSHADERCOMPILERTHREADSPROC>(load("glMaxShaderCompilerThreadsARB"));
+    glExtensions.hasParallelShaderCompile = glExtensions.maxShaderCompilerThreads != nullptr;
+
+    // GL_ARB_shader_storage_buffer_object alone isn't enough, the culling shader is #version 430
+    if (hasGLVersion(4, 3))
+    {
+        glExtensions.dispatchCompute = reinterpret_cast<PFNRGDISPATCHCOMPUTEPROC>(load("glDispatchCompute"));
+        glExtensions.memoryBarrier = reinterpret_cast<PFNRGMEMORYBARRIERPROC>(load("glMemoryBarrier"));
+        glExtensions.multiDrawElementsIndirect =
+            reinterpret_cast<PFNRGMULTIDRAWELEMENTSINDIRECTPROC>(load("glMultiDrawElementsIndirect"));
+        glExtensions.hasGpuCulling = glExtensions.dispatchCompute && glExtensions.memoryBarrier &&
+                                     glExtensions.multiDrawElementsIndirect;
+    }
+}
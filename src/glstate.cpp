@@ -0,0 +1,188 @@
+#include <rg/glstate.hpp>
+
+namespace
+{
+const GLuint UNKNOWN = ~0u;
+
+// slot of a tracked texture target, -1 for the others
+int getTargetSlot(GLenum target)
+{
+    switch (target)
+    {
+    case GL_TEXTURE_2D:
+        return 0;
+    case GL_TEXTURE_CUBE_MAP:
+        return 1;
+    default:
+        return -1;
+    }
+}
+} // namespace
+
+GLState &GLState::global()
+{
+    static GLState state;
+    return state;
+}
+
+GLState::GLState()
+{
+    invalidate();
+}
+
+template <typename T> bool GLState::changes(T &cached, T value)
+{
+    if (cached == value)
+    {
+        stats.filtered++;
+        return false;
+    }
+    cached = value;
+    stats.issued++;
+    return true;
+}
+
+void GLState::useProgram(GLuint newProgram)
+{
+    if (changes(program, newProgram))
+        glUseProgram(newProgram);
+}
+
+void GLState::bindVertexArray(GLuint newVertexArray)
+{
+    if (changes(vertexArray, newVertexArray))
+        glBindVertexArray(newVertexArray);
+}
+
+void GLState::activeTexture(unsigned int unit)
+{
+    if (changes(activeUnit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState::bindTexture(unsigned int unit, GLenum target, GLuint texture)
+{
+    int slot = getTargetSlot(target);
+    if (unit < TRACKED_TEXTURE_UNITS && slot >= 0)
+    {
+        // the active unit only matters if the binding changes
+        if (textures[unit][slot] == texture)
+        {
+            stats.filtered++;
+            return;
+        }
+        activeTexture(unit);
+        changes(textures[unit][slot], texture);
+    }
+    else
+    {
+        activeTexture(unit);
+        stats.issued++;
+    }
+    glBindTexture(target, texture);
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+    if (activeUnit == UNKNOWN)
+        activeTexture(0);
+    bindTexture(activeUnit, target, texture);
+}
+
+void GLState::setCapability(GLenum capability, int &cached, bool enabled)
+{
+    if (!changes(cached, enabled ? 1 : 0))
+        return;
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+void GLState::setBlend(bool enabled)
+{
+    setCapability(GL_BLEND, blend, enabled);
+}
+
+void GLState::setBlendFunc(GLenum source, GLenum destination)
+{
+    if (blendSource == source && blendDestination == destination)
+    {
+        stats.filtered++;
+        return;
+    }
+    blendSource = source;
+    blendDestination = destination;
+    stats.issued++;
+    glBlendFunc(source, destination);
+}
+
+void GLState::setDepthTest(bool enabled)
+{
+    setCapability(GL_DEPTH_TEST, depthTest, enabled);
+}
+
+void GLState::setDepthFunc(GLenum function)
+{
+    if (changes(depthFunction, function))
+        glDepthFunc(function);
+}
+
+void GLState::setCullFace(bool enabled)
+{
+    setCapability(GL_CULL_FACE, cullFace, enabled);
+}
+
+void GLState::setCullFaceMode(GLenum mode)
+{
+    if (changes(cullFaceMode, mode))
+        glCullFace(mode);
+}
+
+void GLState::deleteProgram(GLuint deleted)
+{
+    // a program in use stays alive until it's replaced, it doesn't get unbound
+    glDeleteProgram(deleted);
+    if (program == deleted)
+        program = UNKNOWN;
+}
+
+void GLState::deleteVertexArray(GLuint deleted)
+{
+    glDeleteVertexArrays(1, &deleted);
+    if (vertexArray == deleted)
+        vertexArray = 0;
+}
+
+void GLState::deleteTexture(GLuint deleted)
+{
+    glDeleteTextures(1, &deleted);
+    // deleting a texture binds 0 in its place on every unit
+    for (GLuint(&unit)[TRACKED_TEXTURE_TARGETS] : textures)
+    {
+        for (GLuint &texture : unit)
+        {
+            if (texture == deleted)
+                texture = 0;
+        }
+    }
+}
+
+void GLState::invalidate()
+{
+    program = vertexArray = activeUnit = UNKNOWN;
+    for (GLuint(&unit)[TRACKED_TEXTURE_TARGETS] : textures)
+    {
+        for (GLuint &texture : unit)
+            texture = UNKNOWN;
+    }
+    blend = depthTest = cullFace = -1;
+    blendSource = blendDestination = depthFunction = cullFaceMode = UNKNOWN;
+}
+
+GLStateStats GLState::takeStats()
+{
+    GLStateStats taken = stats;
+    stats = GLStateStats();
+    return taken;
+}
@@ -0,0 +1,164 @@
+#include <rg/glextensions.hpp>
+#include <rg/gpuculling.hpp>
+
+#include <algorithm>
+#include <string>
+
+namespace
+{
+// invocations of a work group, local_size_x of gpu_culling.cs
+const unsigned int CULLING_GROUP_SIZE = 64;
+// the passes of gpu_culling.cs: cull and count per instance, lay out the levels per mesh, write per instance
+const int PASS_CULL = 0;
+const int PASS_OFFSETS = 1;
+const int PASS_WRITE = 2;
+} // namespace
+
+GpuCuller::GpuCuller()
+{
+    // the size of the occlusion buffer is the shader's to know as well
+    std::vector<std::string> defines = {"OCCLUSION_WIDTH " + std::to_string(OcclusionCuller::WIDTH),
+                                        "OCCLUSION_HEIGHT " + std::to_string(OcclusionCuller::HEIGHT),
+                                        "OCCLUSION_BLOCK_SIZE " + std::to_string(OcclusionCuller::BLOCK_SIZE)};
+    cullShader.reset(new Shader("resources/shaders/gpu_culling.cs", defines));
+    glGenBuffers(BINDING_COUNT, buffers);
+    // every binding the shader declares has a buffer, even the occlusion ones of frames without occlusion culling
+    for (int binding = 0; binding < BINDING_COUNT; binding++)
+        upload(static_cast<Binding>(binding), nullptr, 0);
+}
+
+GpuCuller::~GpuCuller()
+{
+    glDeleteBuffers(BINDING_COUNT, buffers);
+}
+
+bool GpuCuller::isSupported()
+{
+    return glExtensions.hasGpuCulling;
+}
+
+void GpuCuller::upload(Binding binding, const void *data, size_t size)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[binding]);
+    // a new store every time, draws that still read the old one don't stall the upload
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_STREAM_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffers[binding]);
+}
+
+void GpuCuller::reserve(Binding binding, size_t size)
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[binding]);
+    if (size > capacities[binding])
+    {
+        capacities[binding] = std::max(size, capacities[binding] * 2);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, capacities[binding], nullptr, GL_DYNAMIC_COPY);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffers[binding]);
+}
+
+void GpuCuller::dispatch(int pass, unsigned int count)
+{
+    cullShader->setInt("cullPass", pass);
+    glExtensions.dispatchCompute((count + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE, 1, 1);
+    glExtensions.memoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    stats.dispatches++;
+}
+
+void GpuCuller::begin(const glm::mat4 &viewProjection, const LodSelector &selector, const OcclusionCuller *occlusion)
+{
+    this->viewProjection = viewProjection;
+    cameraPosition = selector.getCameraPosition();
+    projectionScale = selector.getProjectionScale();
+    lodThreshold = selector.enabled ? selector.pixelThreshold : -1.0f;
+    this->occlusion = occlusion != nullptr;
+    if (occlusion)
+    {
+        upload(OCCLUSION_DEPTH, occlusion->getDepth().data(), occlusion->getDepth().size() * sizeof(float));
+        upload(OCCLUSION_HIZ, occlusion->getHiZ().data(), occlusion->getHiZ().size() * sizeof(float));
+    }
+}
+
+void GpuCuller::draw(Shader &shader, std::vector<Mesh> &meshes, const std::vector<glm::mat4> &models)
+{
+    if (models.empty() || meshes.empty())
+        return;
+
+    // one command per level of every mesh, all of them starting at the mesh's range of the visible matrices until
+    // the shader lays the levels out in it. The tables are rebuilt every draw, that's as much work as there are meshes
+    // and keeps them right for whichever meshes come in.
+    meshInfos.clear();
+    levelErrors.clear();
+    commands.clear();
+    placements.clear();
+    const GLuint instanceCount = static_cast<GLuint>(models.size());
+    GLuint visibleCount = 0;
+    for (const Mesh &mesh : meshes)
+    {
+        // shared meshes are ranges of the GeometryBuffer, the others start at the beginning of their own buffers
+        GeometryAllocation allocation = mesh.isShared() ? mesh.getAllocation() : GeometryAllocation();
+        MeshInfo info;
+        info.boxMin = glm::vec4(mesh.getBoundingBoxMin(), 0.0f);
+        info.boxMax = glm::vec4(mesh.getBoundingBoxMax(), 0.0f);
+        info.sphere = glm::vec4(mesh.getBoundingCenter(), mesh.getBoundingRadius());
+        info.firstCommand = static_cast<uint32_t>(commands.size());
+        info.levelCount = mesh.getLodCount();
+        info.firstPlacement = static_cast<uint32_t>(placements.size());
+        info.placementCount = mesh.getPlacementCount();
+        meshInfos.push_back(info);
+        for (unsigned int p = 0; p < mesh.getPlacementCount(); p++)
+            placements.push_back(mesh.getPlacement(p));
+        for (unsigned int lod = 0; lod < mesh.getLodCount(); lod++)
+        {
+            const MeshLod &level = mesh.getLod(lod);
+            DrawElementsIndirectCommand command;
+            command.count = level.indexCount;
+            command.instanceCount = 0;
+            command.firstIndex = allocation.firstIndex + level.indexOffset;
+            command.baseVertex = static_cast<GLint>(allocation.baseVertex);
+            command.baseInstance = visibleCount;
+            commands.push_back(command);
+            levelErrors.push_back(level.error);
+        }
+        visibleCount += instanceCount * info.placementCount;
+    }
+
+    upload(INSTANCES, models.data(), models.size() * sizeof(glm::mat4));
+    upload(MESHES, meshInfos.data(), meshInfos.size() * sizeof(MeshInfo));
+    upload(LEVEL_ERRORS, levelErrors.data(), levelErrors.size() * sizeof(float));
+    upload(COMMANDS, commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand));
+    upload(PLACEMENTS, placements.data(), placements.size() * sizeof(glm::mat4));
+    reserve(VISIBLE, visibleCount * sizeof(InstanceData));
+    reserve(COPY_LEVELS, visibleCount * sizeof(GLuint));
+
+    cullShader->use();
+    cullShader->setMat4("viewProjection", viewProjection);
+    cullShader->setVec3("cameraPosition", cameraPosition);
+    cullShader->setFloat("projectionScale", projectionScale);
+    cullShader->setFloat("lodThreshold", lodThreshold);
+    cullShader->setInt("instanceCount", static_cast<int>(models.size()));
+    cullShader->setInt("meshCount", static_cast<int>(meshes.size()));
+    cullShader->setBool("occlusion", occlusion);
+    dispatch(PASS_CULL, instanceCount);
+    dispatch(PASS_OFFSETS, static_cast<unsigned int>(meshes.size()));
+    dispatch(PASS_WRITE, instanceCount);
+    // the draws read the commands and the matrices the shader wrote
+    glExtensions.memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    stats.instances += instanceCount;
+
+    shader.use();
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers[COMMANDS]);
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const void *indirect = (void *)(meshInfos[i].firstCommand * sizeof(DrawElementsIndirectCommand));
+        meshes[i].DrawIndirect(shader, buffers[VISIBLE], indirect, meshInfos[i].levelCount);
+        stats.drawCalls++;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+GpuCullingStats GpuCuller::takeStats()
+{
+    GpuCullingStats taken = stats;
+    stats = GpuCullingStats();
+    return taken;
+}
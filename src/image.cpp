@@ -0,0 +1,200 @@
+#include <rg/filesystem.hpp>
+#include <rg/glstate.hpp>
+#include <rg/image.hpp>
+#include <rg/threadpool.hpp>
+
+#include <stb_image.h>
+
+#include <atomic>
+#include <iostream>
+
+namespace
+{
+std::atomic<bool> cookedTexturesEnabled(true);
+
+int getComponentCount(GLenum baseInternalFormat)
+{
+    switch (baseInternalFormat)
+    {
+    case GL_RED:
+        return 1;
+    case GL_RG:
+        return 2;
+    case GL_RGBA:
+        return 4;
+    default:
+        return 3;
+    }
+}
+
+// uploads every level and face of a cooked image into the bound texture, the image says how many mipmaps it has
+void uploadCompressed(GLenum target, const Image &image)
+{
+    const KtxTexture &cooked = image.cooked;
+    for (unsigned int level = 0; level < cooked.levels.size(); level++)
+    {
+        const KtxLevel &entry = cooked.levels[level];
+        for (unsigned int face = 0; face < cooked.faces; face++)
+        {
+            GLenum faceTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : target;
+            glCompressedTexImage2D(faceTarget, level, cooked.internalFormat, entry.width, entry.height, 0,
+                                   static_cast<GLsizei>(entry.faceSize), cooked.getFace(level, face));
+        }
+    }
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(cooked.levels.size()) - 1);
+}
+} // namespace
+
+Image::~Image()
+{
+    if (data)
+        stbi_image_free(data);
+}
+
+GLenum Image::getFormat() const
+{
+    if (isCooked())
+        return cooked.baseInternalFormat;
+    if (components == 1)
+        return GL_RED;
+    else if (components == 4)
+        return GL_RGBA;
+    return GL_RGB;
+}
+
+void setCookedTexturesEnabled(bool enabled)
+{
+    cookedTexturesEnabled = enabled;
+}
+
+bool isCookedTexturesEnabled()
+{
+    return cookedTexturesEnabled;
+}
+
+std::string getCookedTexturePath(const std::string &path)
+{
+    return path + ".ktx";
+}
+
+std::string getCookedCubemapPath(const std::vector<std::string> &faces)
+{
+    const std::string &first = faces.front();
+    size_t slash = first.find_last_of('/');
+    return (slash == std::string::npos ? std::string(".") : first.substr(0, slash)) + "/cubemap.ktx";
+}
+
+bool hasCookedTexture(const std::string &cookedPath, const std::vector<std::string> &sources)
+{
+    FileInfo cookedInfo;
+    if (!FileSystem::getFileInfo(cookedPath, cookedInfo))
+        return false;
+    // a source that doesn't exist (anymore) doesn't make the cooked file stale, the cooked file is all there is
+    for (const std::string &source : sources)
+    {
+        FileInfo sourceInfo;
+        if (FileSystem::getFileInfo(source, sourceInfo) && sourceInfo.modified > cookedInfo.modified)
+            return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const Image> loadCookedImage(const std::string &cookedPath)
+{
+    std::shared_ptr<Image> image = std::make_shared<Image>();
+    image->path = cookedPath;
+    if (readKtx(cookedPath, image->cooked))
+    {
+        image->width = static_cast<int>(image->cooked.width);
+        image->height = static_cast<int>(image->cooked.height);
+        image->components = getComponentCount(image->cooked.baseInternalFormat);
+    }
+    return image;
+}
+
+std::shared_ptr<const Image> loadImage(const std::string &path)
+{
+    std::string cookedPath = getCookedTexturePath(path);
+    if (cookedTexturesEnabled && hasCookedTexture(cookedPath, {path}))
+    {
+        std::shared_ptr<const Image> cooked = loadCookedImage(cookedPath);
+        if (cooked->isValid())
+            return cooked;
+    }
+
+    // stb_image is reentrant as long as nobody changes the global flags (e.g. stbi_set_flip_vertically_on_load)
+    // while decodes are in flight
+    std::shared_ptr<Image> image = std::make_shared<Image>();
+    image->path = path;
+    FileView file = FileSystem::readFile(path);
+    if (file.isValid())
+        image->data = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &image->width, &image->height,
+                                            &image->components, 0);
+    return image;
+}
+
+ImageFuture loadImageAsync(const std::string &path)
+{
+    return ThreadPool::global().submit([path]() { return loadImage(path); }).share();
+}
+
+void uploadTexture(unsigned int textureID, const Image &image)
+{
+    if (!image.isValid())
+    {
+        std::cout << "Texture failed to load at path: " << image.path << std::endl;
+        return;
+    }
+
+    GLState::global().bindTexture(GL_TEXTURE_2D, textureID);
+    if (image.isCooked())
+        uploadCompressed(GL_TEXTURE_2D, image);
+    else
+    {
+        GLenum format = image.getFormat();
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void uploadCubemap(unsigned int textureID, const std::vector<ImageFuture> &faces)
+{
+    GLState::global().bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    for (unsigned int i = 0; i < faces.size(); i++)
+    {
+        std::shared_ptr<const Image> face = faces[i].get();
+        if (face->data)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, face->width, face->height, 0, GL_RGB,
+                         GL_UNSIGNED_BYTE, face->data);
+        else
+            std::cout << "Cubemap texture failed to load at path: " << face->path << std::endl;
+    }
+    setCubemapParameters(false);
+}
+
+void uploadCubemap(unsigned int textureID, const Image &cooked)
+{
+    if (!cooked.isCooked() || cooked.cooked.faces != 6)
+    {
+        std::cout << "Cubemap texture failed to load at path: " << cooked.path << std::endl;
+        return;
+    }
+    GLState::global().bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    uploadCompressed(GL_TEXTURE_CUBE_MAP, cooked);
+    setCubemapParameters(cooked.cooked.levels.size() > 1);
+}
+
+void setCubemapParameters(bool mipmaps)
+{
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
@@ -0,0 +1,71 @@
+#include <rg/instancebuffer.hpp>
+
+#include <algorithm>
+#include <cstddef>
+
+InstanceBuffer::~InstanceBuffer()
+{
+    glDeleteBuffers(1, &buffer);
+}
+
+void InstanceBuffer::begin()
+{
+    matrices.clear();
+    if (buffer != 0)
+    {
+        // orphaned, draws of the last frame that still read the old storage don't stall the upload
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+    }
+}
+
+unsigned int InstanceBuffer::append(const glm::mat4 *data, size_t count)
+{
+    unsigned int first = static_cast<unsigned int>(matrices.size());
+    for (size_t i = 0; i < count; i++)
+        matrices.push_back(InstanceData(data[i]));
+    if (buffer == 0)
+        glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (matrices.size() > capacity)
+    {
+        // a new store, earlier draws of the frame keep the old one and the new one gets all matrices
+        capacity = std::max<size_t>(matrices.size(), capacity * 2);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, matrices.size() * sizeof(InstanceData), matrices.data());
+    }
+    else
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(InstanceData), count * sizeof(InstanceData),
+                        matrices.data() + first);
+    }
+    return first;
+}
+
+void InstanceBuffer::bindAttributes(unsigned int first) const
+{
+    bindAttributes(buffer, first);
+}
+
+void InstanceBuffer::bindAttributes(GLuint buffer, unsigned int first)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int column = 0; column < 4; column++)
+    {
+        GLuint location = INSTANCE_MATRIX_LOCATION + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void *)(first * sizeof(InstanceData) + column * sizeof(glm::vec4)));
+        // one matrix per instance instead of per vertex
+        glVertexAttribDivisor(location, 1);
+    }
+    for (unsigned int column = 0; column < 3; column++)
+    {
+        GLuint location = INSTANCE_NORMAL_MATRIX_LOCATION + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                              (void *)(first * sizeof(InstanceData) + offsetof(InstanceData, normalMatrix) +
+                                       column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+}
@@ -0,0 +1,150 @@
+#include <rg/filesystem.hpp>
+#include <rg/ktx.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+const unsigned char KTX_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+const uint32_t KTX_ENDIANNESS = 0x04030201;
+
+struct KtxHeader
+{
+    unsigned char identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+size_t alignTo4(size_t size)
+{
+    return (size + 3) & ~size_t(3);
+}
+
+bool fail(const std::string &name, const char *reason)
+{
+    std::cout << "ERROR::KTX:: " << name << ": " << reason << std::endl;
+    return false;
+}
+} // namespace
+
+bool parseKtx(const unsigned char *bytes, size_t size, KtxTexture &texture, const std::string &name)
+{
+    KtxHeader header;
+    if (size < sizeof(header))
+        return fail(name, "file too small");
+    std::memcpy(&header, bytes, sizeof(header));
+    if (std::memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0)
+        return fail(name, "not a KTX 1.1 file");
+    if (header.endianness != KTX_ENDIANNESS)
+        return fail(name, "byte swapped files are not supported");
+    if (header.glType != 0 || header.glFormat != 0)
+        return fail(name, "only compressed formats are supported");
+    if (header.pixelDepth > 1 || header.numberOfArrayElements > 0 ||
+        (header.numberOfFaces != 1 && header.numberOfFaces != 6) || header.pixelWidth == 0 || header.pixelHeight == 0)
+        return fail(name, "only 2D textures and cubemaps are supported");
+
+    texture.internalFormat = header.glInternalFormat;
+    texture.baseInternalFormat = header.glBaseInternalFormat;
+    texture.width = header.pixelWidth;
+    texture.height = header.pixelHeight;
+    texture.faces = header.numberOfFaces;
+    texture.levels.clear();
+    texture.data.clear();
+
+    // 0 levels means the loader should generate them, there is nothing to generate them from for compressed data
+    unsigned int levelCount = header.numberOfMipmapLevels > 0 ? header.numberOfMipmapLevels : 1;
+    size_t offset = sizeof(header) + header.bytesOfKeyValueData;
+    for (unsigned int level = 0; level < levelCount; level++)
+    {
+        uint32_t faceSize;
+        if (offset + sizeof(faceSize) > size)
+            return fail(name, "truncated");
+        std::memcpy(&faceSize, bytes + offset, sizeof(faceSize));
+        offset += sizeof(faceSize);
+
+        KtxLevel entry;
+        entry.width = std::max(1u, texture.width >> level);
+        entry.height = std::max(1u, texture.height >> level);
+        entry.faceSize = faceSize;
+        entry.offset = texture.data.size();
+        for (unsigned int face = 0; face < texture.faces; face++)
+        {
+            if (offset + faceSize > size)
+                return fail(name, "truncated");
+            texture.data.insert(texture.data.end(), bytes + offset, bytes + offset + faceSize);
+            // cube faces are padded to 4 bytes, so are whole levels
+            offset += alignTo4(faceSize);
+        }
+        offset = alignTo4(offset);
+        texture.levels.push_back(entry);
+    }
+    return true;
+}
+
+bool readKtx(const std::string &path, KtxTexture &texture)
+{
+    FileView file = FileSystem::readFile(path);
+    if (!file.isValid())
+        return false;
+    return parseKtx(file.data(), file.size(), texture, path);
+}
+
+bool writeKtx(const std::string &path, const KtxTexture &texture)
+{
+    KtxHeader header;
+    std::memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.endianness = KTX_ENDIANNESS;
+    header.glType = 0;
+    header.glTypeSize = 1;
+    header.glFormat = 0;
+    header.glInternalFormat = texture.internalFormat;
+    header.glBaseInternalFormat = texture.baseInternalFormat;
+    header.pixelWidth = texture.width;
+    header.pixelHeight = texture.height;
+    header.pixelDepth = 0;
+    header.numberOfArrayElements = 0;
+    header.numberOfFaces = texture.faces;
+    header.numberOfMipmapLevels = static_cast<uint32_t>(texture.levels.size());
+    header.bytesOfKeyValueData = 0;
+
+    // same procedure as the mesh cache: write to a temporary file and rename it into place
+    std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    static const char zeros[4] = {};
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (unsigned int level = 0; level < texture.levels.size(); level++)
+    {
+        uint32_t faceSize = static_cast<uint32_t>(texture.levels[level].faceSize);
+        out.write(reinterpret_cast<const char *>(&faceSize), sizeof(faceSize));
+        for (unsigned int face = 0; face < texture.faces; face++)
+        {
+            out.write(reinterpret_cast<const char *>(texture.getFace(level, face)), faceSize);
+            out.write(zeros, alignTo4(faceSize) - faceSize);
+        }
+    }
+    out.close();
+    if (!out)
+    {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
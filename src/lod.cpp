@@ -0,0 +1,58 @@
+#include <rg/lod.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+void LodSelector::update(const Camera &camera, float viewportHeight)
+{
+    cameraPosition = camera.Position;
+    projectionScale = viewportHeight / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f));
+}
+
+float LodSelector::getScreenError(const Mesh &mesh, const glm::mat4 &model, unsigned int lod) const
+{
+    return mesh.getLod(lod).error * getErrorScale(mesh, model);
+}
+
+float LodSelector::getErrorScale(const Mesh &mesh, const glm::mat4 &model) const
+{
+    // the largest axis scale bounds how much the model matrix can stretch the error
+    float scale = std::max(glm::length(glm::vec3(model[0])),
+                           std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    glm::vec3 center = glm::vec3(model * glm::vec4(mesh.getBoundingCenter(), 1.0f));
+    // distance to the nearest point of the bounding sphere, meshes the camera is inside of count as very close
+    float distance = glm::length(center - cameraPosition) - mesh.getBoundingRadius() * scale;
+    distance = std::max(distance, 0.1f);
+    return scale * projectionScale / distance;
+}
+
+unsigned int LodSelector::select(const Mesh &mesh, const glm::mat4 &model, unsigned int current) const
+{
+    if (!enabled)
+        return 0;
+    unsigned int lod = std::min(current, mesh.getLodCount() - 1);
+    while (lod > 0 && getScreenError(mesh, model, lod) > pixelThreshold)
+        lod--;
+    while (lod + 1 < mesh.getLodCount() &&
+           getScreenError(mesh, model, lod + 1) <= pixelThreshold * (1.0f - hysteresis))
+        lod++;
+    return lod;
+}
+
+unsigned int LodSelector::select(const Mesh &mesh, const glm::mat4 *models, size_t count, unsigned int current) const
+{
+    if (!enabled || count == 0)
+        return 0;
+    size_t nearest = 0;
+    float largest = getErrorScale(mesh, models[0]);
+    for (size_t i = 1; i < count; i++)
+    {
+        float scale = getErrorScale(mesh, models[i]);
+        if (scale > largest)
+        {
+            largest = scale;
+            nearest = i;
+        }
+    }
+    return select(mesh, models[nearest], current);
+}
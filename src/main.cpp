@@ -5,9 +5,11 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <cmath>
+#include <cstdlib>
 
 #include <rg/error.hpp>
 
@@ -15,11 +17,25 @@
 
 #include <rg/camera.hpp>
 #include <rg/shader.hpp>
+#include <rg/uniformbuffer.hpp>
 #include <rg/filesystem.hpp>
+#include <rg/assetregistry.hpp>
+#include <rg/assetstreamer.hpp>
+#include <rg/benchmark.hpp>
+#include <rg/bvh.hpp>
+#include <rg/geometrybuffer.hpp>
+#include <rg/glextensions.hpp>
+#include <rg/glstate.hpp>
+#include <rg/gpuculling.hpp>
+#include <rg/image.hpp>
+#include <rg/instancebuffer.hpp>
 #include <rg/mesh.hpp>
 #include <rg/model.hpp>
+#include <rg/occlusion.hpp>
 #include <rg/pointlight.hpp>
+#include <rg/programcache.hpp>
 #include <rg/programstate.hpp>
+#include <rg/renderqueue.hpp>
 
 #include <stb_image.h>
 
@@ -29,8 +45,6 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void proccess_input(GLFWwindow *window);
 void draw_imgui();
-unsigned int loadTexture(const char *path);
-unsigned int loadCubemap(std::vector<std::string> faces);
 void renderQuad();
 
 // window
@@ -50,12 +64,23 @@ float lastFrame = 0.f;
 bool hdrKeyPressed = false;
 
 ProgramState *programState;
+AssetStreamer *assetStreamer;
+// helicopter instances, queried for the ones in the frustum
+SceneBvh *sceneBvh;
 
-int main()
+int main(int argc, char **argv)
 {
+    // a packed build ships resources.rgpack (see pack_builder), RG_LOOSE_FILES=1 lets the files on disk override it
+    if (FileSystem::mountPack(FileSystem::getPath("resources.rgpack")))
+    {
+        const char *looseFiles = std::getenv("RG_LOOSE_FILES");
+        FileSystem::setLooseFilesFirst(looseFiles && std::string(looseFiles) == "1");
+    }
+
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    // a 4.5 context lets the helicopters be culled on the GPU (GpuCuller), everything else only needs 3.3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
@@ -63,6 +88,12 @@ int main()
 #endif
 
     GLFWwindow *window = glfwCreateWindow(WinWidth, WinHeight, "RG Project", nullptr, nullptr);
+    if (window == nullptr)
+    {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(WinWidth, WinHeight, "RG Project", nullptr, nullptr);
+    }
 
     ASSERT(nullptr != window, "Failed to create window.");
 
@@ -74,13 +105,32 @@ int main()
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     ASSERT(gladLoadGLLoader((GLADloadproc)glfwGetProcAddress), "Failed to initialize GLAD.");
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+    ProgramCache::setDirectory(FileSystem::getPath("shader_cache"));
+    // let the driver use as many threads as it likes for the programs below
+    if (glExtensions.hasParallelShaderCompile)
+        glExtensions.maxShaderCompilerThreads(0xFFFFFFFF);
     // stbi_set_flip_vertically_on_load(true);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // textures cooked by texture_cooker are S3TC/RGTC compressed, without S3TC support the sources are loaded instead
+    setCookedTexturesEnabled(hasGLExtension("GL_EXT_texture_compression_s3tc"));
+
+    // all binds and toggles of the render loop go through the state cache, it drops the redundant ones
+    GLState &glState = GLState::global();
+    glState.setBlend(true);
+    glState.setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     glFrontFace(GL_CW);
 
+    // "--benchmark [copies]" compares the frame time and memory of the full and compact vertex formats, then exits
+    if (argc > 1 && std::string(argv[1]) == "--benchmark")
+    {
+        int copies = argc > 2 ? std::atoi(argv[2]) : 64;
+        runVertexFormatBenchmark("resources/objects/ah64d/ah64d.obj", copies, 200);
+        glfwTerminate();
+        return 0;
+    }
+
     programState = new ProgramState();
     programState->loadFromFile("resources/program_state.txt");
     if (programState->imguiEnabled)
@@ -97,13 +147,31 @@ int main()
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 330 core");
 
-    glEnable(GL_DEPTH_TEST);
-
-    Shader *shader = new Shader("resources/shaders/vertex_shader.vs", "resources/shaders/fragment_shader.fs");
-    Shader *skyboxShader = new Shader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
-    Shader *textureShader = new Shader("resources/shaders/plate.vs", "resources/shaders/plate.fs");
-    Shader *transparentShader = new Shader("resources/shaders/plate.vs", "resources/shaders/plate.fs");
-    Shader *hdrShader = new Shader("resources/shaders/hdr.vs", "resources/shaders/hdr.fs");
+    glState.setDepthTest(true);
+
+    // assets are shared through the registry. The helicopters and the glass panes are drawn instanced, their
+    // programs read the model matrices from the instance attributes.
+    AssetRegistry &assets = AssetRegistry::global();
+    GeometryBuffer::setEnabled(programState->sharedGeometry);
+    VertexFormat vertexFormat = programState->compactVertices ? VertexFormat::Compact : VertexFormat::Full;
+    auto getInstancedDefines = [](VertexFormat format) {
+        std::vector<std::string> defines = getVertexFormatDefines(format);
+        defines.push_back(INSTANCED_DEFINE);
+        return defines;
+    };
+    std::shared_ptr<Shader> shader = assets.getShader("resources/shaders/vertex_shader.vs",
+                                                      "resources/shaders/fragment_shader.fs", nullptr,
+                                                      getInstancedDefines(vertexFormat));
+    std::shared_ptr<Shader> skyboxShader =
+        assets.getShader("resources/shaders/skybox.vs", "resources/shaders/skybox.fs");
+    std::shared_ptr<Shader> textureShader =
+        assets.getShader("resources/shaders/plate.vs", "resources/shaders/plate.fs");
+    std::shared_ptr<Shader> transparentShader =
+        assets.getShader("resources/shaders/plate.vs", "resources/shaders/plate.fs", nullptr,
+                         std::vector<std::string>{INSTANCED_DEFINE});
+    std::shared_ptr<Shader> hdrShader = assets.getShader("resources/shaders/hdr.vs", "resources/shaders/hdr.fs");
+    // the programs build while the buffers are set up and the assets start loading, they're first used below
+    ShaderBatch shaders({shader, skyboxShader, textureShader, transparentShader, hdrShader});
 
     float skyboxVertices[] = {-1.0f, 1.0f,  -1.0f, -1.0f, -1.0f, -1.0f, 1.0f,  -1.0f, -1.0f,
                               1.0f,  -1.0f, -1.0f, 1.0f,  1.0f,  -1.0f, -1.0f, 1.0f,  -1.0f,
@@ -130,7 +198,7 @@ int main()
     // create floating point color buffer
     unsigned int colorBuffer;
     glGenTextures(1, &colorBuffer);
-    glBindTexture(GL_TEXTURE_2D, colorBuffer);
+    glState.bindTexture(GL_TEXTURE_2D, colorBuffer);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, WinWidth, WinHeight, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -151,12 +219,17 @@ int main()
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
+    glState.bindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
 
+    // none of the loads block: decoding and importing run on worker threads and the uploads are spread over the
+    // first frames (assetStreamer->update()), placeholders are drawn until then
+    assetStreamer = new AssetStreamer(programState->uploadBudgetKB * 1024);
+    assets.setStreamer(assetStreamer);
+
     // +X (right)
     // -X (left)
     // +Y (top)
@@ -169,12 +242,10 @@ int main()
                                    FileSystem::getPath("resources/textures/skybox/negy.jpg"),
                                    FileSystem::getPath("resources/textures/skybox/posz.jpg"),
                                    FileSystem::getPath("resources/textures/skybox/negz.jpg")};
-    unsigned int cubemapTexture = loadCubemap(faces);
-    skyboxShader->use();
-    skyboxShader->setInt("skybox", 0);
+    std::shared_ptr<TextureObject> cubemapTexture = assets.getCubemap(faces);
 
-    Model helicopter("resources/objects/ah64d/ah64d.obj");
-    helicopter.SetShaderTextureNamePrefix("material.");
+    std::shared_ptr<Model> helicopter = assets.getModel("resources/objects/ah64d/ah64d.obj", false, vertexFormat);
+    helicopter->SetShaderTextureNamePrefix("material.");
 
     PointLight &pointLight = programState->pointLight;
     pointLight.position = glm::vec3(4.0, 4.0, 0.0);
@@ -210,35 +281,32 @@ int main()
         {glm::vec3(0.f, 21.f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f)},
     };
 
-    unsigned int VBO, VAO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(plate_vertices), plate_vertices, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(plate_indices), plate_indices, GL_STATIC_DRAW);
-
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    // color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // texture coord attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    // the plate and the glass panes are the same quad. plate.vs reads the second attribute as its normal, which
+    // holds the colors here as it always did.
+    auto createQuad = [&plate_vertices, &plate_indices]() {
+        std::vector<Vertex> vertices(4);
+        for (unsigned int i = 0; i < vertices.size(); i++)
+        {
+            const float *v = plate_vertices + i * 8;
+            vertices[i].Position = glm::vec3(v[0], v[1], v[2]);
+            vertices[i].Normal = glm::vec3(v[3], v[4], v[5]);
+            vertices[i].TexCoords = glm::vec2(v[6], v[7]);
+            vertices[i].Tangent = vertices[i].Bitangent = glm::vec3(0.0f);
+        }
+        std::vector<unsigned int> indices(plate_indices, plate_indices + 6);
+        return std::unique_ptr<Mesh>(new Mesh(std::move(vertices), std::move(indices), std::vector<Texture>()));
+    };
+    std::unique_ptr<Mesh> quad = createQuad();
 
-    unsigned int plate_texture = loadTexture("resources/textures/concrete.jpg");
-    unsigned int transparent_texture = loadTexture("resources/textures/binding-dark.png");
+    std::shared_ptr<TextureObject> plate_texture = assets.getTexture("resources/textures/concrete.jpg");
+    std::shared_ptr<TextureObject> transparent_texture = assets.getTexture("resources/textures/binding-dark.png");
 
     // draw in wireframe
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+    shaders.finish();
+    skyboxShader->use();
+    skyboxShader->setInt("skybox", 0);
     textureShader->use();
     textureShader->setInt("texture_sampler", 0);
     transparentShader->use();
@@ -247,111 +315,256 @@ int main()
     hdrShader->use();
     hdrShader->setInt("hdrBuffer", 0);
 
+    // the quad has no textures of its own, the packets bind these on top of it
+    Material plateMaterial(
+        std::vector<Texture>{Texture{plate_texture, TextureType::Diffuse, "resources/textures/concrete.jpg"}});
+    Material glassMaterial(std::vector<Texture>{
+        Texture{transparent_texture, TextureType::Diffuse, "resources/textures/binding-dark.png"}});
+    // draws of the frame, sorted before they are executed
+    RenderQueue renderQueue;
+    renderQueue.frontFace = GL_CW;
+    // model matrices of the instanced draws, refilled every frame
+    std::unique_ptr<InstanceBuffer> instances(new InstanceBuffer());
+    std::vector<glm::mat4> helicopterModels;
+    std::vector<glm::mat4> visibleHelicopters;
+    std::vector<unsigned int> visibleItems;
+    sceneBvh = new SceneBvh();
+    // the nearest helicopters and the plate hide the helicopters behind them
+    OcclusionCuller occlusionCuller;
+    const unsigned int helicopterOccluders = 8;
+    std::vector<unsigned int> occluderItems;
+    std::vector<glm::mat4> glassModels;
+    // on GL 4.3 and up all helicopters go to the GPU, which culls them and picks their levels
+    std::unique_ptr<GpuCuller> gpuCuller;
+    if (GpuCuller::isSupported())
+        gpuCuller.reset(new GpuCuller());
+
+    // camera and lights are written once per frame for all programs
+    std::unique_ptr<UniformBuffer> cameraBuffer(new UniformBuffer(CAMERA_BLOCK_BINDING, sizeof(CameraBlock)));
+    std::unique_ptr<UniformBuffer> lightsBuffer(new UniformBuffer(LIGHTS_BLOCK_BINDING, sizeof(LightsBlock)));
+
     while (!glfwWindowShouldClose(window))
     {
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        programState->uniformStats = Shader::takeUniformStats();
+        programState->glStateStats = glState.takeStats();
+        programState->renderQueueStats = renderQueue.takeStats();
+        programState->occlusionStats = occlusionCuller.takeStats();
+        if (gpuCuller)
+            programState->gpuCullingStats = gpuCuller->takeStats();
 
         proccess_input(window);
 
+        assetStreamer->setUploadBudget(programState->uploadBudgetKB * 1024);
+        assetStreamer->update();
+
+        // switching the vertex format or the megabuffer mode loads the model again, the registry frees the old one
+        // with its last handle
+        GeometryBuffer::setEnabled(programState->sharedGeometry);
+        vertexFormat = programState->compactVertices ? VertexFormat::Compact : VertexFormat::Full;
+        if (vertexFormat != helicopter->vertexFormat || programState->sharedGeometry != helicopter->sharedGeometry)
+        {
+            helicopter = assets.getModel("resources/objects/ah64d/ah64d.obj", false, vertexFormat);
+            helicopter->SetShaderTextureNamePrefix("material.");
+            shader = assets.getShader("resources/shaders/vertex_shader.vs", "resources/shaders/fragment_shader.fs",
+                                      nullptr, getInstancedDefines(vertexFormat));
+        }
+        if (programState->sharedGeometry != quad->isShared())
+            quad = createQuad();
+
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         glClearColor(programState->backgroundColor.r, programState->backgroundColor.g, programState->backgroundColor.b,
                      1.f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_FRONT);
-
-        shader->use();
-        // pointLight.position = glm::vec3(4.0 * cos(currentFrame), 4.0f, 4.0 * sin(currentFrame));
-        shader->setVec3("pointLight.position", pointLight.position);
-        shader->setVec3("pointLight.ambient", pointLight.ambient);
-        shader->setVec3("pointLight.diffuse", pointLight.diffuse);
-        shader->setVec3("pointLight.specular", pointLight.specular);
-        shader->setFloat("pointLight.constant", pointLight.constant);
-        shader->setFloat("pointLight.linear", pointLight.linear);
-        shader->setFloat("pointLight.quadratic", pointLight.quadratic);
-        shader->setVec3("viewPosition", programState->camera.Position);
-        shader->setFloat("material.shininess", 32.f);
         glm::mat4 projection =
             glm::perspective(glm::radians(programState->camera.Zoom), (float)WinWidth / (float)WinHeight, 0.1f, 100.0f);
         glm::mat4 view = programState->camera.GetViewMatrix();
-        shader->setMat4("projection", projection);
-        shader->setMat4("view", view);
+        CameraBlock camera = CameraBlock();
+        camera.projection = projection;
+        camera.view = view;
+        camera.viewPosition = programState->camera.Position;
+        cameraBuffer->update(camera);
+
+        // pointLight.position = glm::vec3(4.0 * cos(currentFrame), 4.0f, 4.0 * sin(currentFrame));
+        LightsBlock lights = LightsBlock();
+        lights.pointLight.position = pointLight.position;
+        lights.pointLight.ambient = pointLight.ambient;
+        lights.pointLight.diffuse = pointLight.diffuse;
+        lights.pointLight.specular = pointLight.specular;
+        lights.pointLight.constant = pointLight.constant;
+        lights.pointLight.linear = pointLight.linear;
+        lights.pointLight.quadratic = pointLight.quadratic;
+        // the plate's light goes around it, the glass is lit from a fixed direction
+        lights.dirLights[DIR_LIGHT_PLATE].direction =
+            glm::vec3(10.0 * cos(currentFrame), 10.0f, 10.0 * sin(currentFrame));
+        lights.dirLights[DIR_LIGHT_GLASS].direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+        for (DirLightBlock &dirLight : lights.dirLights)
+        {
+            dirLight.ambient = pointLight.ambient;
+            dirLight.diffuse = pointLight.diffuse * 5.0f;
+            dirLight.specular = pointLight.specular;
+        }
+        lightsBuffer->update(lights);
+
+        // values every draw of a program shares are set once, the packets only set what differs between them
+        shader->use();
+        shader->setFloat("material.shininess", 32.f);
+        textureShader->use();
+        textureShader->setBool("blinn", programState->blinn);
+        textureShader->setFloat("material.shininess", 32.0f);
+        transparentShader->use();
+        transparentShader->setBool("blinn", programState->blinn);
+        transparentShader->setFloat("material.shininess", 32.0f);
 
         // 1. render scene into floating point framebuffer
         // -----------------------------------------------
         glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+        renderQueue.begin(view, projection);
+        renderQueue.meshletCulling = programState->meshletCulling;
+        instances->begin();
+
+        // the helicopters stand in a square grid, the first one at the object position
+        const float helicopterSpacing = 30.0f;
+        int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(programState->helicopterCount))));
+        helicopterModels.clear();
+        for (int i = 0; i < programState->helicopterCount; i++)
+        {
+            glm::vec3 offset = glm::vec3(i % columns, 0.0f, i / columns) * helicopterSpacing;
+            glm::mat4 model = glm::mat4(1.f);
+            model = glm::translate(model, programState->objectPosition + offset * programState->objectScale);
+            model = glm::scale(model, glm::vec3(programState->objectScale));
+            helicopterModels.push_back(model);
+        }
+        // a different count adds the items anew, moved helicopters only refit the tree
+        BoundingBox helicopterBox = helicopter->getBoundingBox();
+        if (sceneBvh->getItemCount() != helicopterModels.size())
+        {
+            sceneBvh->clear();
+            for (const glm::mat4 &helicopterModel : helicopterModels)
+                sceneBvh->addItem(helicopterBox.transformed(helicopterModel));
+        }
+        for (unsigned int i = 0; i < helicopterModels.size(); i++)
+        {
+            BoundingBox box = helicopterBox.transformed(helicopterModels[i]);
+            const BoundingBox &current = sceneBvh->getBounds(i);
+            if (box.minimum != current.minimum || box.maximum != current.maximum)
+                sceneBvh->setBounds(i, box);
+        }
+        sceneBvh->update();
+        visibleItems.clear();
+        sceneBvh->queryFrustum(renderQueue.getFrustum(), visibleItems);
+        std::sort(visibleItems.begin(), visibleItems.end());
+        // with GPU culling the tree only picks the occluders, the compute shader tests every helicopter itself
+        bool gpuCulling = gpuCuller && programState->gpuCulling;
+        if (!gpuCulling)
+        {
+            CullingStats bvhCulled;
+            bvhCulled.culled = static_cast<unsigned int>(helicopterModels.size() - visibleItems.size());
+            renderQueue.addCullingStats(CullingStats(), bvhCulled);
+        }
+
         glm::mat4 model = glm::mat4(1.f);
         model = glm::translate(model, programState->objectPosition);
         model = glm::scale(model, glm::vec3(programState->objectScale));
-        shader->setMat4("model", model);
-        helicopter.Draw(*shader);
+        float angle = 90.0f;
+        glm::mat4 plateModel = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.0f, 0.0f));
 
-        glDisable(GL_CULL_FACE);
+        if (programState->occlusionCulling)
+        {
+            occlusionCuller.begin(projection * view);
+            occlusionCuller.addOccluder(quad->getOccluder(), plateModel);
+            // the nearest helicopters are the ones most likely to hide others
+            occluderItems = visibleItems;
+            size_t occluderCount = std::min<size_t>(occluderItems.size(), helicopterOccluders);
+            glm::vec3 cameraPosition = programState->camera.Position;
+            std::partial_sort(occluderItems.begin(), occluderItems.begin() + occluderCount, occluderItems.end(),
+                              [&](unsigned int a, unsigned int b) {
+                                  return glm::length(sceneBvh->getBounds(a).getCenter() - cameraPosition) <
+                                         glm::length(sceneBvh->getBounds(b).getCenter() - cameraPosition);
+                              });
+            for (size_t i = 0; i < occluderCount; i++)
+                helicopter->addOccluders(occlusionCuller, helicopterModels[occluderItems[i]]);
+            occlusionCuller.render();
+            if (!gpuCulling)
+                visibleItems.erase(std::remove_if(visibleItems.begin(), visibleItems.end(),
+                                                  [&](unsigned int item) {
+                                                      return !occlusionCuller.testBox(sceneBvh->getBounds(item));
+                                                  }),
+                                   visibleItems.end());
+        }
 
-        glBindTexture(GL_TEXTURE_2D, plate_texture);
-        textureShader->use();
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-        textureShader->setMat4("projection", projection);
-        textureShader->setMat4("view", view);
-        float angle = 90.0f;
-        model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.0f, 0.0f));
-        textureShader->setMat4("model", model);
-        textureShader->setBool("blinn", programState->blinn);
+        programState->lodSelector.update(programState->camera, (float)WinHeight);
+        if (gpuCulling)
+        {
+            gpuCuller->begin(projection * view, programState->lodSelector,
+                             programState->occlusionCulling ? &occlusionCuller : nullptr);
+        }
+        else
+        {
+            visibleHelicopters.clear();
+            for (unsigned int item : visibleItems)
+                visibleHelicopters.push_back(helicopterModels[item]);
+            helicopter->submit(renderQueue, *shader, programState->lodSelector, *instances, visibleHelicopters,
+                               programState->helicopterLod, GL_FRONT);
+        }
 
-        textureShader->setVec3("viewPos", programState->camera.Position);
-        textureShader->setFloat("material.shininess", 32.0f);
-        // directional light
-        textureShader->setVec3("dirLight.direction", 10.0 * cos(currentFrame), 10.0f, 10.0 * sin(currentFrame));
-        textureShader->setVec3("dirLight.ambient", programState->pointLight.ambient);
-        textureShader->setVec3("dirLight.diffuse", programState->pointLight.diffuse * 5.0f);
-        textureShader->setVec3("dirLight.specular", programState->pointLight.specular);
+        DrawPacket &plate = renderQueue.submit(*textureShader, *quad, plateModel);
+        plate.material = &plateMaterial;
+        plate.setInt("dirLightIndex", DIR_LIGHT_PLATE);
 
+        // the glass panes are one instanced draw, so they're blended back to front by sorting their matrices
+        glassModels.clear();
+        glm::vec3 glassCenter = glm::vec3(0.0f);
         for (auto settings : glass_positions)
         {
             model = glm::mat4(1.0f);
             model = glm::translate(model, programState->objectPosition);
             model = glm::scale(model, glm::vec3(programState->objectScale));
-            transparentShader->use();
-            glBindVertexArray(VAO);
-            glBindTexture(GL_TEXTURE_2D, transparent_texture);
-            transparentShader->setMat4("projection", projection);
-            transparentShader->setMat4("view", view);
             model = glm::translate(model, settings.first);
-            float angle = 90.f;
             model = glm::rotate(model, glm::radians(angle), settings.second);
-            transparentShader->setMat4("model", model);
-            transparentShader->setVec3("viewPos", programState->camera.Position);
-            transparentShader->setBool("blinn", programState->blinn);
-            transparentShader->setFloat("material.shininess", 32.0f);
-            // directional light
-            transparentShader->setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-            transparentShader->setVec3("dirLight.ambient", programState->pointLight.ambient);
-            transparentShader->setVec3("dirLight.diffuse", programState->pointLight.diffuse * 5.0f);
-            transparentShader->setVec3("dirLight.specular", programState->pointLight.specular);
-            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
+            glassModels.push_back(model);
+            glassCenter += glm::vec3(model[3]) / (float)glass_positions.size();
+        }
+        std::sort(glassModels.begin(), glassModels.end(), [&renderQueue](const glm::mat4 &a, const glm::mat4 &b) {
+            return renderQueue.getViewDepth(glm::vec3(a[3])) > renderQueue.getViewDepth(glm::vec3(b[3]));
+        });
+        DrawPacket &glass = renderQueue.submit(*transparentShader, *quad, glassModels[0], RenderLayer::Transparent);
+        glass.depth = renderQueue.getViewDepth(glassCenter);
+        glass.material = &glassMaterial;
+        glass.setInt("dirLightIndex", DIR_LIGHT_GLASS);
+        glass.instances = instances.get();
+        glass.firstInstance = instances->append(glassModels);
+        glass.instanceCount = static_cast<unsigned int>(glassModels.size());
+
+        renderQueue.sort();
+        renderQueue.execute(RenderLayer::Opaque);
+        if (gpuCulling)
+        {
+            // front faces culled like the helicopter packets of the CPU path
+            glState.setCullFace(true);
+            glState.setCullFaceMode(GL_FRONT);
+            helicopter->Draw(*shader, *gpuCuller, helicopterModels);
         }
 
-        // draw skybox as last
-        glDepthFunc(
-            GL_LEQUAL); // change depth function so depth test passes when values are equal to depth buffer's content
+        // draw skybox after the opaque geometry, so it's only shaded where nothing covers it, and before the glass,
+        // which has to be blended over it
+        // change depth function so depth test passes when values are equal to depth buffer's content
+        glState.setCullFace(false);
+        glState.setDepthFunc(GL_LEQUAL);
+        // skybox.vs removes the translation from the view matrix
         skyboxShader->use();
-        view = glm::mat4(glm::mat3(programState->camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader->setMat4("view", view);
-        skyboxShader->setMat4("projection", projection);
         // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        glState.bindVertexArray(skyboxVAO);
+        glState.bindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture->getId());
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
+        glState.setDepthFunc(GL_LESS); // set depth function back to default
+
+        renderQueue.execute(RenderLayer::Transparent);
 
         if (programState->imguiEnabled)
         {
@@ -365,8 +578,7 @@ int main()
         // --------------------------------------------------------------------------------------------------------------------------
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         hdrShader->use();
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, colorBuffer);
+        glState.bindTexture(0, GL_TEXTURE_2D, colorBuffer);
         hdrShader->setInt("hdr", programState->hdr);
         hdrShader->setFloat("exposure", programState->exposure);
         renderQuad();
@@ -378,19 +590,35 @@ int main()
     programState->saveToFile("resources/program_state.txt");
 
     // free memory
+    // the last handles release the GPU resources, which needs the context that is still alive here
+    helicopter.reset();
+    gpuCuller.reset();
+    quad.reset();
+    cubemapTexture.reset();
+    plateMaterial = Material();
+    glassMaterial = Material();
+    plate_texture.reset();
+    transparent_texture.reset();
+    shader.reset();
+    textureShader.reset();
+    skyboxShader.reset();
+    transparentShader.reset();
+    hdrShader.reset();
+    cameraBuffer.reset();
+    lightsBuffer.reset();
+    instances.reset();
+    assets.setStreamer(nullptr);
+    delete assetStreamer;
+    delete sceneBvh;
+    GeometryBuffer::releaseAll();
     delete programState;
-    delete shader;
-    delete textureShader;
-    delete skyboxShader;
-    delete transparentShader;
-    delete hdrShader;
 
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
 
-    glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteBuffers(1, &skyboxVAO);
+    GLState::global().deleteVertexArray(skyboxVAO);
+    glDeleteBuffers(1, &skyboxVBO);
 
     glfwTerminate();
     return 0;
@@ -509,6 +737,11 @@ void draw_imgui()
         ImGui::ColorEdit3("Background color", (float *)&programState->backgroundColor);
         ImGui::DragFloat3("Object position", (float *)&programState->objectPosition);
         ImGui::DragFloat("Object scale", &programState->objectScale, 0.05, 0.1, 4.0);
+        ImGui::DragInt("Helicopters", &programState->helicopterCount, 1, 1, 1024);
+        ImGui::Checkbox("Occlusion culling", &programState->occlusionCulling);
+        ImGui::Checkbox("Meshlet culling", &programState->meshletCulling);
+        if (GpuCuller::isSupported())
+            ImGui::Checkbox("GPU culling", &programState->gpuCulling);
 
         ImGui::DragFloat("pointLight.constant", &programState->pointLight.constant, 0.05, 0.0, 1.0);
         ImGui::DragFloat("pointLight.linear", &programState->pointLight.linear, 0.05, 0.0, 1.0);
@@ -516,6 +749,24 @@ void draw_imgui()
         ImGui::Checkbox("blinn", &programState->blinn);
         ImGui::Checkbox("hdr", &programState->hdr);
         ImGui::DragFloat("exposure", &programState->exposure, 0.05, 0.0, 5.0);
+        ImGui::Checkbox("Compact vertex format", &programState->compactVertices);
+        ImGui::DragInt("Upload budget (KB/frame)", &programState->uploadBudgetKB, 64, 64, 65536);
+        ImGui::Checkbox("Geometry megabuffer", &programState->sharedGeometry);
+        ImGui::Text("Assets loading: %u", assetStreamer->getPendingCount());
+        AssetRegistry &assets = AssetRegistry::global();
+        ImGui::Text("Assets alive: %zu models, %zu textures, %zu shaders", assets.getModelCount(),
+                    assets.getTextureCount(), assets.getShaderCount());
+        if (ProgramCache::isEnabled())
+            ImGui::Text("Shader programs: %u from cache, %u compiled", ProgramCache::getHitCount(),
+                        ProgramCache::getMissCount());
+        else
+            ImGui::Text("Shader programs: %u compiled (no program binary support)", ProgramCache::getMissCount());
+        const GeometryBuffer &fullGeometry = GeometryBuffer::get(VertexFormat::Full);
+        const GeometryBuffer &compactGeometry = GeometryBuffer::get(VertexFormat::Compact);
+        ImGui::Text("Megabuffer: %u meshes, %zu of %zu KB used",
+                    fullGeometry.getAllocationCount() + compactGeometry.getAllocationCount(),
+                    (fullGeometry.getUsedMemory() + compactGeometry.getUsedMemory()) / 1024,
+                    (fullGeometry.getGpuMemory() + compactGeometry.getGpuMemory()) / 1024);
         ImGui::End();
     }
 
@@ -526,79 +777,37 @@ void draw_imgui()
         ImGui::Text("(Yaw, Pitch): (%f, %f)", c.Yaw, c.Pitch);
         ImGui::Text("Camera front: (%f, %f, %f)", c.Front.x, c.Front.y, c.Front.z);
         ImGui::Checkbox("Camera mouse update", &programState->cameraMouseMovementEnabled);
+        ImGui::Checkbox("LOD", &programState->lodSelector.enabled);
+        ImGui::DragFloat("LOD error (px)", &programState->lodSelector.pixelThreshold, 0.05, 0.1, 16.0);
+        ImGui::Text("Helicopter triangles: %u", programState->helicopterLod.triangles);
+        ImGui::Text("Uniform uploads: %u, %u skipped", programState->uniformStats.uploaded,
+                    programState->uniformStats.skipped);
+        ImGui::Text("GL state calls: %u, %u filtered", programState->glStateStats.issued,
+                    programState->glStateStats.filtered);
+        ImGui::Text("Draw packets: %u, %u program and %u material changes", programState->renderQueueStats.packets,
+                    programState->renderQueueStats.programChanges, programState->renderQueueStats.materialChanges);
+        ImGui::Text("Frustum culling: %u meshes visible, %u culled", programState->renderQueueStats.meshes.visible,
+                    programState->renderQueueStats.meshes.culled);
+        ImGui::Text("Frustum culling: %u instances visible, %u culled",
+                    programState->renderQueueStats.instances.visible, programState->renderQueueStats.instances.culled);
+        ImGui::Text("Meshlet culling: %u meshlets visible, %u culled", programState->renderQueueStats.meshlets.visible,
+                    programState->renderQueueStats.meshlets.culled);
+        ImGui::Text("Occlusion culling: %u of %u instances occluded, %u occluder triangles",
+                    programState->occlusionStats.occluded, programState->occlusionStats.tested,
+                    programState->occlusionStats.occluderTriangles);
+        if (GpuCuller::isSupported() && programState->gpuCulling)
+            ImGui::Text("GPU culling: %u instances in %u dispatches, %u multi draws",
+                        programState->gpuCullingStats.instances, programState->gpuCullingStats.dispatches,
+                        programState->gpuCullingStats.drawCalls);
+        ImGui::Text("Scene BVH: %zu nodes, SAH cost %.1f (%.1f when built)%s", sceneBvh->getNodeCount(),
+                    sceneBvh->getCost(), sceneBvh->getBuildCost(), sceneBvh->isRebuilding() ? ", rebuilding" : "");
         ImGui::End();
     }
 
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-}
-
-unsigned int loadTexture(char const *path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
-
-unsigned int loadCubemap(std::vector<std::string> faces)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrChannels;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE,
-                         data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
+    // ImGui's renderer sets GL state directly
+    GLState::global().invalidate();
 }
 
 unsigned int quadVAO = 0;
@@ -615,7 +824,7 @@ void renderQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
+        GLState::global().bindVertexArray(quadVAO);
         glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
@@ -623,7 +832,6 @@ void renderQuad()
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
+    GLState::global().bindVertexArray(quadVAO);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
 }
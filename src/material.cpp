@@ -0,0 +1,89 @@
+#include <rg/material.hpp>
+#include <rg/glstate.hpp>
+
+#include <iostream>
+
+namespace
+{
+const char *const TEXTURE_TYPE_NAMES[TEXTURE_TYPE_COUNT] = {"texture_diffuse", "texture_specular", "texture_normal",
+                                                            "texture_height"};
+} // namespace
+
+const char *getTextureTypeName(TextureType type)
+{
+    return TEXTURE_TYPE_NAMES[static_cast<unsigned int>(type)];
+}
+
+bool parseTextureType(const std::string &name, TextureType &type)
+{
+    for (unsigned int i = 0; i < TEXTURE_TYPE_COUNT; i++)
+    {
+        if (name == TEXTURE_TYPE_NAMES[i])
+        {
+            type = static_cast<TextureType>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+Material::Material(std::vector<Texture> &&textures)
+{
+    unsigned int counts[TEXTURE_TYPE_COUNT] = {};
+    for (Texture &texture : textures)
+    {
+        unsigned int &count = counts[static_cast<unsigned int>(texture.type)];
+        if (count == MAX_TEXTURES_PER_TYPE)
+        {
+            std::cout << "WARNING::MATERIAL:: more than " << MAX_TEXTURES_PER_TYPE << " "
+                      << getTextureTypeName(texture.type) << " textures, dropping " << texture.path << std::endl;
+            continue;
+        }
+        units.push_back(getMaterialTextureUnit(texture.type, count++));
+        this->textures.push_back(std::move(texture));
+    }
+
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < this->textures.size(); i++)
+    {
+        hash = hashCombine(hash, this->textures[i].object.get());
+        hash = hashCombine(hash, units[i]);
+    }
+    // folded, so every bit of the hash ends up in the key
+    sortKey = static_cast<uint16_t>(hash ^ (hash >> 16) ^ (hash >> 32) ^ (hash >> 48));
+}
+
+void Material::bind() const
+{
+    GLState &state = GLState::global();
+    for (size_t i = 0; i < textures.size(); i++)
+        state.bindTexture(units[i], GL_TEXTURE_2D, textures[i].object ? textures[i].object->getId() : 0);
+}
+
+MaterialSamplers::MaterialSamplers(const std::string &prefix)
+{
+    // FNV-1a continues where it left off, so hashing the suffixes on top of the prefix hashes the whole names
+    // without building them
+    uint64_t prefixHash = hashString(prefix);
+    layout = hashString("#samplers", prefixHash);
+    for (unsigned int type = 0; type < TEXTURE_TYPE_COUNT; type++)
+    {
+        uint64_t typeHash = hashString(TEXTURE_TYPE_NAMES[type], prefixHash);
+        for (unsigned int n = 0; n < MAX_TEXTURES_PER_TYPE; n++)
+            hashes[type][n] = hashString(std::to_string(n + 1), typeHash);
+    }
+}
+
+void MaterialSamplers::apply(Shader &shader) const
+{
+    if (shader.samplerLayout == layout)
+        return;
+    shader.samplerLayout = layout;
+    shader.use();
+    for (unsigned int type = 0; type < TEXTURE_TYPE_COUNT; type++)
+    {
+        for (unsigned int n = 0; n < MAX_TEXTURES_PER_TYPE; n++)
+            shader.setInt(UniformName(hashes[type][n]),
+                          static_cast<int>(getMaterialTextureUnit(static_cast<TextureType>(type), n)));
+    }
+}
@@ -1,77 +1,326 @@
 #include <rg/mesh.hpp>
+#include <rg/geometrybuffer.hpp>
+#include <rg/glextensions.hpp>
+#include <rg/glstate.hpp>
 
+#include <algorithm>
+#include <cstdint>
 
-void Mesh::Draw(Shader &shader)
+Mesh::~Mesh()
 {
-    // bind appropriate textures
-    unsigned int diffuseNr = 1;
-    unsigned int specularNr = 1;
-    unsigned int normalNr = 1;
-    unsigned int heightNr = 1;
-    for (unsigned int i = 0; i < textures.size(); i++)
+    release();
+}
+
+Mesh::Mesh(Mesh &&other) noexcept
+    : vertices(std::move(other.vertices)), indices(std::move(other.indices)), material(std::move(other.material)),
+      VAO(other.VAO), VBO(other.VBO), EBO(other.EBO), format(other.format), retention(other.retention),
+      indexType(other.indexType), gpuMemory(other.gpuMemory), lods(std::move(other.lods)),
+      boundingCenter(other.boundingCenter), boundingRadius(other.boundingRadius), boundingBoxMin(other.boundingBoxMin),
+      boundingBoxMax(other.boundingBoxMax), occluder(std::move(other.occluder)), meshlets(std::move(other.meshlets)),
+      meshletBaseVertices(std::move(other.meshletBaseVertices)), placements(std::move(other.placements)),
+      positionOffset(other.positionOffset), positionScale(other.positionScale), shared(other.shared),
+      allocation(other.allocation)
+{
+    other.VAO = other.VBO = other.EBO = 0;
+    other.shared = false;
+}
+
+Mesh &Mesh::operator=(Mesh &&other) noexcept
+{
+    if (this != &other)
     {
-        glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-        // retrieve texture number (the N in diffuse_textureN)
-        std::string number;
-        std::string name = textures[i].type;
-        if (name == "texture_diffuse")
-            number = std::to_string(diffuseNr++);
-        else if (name == "texture_specular")
-            number = std::to_string(specularNr++); // transfer unsigned int to stream
-        else if (name == "texture_normal")
-            number = std::to_string(normalNr++); // transfer unsigned int to stream
-        else if (name == "texture_height")
-            number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-        // now set the sampler to the correct texture unit
-        glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-        // and finally bind the texture
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        release();
+        vertices = std::move(other.vertices);
+        indices = std::move(other.indices);
+        material = std::move(other.material);
+        VAO = other.VAO;
+        VBO = other.VBO;
+        EBO = other.EBO;
+        format = other.format;
+        retention = other.retention;
+        indexType = other.indexType;
+        gpuMemory = other.gpuMemory;
+        lods = std::move(other.lods);
+        boundingCenter = other.boundingCenter;
+        boundingRadius = other.boundingRadius;
+        boundingBoxMin = other.boundingBoxMin;
+        boundingBoxMax = other.boundingBoxMax;
+        occluder = std::move(other.occluder);
+        meshlets = std::move(other.meshlets);
+        meshletBaseVertices = std::move(other.meshletBaseVertices);
+        placements = std::move(other.placements);
+        positionOffset = other.positionOffset;
+        positionScale = other.positionScale;
+        shared = other.shared;
+        allocation = other.allocation;
+        other.VAO = other.VBO = other.EBO = 0;
+        other.shared = false;
     }
+    return *this;
+}
+
+void Mesh::release()
+{
+    if (shared)
+        GeometryBuffer::get(format).free(allocation);
+    shared = false;
+    allocation = GeometryAllocation();
+    // names of 0 are silently ignored by glDelete*, so moved-from meshes need no special case
+    GLState::global().deleteVertexArray(VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    VAO = VBO = EBO = 0;
+}
+
+void Mesh::releaseCpuData()
+{
+    // swapping with empty vectors gives the memory back, clear() would keep the capacity
+    std::vector<Vertex>().swap(vertices);
+    std::vector<unsigned int>().swap(indices);
+}
+
+void Mesh::Draw(Shader &shader, unsigned int lod)
+{
+    draw(shader, lod, nullptr, 0, 1);
+}
+
+void Mesh::DrawInstanced(Shader &shader, const InstanceBuffer &instances, unsigned int first, unsigned int count,
+                         unsigned int lod)
+{
+    if (count > 0)
+        draw(shader, lod, &instances, first, count);
+}
+
+void Mesh::bind(Shader &shader)
+{
+    // bind appropriate textures, the samplers already point at their units
+    material.bind();
+
+    // compact positions are stored relative to the mesh bounds
+    if (format == VertexFormat::Compact)
+    {
+        shader.setVec3("positionOffset", positionOffset);
+        shader.setVec3("positionScale", positionScale);
+    }
+
+    // every shared mesh of the format uses the same VAO, it stays bound for the next one. Own ones are left bound
+    // too, drawing the mesh again doesn't have to bind it.
+    GLState::global().bindVertexArray(shared ? GeometryBuffer::get(format).getVAO() : VAO);
+}
+
+void Mesh::draw(Shader &shader, unsigned int lod, const InstanceBuffer *instances, unsigned int first,
+                unsigned int count)
+{
+    bind(shader);
 
     // draw mesh
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    const MeshLod &level = lods[std::min<size_t>(lod, lods.size() - 1)];
+    size_t indexSize = getIndexSize(indexType);
+    if (shared)
+    {
+        void *offset = (void *)((allocation.firstIndex + level.indexOffset) * indexSize);
+        if (instances)
+        {
+            instances->bindAttributes(first);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.indexCount, indexType, offset, count,
+                                              allocation.baseVertex);
+        }
+        else
+        {
+            glDrawElementsBaseVertex(GL_TRIANGLES, level.indexCount, indexType, offset, allocation.baseVertex);
+        }
+    }
+    else
+    {
+        void *offset = (void *)(level.indexOffset * indexSize);
+        if (instances)
+        {
+            instances->bindAttributes(first);
+            glDrawElementsInstanced(GL_TRIANGLES, level.indexCount, indexType, offset, count);
+        }
+        else
+        {
+            glDrawElements(GL_TRIANGLES, level.indexCount, indexType, offset);
+        }
+    }
+}
 
-    // always good practice to set everything back to defaults once configured.
-    glActiveTexture(GL_TEXTURE0);
+void Mesh::DrawRanges(Shader &shader, const GLsizei *counts, const void *const *offsets, unsigned int rangeCount,
+                      const InstanceBuffer *instances, unsigned int first)
+{
+    if (rangeCount == 0)
+        return;
+    bind(shader);
+    // attributes with a divisor read their first element in a draw that isn't instanced
+    if (instances)
+        instances->bindAttributes(first);
+    if (shared)
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts, indexType, offsets, rangeCount, meshletBaseVertices.data());
+    else
+        glMultiDrawElements(GL_TRIANGLES, counts, indexType, offsets, rangeCount);
+}
+
+void Mesh::DrawIndirect(Shader &shader, GLuint matrixBuffer, const void *indirect, unsigned int drawCount)
+{
+    if (drawCount == 0)
+        return;
+    bind(shader);
+    InstanceBuffer::bindAttributes(matrixBuffer, 0);
+    glExtensions.multiDrawElementsIndirect(GL_TRIANGLES, indexType, indirect, drawCount, 0);
+}
+
+void Mesh::setMeshlets(std::vector<Meshlet> &&meshlets)
+{
+    this->meshlets = std::move(meshlets);
+    meshletBaseVertices.assign(shared ? this->meshlets.size() : 0, static_cast<GLint>(allocation.baseVertex));
+}
+
+void Mesh::setPlacements(std::vector<glm::mat4> &&placements)
+{
+    this->placements = std::move(placements);
+}
+
+unsigned int Mesh::cullMeshlets(const Frustum &frustum, const glm::mat4 &model, const glm::vec3 &cameraPosition,
+                                GLenum cullFace, GLenum frontFace, GLsizei *counts, const void **offsets,
+                                CullingStats &stats) const
+{
+    // the cones bound the counter-clockwise normals. GL drops the triangles whose counter-clockwise normal faces away
+    // from the camera when it culls back faces of counter-clockwise front faces or front faces of clockwise ones, and
+    // the others in the two remaining cases. A mirroring model matrix turns the winding around once more.
+    bool coneTest = cullFace == GL_FRONT || cullFace == GL_BACK;
+    bool culledFaceAway = (cullFace == GL_BACK) == (frontFace == GL_CCW);
+    if (glm::determinant(glm::mat3(model)) < 0.0f)
+        culledFaceAway = !culledFaceAway;
+    float side = culledFaceAway ? 1.0f : -1.0f;
+
+    // spheres grow with the largest scale of the model matrix, the cones are tested in model space where they are
+    // exact whatever the matrix does (whether a triangle faces the camera doesn't change under an affine transform)
+    float scale = std::max(std::max(glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1]))),
+                           glm::length(glm::vec3(model[2])));
+    glm::vec3 camera = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.0f));
+    size_t indexSize = getIndexSize(indexType);
+    unsigned int firstIndex = shared ? allocation.firstIndex : 0;
+
+    unsigned int rangeCount = 0;
+    unsigned int rangeEnd = 0;
+    for (const Meshlet &meshlet : meshlets)
+    {
+        bool visible = frustum.intersectsSphere(glm::vec3(model * glm::vec4(meshlet.center, 1.0f)),
+                                                meshlet.radius * scale);
+        if (visible && coneTest)
+        {
+            // all triangles face away if the camera lies in the cone opposite to the normals, widened by the sphere,
+            // and all face it if the camera lies in the cone of the normals
+            glm::vec3 toCenter = meshlet.center - camera;
+            visible = side * glm::dot(toCenter, meshlet.coneAxis) <
+                      meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+        }
+        if (!visible)
+        {
+            stats.culled++;
+            continue;
+        }
+        stats.visible++;
+        if (rangeCount > 0 && meshlet.indexOffset == rangeEnd)
+        {
+            counts[rangeCount - 1] += meshlet.indexCount;
+        }
+        else
+        {
+            counts[rangeCount] = meshlet.indexCount;
+            offsets[rangeCount] = (const void *)((firstIndex + meshlet.indexOffset) * indexSize);
+            rangeCount++;
+        }
+        rangeEnd = meshlet.indexOffset + meshlet.indexCount;
+    }
+    return rangeCount;
 }
 
-void Mesh::setupMesh()
+void Mesh::setupMesh(const Vertex *vertexData, size_t vertexCount, const unsigned int *indexData, size_t indexCount)
 {
+    if (lods.empty())
+        lods.push_back(MeshLod{0, static_cast<unsigned int>(indexCount), 0.0f});
+
+    // bounding box, and a bounding sphere around its center
+    glm::vec3 minimum(0.0f), maximum(0.0f);
+    if (vertexCount > 0)
+        minimum = maximum = vertexData[0].Position;
+    for (size_t i = 1; i < vertexCount; i++)
+    {
+        minimum = glm::min(minimum, vertexData[i].Position);
+        maximum = glm::max(maximum, vertexData[i].Position);
+    }
+    boundingBoxMin = minimum;
+    boundingBoxMax = maximum;
+    boundingCenter = (minimum + maximum) * 0.5f;
+    boundingRadius = 0.0f;
+    for (size_t i = 0; i < vertexCount; i++)
+        boundingRadius = std::max(boundingRadius, glm::length(vertexData[i].Position - boundingCenter));
+
+    // the coarsest level as an occluder, with only the vertices it uses. A simplified one is pulled inside the
+    // original surface by its error or, where that isn't safe, not used at all (see MAX_OCCLUDER_TRIANGLES).
+    const MeshLod &coarsest = lods.back();
+    occluder = OccluderMesh();
+    if (coarsest.indexCount / 3 <= MAX_OCCLUDER_TRIANGLES)
+    {
+        std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+        for (unsigned int i = 0; i < coarsest.indexCount; i++)
+        {
+            unsigned int index = indexData[coarsest.indexOffset + i];
+            if (remap[index] == UINT32_MAX)
+            {
+                remap[index] = static_cast<uint32_t>(occluder.vertices.size());
+                occluder.vertices.push_back(vertexData[index].Position);
+            }
+            occluder.indices.push_back(remap[index]);
+        }
+        if (coarsest.error > 0.0f && !shrinkOccluder(occluder, coarsest.error))
+            occluder = OccluderMesh();
+    }
+
+    // the data in the layout of the format
+    std::vector<CompactVertex> compactVertices;
+    std::vector<uint16_t> shortIndices;
+    const void *gpuVertices = vertexData;
+    const void *gpuIndices = indexData;
+    indexType = GL_UNSIGNED_INT;
+    if (format == VertexFormat::Compact)
+    {
+        compactVertices = compressVertices(vertexData, vertexCount, positionOffset, positionScale);
+        gpuVertices = compactVertices.data();
+        if (canUseShortIndices(vertexCount))
+        {
+            shortIndices = compressIndices(indexData, indexCount);
+            gpuIndices = shortIndices.data();
+            indexType = GL_UNSIGNED_SHORT;
+        }
+    }
+    gpuMemory = vertexCount * getVertexSize(format) + indexCount * getIndexSize(indexType);
+
+    // megabuffer mode: suballocate from the buffers shared by all meshes of the format, if their indices fit
+    if (GeometryBuffer::isEnabled() && GeometryBuffer::get(format).getIndexType() == indexType)
+    {
+        allocation = GeometryBuffer::get(format).allocate(gpuVertices, vertexCount, gpuIndices, indexCount);
+        shared = true;
+        return;
+    }
+
     // create buffers/arrays
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
 
-    glBindVertexArray(VAO);
+    GLState::global().bindVertexArray(VAO);
     // load data into vertex buffers
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
     // A great thing about structs is that their memory layout is sequential for all its items.
     // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2
     // array which again translates to 3/2 floats which translates to a byte array.
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * getVertexSize(format), gpuVertices, GL_STATIC_DRAW);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * getIndexSize(indexType), gpuIndices, GL_STATIC_DRAW);
 
     // set the vertex attribute pointers
-    // vertex Positions
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
-    // vertex normals
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
-    // vertex texture coords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
-    // vertex tangent
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Tangent));
-    // vertex bitangent
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Bitangent));
-
-    glBindVertexArray(0);
+    setupVertexAttributes(format);
+    GLState::global().bindVertexArray(0);
 }
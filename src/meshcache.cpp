@@ -0,0 +1,378 @@
+#include <rg/filesystem.hpp>
+#include <rg/hash.hpp>
+#include <rg/meshcache.hpp>
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+const char MESH_CACHE_MAGIC[4] = {'R', 'G', 'M', 'C'};
+
+struct MeshCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t vertexLayout;
+    uint64_t sourceSize;
+    int64_t sourceModified; // nanoseconds since epoch
+    uint32_t importFlags;
+    uint32_t optimizeFlags;
+    uint32_t meshCount;
+    uint32_t dependencyCount;
+};
+
+struct MeshCacheRecord
+{
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t textureCount;
+    uint32_t textureBytes;
+    uint32_t lodCount;
+    uint32_t meshletCount;
+    uint32_t placementCount;
+    uint32_t reserved;
+    uint64_t lodOffset;
+    uint64_t meshletOffset;
+    uint64_t placementOffset;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t textureOffset;
+};
+
+// the other files of an import follow the records as [MeshCacheDependency, path chars], each padded to 8 bytes
+struct MeshCacheDependency
+{
+    uint64_t size;
+    int64_t modified;
+    uint32_t pathLength;
+    // 0 if the import looked for the file but it wasn't there
+    uint32_t exists;
+};
+
+// texture references are stored as [typeLength, pathLength, type chars, path chars]
+struct TextureRefHeader
+{
+    uint32_t typeLength;
+    uint32_t pathLength;
+};
+
+// any change to the Vertex struct (field order, types, padding) changes this value and thus invalidates the cache
+uint64_t vertexLayoutSignature()
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    hash = hashCombine(hash, sizeof(Vertex));
+    hash = hashCombine(hash, offsetof(Vertex, Position));
+    hash = hashCombine(hash, offsetof(Vertex, Normal));
+    hash = hashCombine(hash, offsetof(Vertex, TexCoords));
+    hash = hashCombine(hash, offsetof(Vertex, Tangent));
+    hash = hashCombine(hash, offsetof(Vertex, Bitangent));
+    return hash;
+}
+
+// goes through the file system so a source in an asset pack reports the size and time it had when it was packed
+bool statSource(const std::string &path, uint64_t &size, int64_t &modified)
+{
+    FileInfo info;
+    if (!FileSystem::getFileInfo(path, info))
+        return false;
+    size = info.size;
+    modified = info.modified;
+    return true;
+}
+
+uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// what the file system says about a dependency now, a missing file has size and time 0
+MeshCacheDependency statDependency(const std::string &path)
+{
+    MeshCacheDependency dependency = {0, 0, static_cast<uint32_t>(path.size()), 0};
+    if (statSource(path, dependency.size, dependency.modified))
+        dependency.exists = 1;
+    return dependency;
+}
+
+void writePadding(std::ofstream &out, uint64_t &offset, uint64_t alignment)
+{
+    static const char zeros[16] = {};
+    uint64_t aligned = alignOffset(offset, alignment);
+    out.write(zeros, aligned - offset);
+    offset = aligned;
+}
+} // namespace
+
+MeshCache::~MeshCache()
+{
+    close();
+}
+
+std::string MeshCache::getCachePath(const std::string &assetPath)
+{
+    return assetPath + ".rgcache";
+}
+
+void MeshCache::close()
+{
+    file = FileView();
+    meshes.clear();
+}
+
+bool MeshCache::open(const std::string &assetPath, unsigned int importFlags, unsigned int optimizeFlags)
+{
+    close();
+
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    if (!statSource(assetPath, sourceSize, sourceModified))
+        return false;
+
+    // mapped either way, in place from the asset pack or as a loose file
+    file = FileSystem::readFile(getCachePath(assetPath));
+    if (!file.isValid() || file.size() < sizeof(MeshCacheHeader))
+    {
+        close();
+        return false;
+    }
+    size_t mappingSize = file.size();
+
+    const unsigned char *base = file.data();
+    const MeshCacheHeader *header = reinterpret_cast<const MeshCacheHeader *>(base);
+    if (std::memcmp(header->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+        header->version != MESH_CACHE_VERSION || header->vertexLayout != vertexLayoutSignature() ||
+        header->sourceSize != sourceSize || header->sourceModified != sourceModified ||
+        header->importFlags != importFlags || header->optimizeFlags != optimizeFlags ||
+        sizeof(MeshCacheHeader) + header->meshCount * sizeof(MeshCacheRecord) > mappingSize)
+    {
+        close();
+        return false;
+    }
+
+    const MeshCacheRecord *records = reinterpret_cast<const MeshCacheRecord *>(base + sizeof(MeshCacheHeader));
+
+    // every other file the import read has to be as it was as well
+    uint64_t dependencyOffset = sizeof(MeshCacheHeader) + uint64_t(header->meshCount) * sizeof(MeshCacheRecord);
+    for (uint32_t i = 0; i < header->dependencyCount; i++)
+    {
+        if (dependencyOffset + sizeof(MeshCacheDependency) > mappingSize)
+        {
+            close();
+            return false;
+        }
+        const MeshCacheDependency *recorded = reinterpret_cast<const MeshCacheDependency *>(base + dependencyOffset);
+        uint64_t pathOffset = dependencyOffset + sizeof(MeshCacheDependency);
+        if (pathOffset + recorded->pathLength > mappingSize)
+        {
+            close();
+            return false;
+        }
+        std::string path(reinterpret_cast<const char *>(base + pathOffset), recorded->pathLength);
+        MeshCacheDependency current = statDependency(path);
+        if (current.exists != recorded->exists || current.size != recorded->size ||
+            current.modified != recorded->modified)
+        {
+            close();
+            return false;
+        }
+        dependencyOffset = alignOffset(pathOffset + recorded->pathLength, alignof(MeshCacheDependency));
+    }
+
+    meshes.reserve(header->meshCount);
+    for (uint32_t i = 0; i < header->meshCount; i++)
+    {
+        const MeshCacheRecord &record = records[i];
+        // a truncated or otherwise damaged file is treated like a stale one
+        if (record.vertexOffset + uint64_t(record.vertexCount) * sizeof(Vertex) > mappingSize ||
+            record.indexOffset + uint64_t(record.indexCount) * sizeof(unsigned int) > mappingSize ||
+            record.textureOffset + record.textureBytes > mappingSize ||
+            record.lodOffset + uint64_t(record.lodCount) * sizeof(MeshLod) > mappingSize ||
+            record.meshletOffset + uint64_t(record.meshletCount) * sizeof(Meshlet) > mappingSize ||
+            record.placementOffset + uint64_t(record.placementCount) * sizeof(glm::mat4) > mappingSize)
+        {
+            close();
+            return false;
+        }
+
+        CachedMesh mesh;
+        mesh.vertices = reinterpret_cast<const Vertex *>(base + record.vertexOffset);
+        mesh.vertexCount = record.vertexCount;
+        mesh.indices = reinterpret_cast<const unsigned int *>(base + record.indexOffset);
+        mesh.indexCount = record.indexCount;
+        mesh.lods = reinterpret_cast<const MeshLod *>(base + record.lodOffset);
+        mesh.lodCount = record.lodCount;
+        mesh.meshlets = reinterpret_cast<const Meshlet *>(base + record.meshletOffset);
+        mesh.meshletCount = record.meshletCount;
+        mesh.placements = reinterpret_cast<const glm::mat4 *>(base + record.placementOffset);
+        mesh.placementCount = record.placementCount;
+
+        const unsigned char *ref = base + record.textureOffset;
+        const unsigned char *refEnd = ref + record.textureBytes;
+        for (uint32_t j = 0; j < record.textureCount; j++)
+        {
+            TextureRefHeader refHeader;
+            if (ref + sizeof(refHeader) > refEnd)
+            {
+                close();
+                return false;
+            }
+            std::memcpy(&refHeader, ref, sizeof(refHeader));
+            ref += sizeof(refHeader);
+            if (ref + refHeader.typeLength + refHeader.pathLength > refEnd)
+            {
+                close();
+                return false;
+            }
+            // the type is stored by its name, so the file doesn't depend on the order of TextureType
+            Texture texture;
+            bool known = parseTextureType(std::string(reinterpret_cast<const char *>(ref), refHeader.typeLength),
+                                          texture.type);
+            ref += refHeader.typeLength;
+            texture.path.assign(reinterpret_cast<const char *>(ref), refHeader.pathLength);
+            ref += refHeader.pathLength;
+            if (known)
+                mesh.textures.push_back(texture);
+        }
+        meshes.push_back(mesh);
+    }
+    return true;
+}
+
+bool MeshCache::write(const std::string &assetPath, unsigned int importFlags, unsigned int optimizeFlags,
+                      const std::vector<MeshData> &meshes, const std::vector<std::string> &dependencies)
+{
+    MeshCacheHeader header;
+    std::memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    header.version = MESH_CACHE_VERSION;
+    header.vertexLayout = vertexLayoutSignature();
+    header.importFlags = importFlags;
+    header.optimizeFlags = optimizeFlags;
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    if (!statSource(assetPath, header.sourceSize, header.sourceModified))
+        return false;
+    // the asset itself is in the header already
+    std::vector<std::string> dependencyPaths;
+    for (const std::string &path : dependencies)
+    {
+        if (path != assetPath)
+            dependencyPaths.push_back(path);
+    }
+    header.dependencyCount = static_cast<uint32_t>(dependencyPaths.size());
+
+    // lay out the records and the dependencies first, the data blocks follow in mesh order
+    std::vector<MeshCacheRecord> records(meshes.size());
+    uint64_t offset = sizeof(MeshCacheHeader) + meshes.size() * sizeof(MeshCacheRecord);
+    for (const std::string &path : dependencyPaths)
+        offset = alignOffset(offset + sizeof(MeshCacheDependency) + path.size(), alignof(MeshCacheDependency));
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const MeshData &mesh = meshes[i];
+        MeshCacheRecord &record = records[i];
+        record.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+        record.indexCount = static_cast<uint32_t>(mesh.indices.size());
+        record.textureCount = static_cast<uint32_t>(mesh.textures.size());
+        record.textureBytes = 0;
+        for (const Texture &texture : mesh.textures)
+            record.textureBytes +=
+                sizeof(TextureRefHeader) + std::strlen(getTextureTypeName(texture.type)) + texture.path.size();
+
+        record.lodCount = static_cast<uint32_t>(mesh.lods.size());
+        record.meshletCount = static_cast<uint32_t>(mesh.meshlets.size());
+        record.placementCount = static_cast<uint32_t>(mesh.placements.size());
+        record.reserved = 0;
+
+        record.textureOffset = offset;
+        offset += record.textureBytes;
+        offset = record.lodOffset = alignOffset(offset, alignof(MeshLod));
+        offset += uint64_t(record.lodCount) * sizeof(MeshLod);
+        offset = record.meshletOffset = alignOffset(offset, alignof(Meshlet));
+        offset += uint64_t(record.meshletCount) * sizeof(Meshlet);
+        offset = record.placementOffset = alignOffset(offset, 16);
+        offset += uint64_t(record.placementCount) * sizeof(glm::mat4);
+        offset = record.vertexOffset = alignOffset(offset, 16);
+        offset += uint64_t(record.vertexCount) * sizeof(Vertex);
+        offset = record.indexOffset = alignOffset(offset, sizeof(unsigned int));
+        offset += uint64_t(record.indexCount) * sizeof(unsigned int);
+    }
+
+    // write to a temporary file first so a crash mid-write never leaves a half-written cache behind
+    std::string cachePath = getCachePath(assetPath);
+    std::string tmpPath = cachePath + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    offset = 0;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(MeshCacheRecord));
+    offset += sizeof(header) + records.size() * sizeof(MeshCacheRecord);
+    for (const std::string &path : dependencyPaths)
+    {
+        MeshCacheDependency dependency = statDependency(path);
+        out.write(reinterpret_cast<const char *>(&dependency), sizeof(dependency));
+        out.write(path.data(), path.size());
+        offset += sizeof(dependency) + path.size();
+        writePadding(out, offset, alignof(MeshCacheDependency));
+    }
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const MeshData &mesh = meshes[i];
+        for (const Texture &texture : mesh.textures)
+        {
+            const char *type = getTextureTypeName(texture.type);
+            TextureRefHeader refHeader = {static_cast<uint32_t>(std::strlen(type)),
+                                          static_cast<uint32_t>(texture.path.size())};
+            out.write(reinterpret_cast<const char *>(&refHeader), sizeof(refHeader));
+            out.write(type, refHeader.typeLength);
+            out.write(texture.path.data(), texture.path.size());
+        }
+        offset += records[i].textureBytes;
+        writePadding(out, offset, alignof(MeshLod));
+        out.write(reinterpret_cast<const char *>(mesh.lods.data()), mesh.lods.size() * sizeof(MeshLod));
+        offset += mesh.lods.size() * sizeof(MeshLod);
+        writePadding(out, offset, alignof(Meshlet));
+        out.write(reinterpret_cast<const char *>(mesh.meshlets.data()), mesh.meshlets.size() * sizeof(Meshlet));
+        offset += mesh.meshlets.size() * sizeof(Meshlet);
+        writePadding(out, offset, 16);
+        out.write(reinterpret_cast<const char *>(mesh.placements.data()), mesh.placements.size() * sizeof(glm::mat4));
+        offset += mesh.placements.size() * sizeof(glm::mat4);
+        writePadding(out, offset, 16);
+        out.write(reinterpret_cast<const char *>(mesh.vertices.data()), mesh.vertices.size() * sizeof(Vertex));
+        offset += mesh.vertices.size() * sizeof(Vertex);
+        writePadding(out, offset, sizeof(unsigned int));
+        out.write(reinterpret_cast<const char *>(mesh.indices.data()), mesh.indices.size() * sizeof(unsigned int));
+        offset += mesh.indices.size() * sizeof(unsigned int);
+    }
+    out.close();
+    if (!out)
+    {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return std::rename(tmpPath.c_str(), cachePath.c_str()) == 0;
+}
+
+bool MeshCache::read(const std::string &assetPath, unsigned int importFlags, unsigned int optimizeFlags,
+                     std::vector<MeshData> &meshes)
+{
+    MeshCache cache;
+    if (!cache.open(assetPath, importFlags, optimizeFlags))
+        return false;
+
+    meshes.resize(cache.getMeshes().size());
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        const CachedMesh &cached = cache.getMeshes()[i];
+        meshes[i].vertices.assign(cached.vertices, cached.vertices + cached.vertexCount);
+        meshes[i].indices.assign(cached.indices, cached.indices + cached.indexCount);
+        meshes[i].lods.assign(cached.lods, cached.lods + cached.lodCount);
+        meshes[i].meshlets.assign(cached.meshlets, cached.meshlets + cached.meshletCount);
+        meshes[i].placements.assign(cached.placements, cached.placements + cached.placementCount);
+        meshes[i].textures = cached.textures;
+    }
+    return true;
+}
@@ -0,0 +1,703 @@
+#include <rg/hash.hpp>
+#include <rg/meshoptimizer.hpp>
+#include <rg/meshsimplifier.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+namespace
+{
+// FIFO post-transform cache: a vertex is cached while fewer than size vertices were transformed after it
+class VertexCacheSimulator
+{
+  public:
+    VertexCacheSimulator(size_t vertexCount, unsigned int size) : size(size), time(size + 1), timestamps(vertexCount, 0)
+    {
+    }
+
+    // returns true if the vertex had to be transformed
+    bool reference(unsigned int vertex)
+    {
+        if (time - timestamps[vertex] <= size)
+            return false;
+        timestamps[vertex] = time++;
+        return true;
+    }
+
+    unsigned int triangleMisses(const std::vector<unsigned int> &indices, size_t triangle)
+    {
+        return reference(indices[triangle * 3]) + reference(indices[triangle * 3 + 1]) +
+               reference(indices[triangle * 3 + 2]);
+    }
+
+    // everything currently in the cache is considered evicted
+    void flush()
+    {
+        time += size + 1;
+    }
+
+  private:
+    unsigned int size;
+    unsigned int time;
+    std::vector<unsigned int> timestamps;
+};
+
+VertexCacheStatistics &operator+=(VertexCacheStatistics &sum, const VertexCacheStatistics &statistics)
+{
+    sum.triangles += statistics.triangles;
+    sum.vertices += statistics.vertices;
+    sum.misses += statistics.misses;
+    return sum;
+}
+
+VertexCacheStatistics analyzeMeshes(const std::vector<MeshData> &meshes)
+{
+    VertexCacheStatistics sum;
+    for (const MeshData &mesh : meshes)
+    {
+        // only the full detail level, the others are generated after the ordering passes
+        size_t count = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount;
+        std::vector<unsigned int> lod0(mesh.indices.begin(), mesh.indices.begin() + count);
+        sum += analyzeVertexCache(lod0, mesh.vertices.size());
+    }
+    return sum;
+}
+
+void printStatistics(const char *stage, const VertexCacheStatistics &statistics)
+{
+    std::ostringstream line;
+    line << "    " << std::left << std::setw(14) << stage << std::fixed << std::setprecision(3) << "ACMR "
+         << statistics.getACMR() << "  ATVR " << statistics.getATVR();
+    std::cout << line.str() << std::endl;
+}
+// bounding sphere and normal cone of the triangles in indices[first, first + count)
+Meshlet makeMeshlet(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, unsigned int first,
+                    unsigned int count)
+{
+    Meshlet meshlet;
+    meshlet.indexOffset = first;
+    meshlet.indexCount = count;
+
+    // a sphere around the center of the box, not the smallest one but close enough to cull by
+    glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+    for (unsigned int i = first; i < first + count; i++)
+    {
+        minimum = glm::min(minimum, vertices[indices[i]].Position);
+        maximum = glm::max(maximum, vertices[indices[i]].Position);
+    }
+    meshlet.center = (minimum + maximum) * 0.5f;
+    meshlet.radius = 0.0f;
+    for (unsigned int i = first; i < first + count; i++)
+        meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].Position - meshlet.center));
+
+    // the axis is the average face normal, the cone opens as far as the normal farthest from it
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis(0.0f);
+    for (unsigned int i = first; i + 2 < first + count; i += 3)
+    {
+        const glm::vec3 &a = vertices[indices[i]].Position;
+        glm::vec3 normal = glm::cross(vertices[indices[i + 1]].Position - a, vertices[indices[i + 2]].Position - a);
+        float length = glm::length(normal);
+        // degenerate triangles are never drawn, whichever way they'd face
+        if (length > 0.0f)
+        {
+            normals.push_back(normal / length);
+            axis += normal / length;
+        }
+    }
+    float axisLength = glm::length(axis);
+    meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+    float minimumDot = axisLength > 0.0f ? 1.0f : -1.0f;
+    for (const glm::vec3 &normal : normals)
+        minimumDot = std::min(minimumDot, glm::dot(normal, meshlet.coneAxis));
+    // past about 85 degrees from the axis the cone would hardly ever cull anything
+    meshlet.coneCutoff = minimumDot <= 0.1f ? 1.0f : std::sqrt(1.0f - minimumDot * minimumDot);
+    return meshlet;
+}
+
+// largest distance between a transformed attribute of a copy and the copy's own, relative to the mesh radius for
+// positions. OBJ files store normals with few digits, so directions get more slack.
+const float DUPLICATE_POSITION_TOLERANCE = 1e-4f;
+const float DUPLICATE_DIRECTION_TOLERANCE = 1e-2f;
+
+// what a rigid transform leaves alone: the triangles, the texture coordinates and the textures
+uint64_t hashRigidInvariants(const MeshData &mesh)
+{
+    uint64_t hash = hashCombine(FNV_OFFSET_BASIS, mesh.vertices.size());
+    hash = hashBytes(mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int), hash);
+    for (const Vertex &vertex : mesh.vertices)
+        hash = hashCombine(hash, vertex.TexCoords);
+    for (const Texture &texture : mesh.textures)
+        hash = hashString(texture.path, hashCombine(hash, texture.type));
+    return hash;
+}
+
+// centroid and an orthonormal basis spanned by two reference vertices, the same two vertices of a copy give the
+// copy's basis
+struct RigidFrame
+{
+    glm::vec3 origin = glm::vec3(0.0f);
+    glm::mat3 basis = glm::mat3(1.0f);
+    float radius = 0.0f;
+    unsigned int first = 0;
+    unsigned int second = 0;
+    bool valid = false;
+};
+
+bool makeBasis(const std::vector<Vertex> &vertices, const glm::vec3 &origin, unsigned int first, unsigned int second,
+               float radius, glm::mat3 &basis)
+{
+    glm::vec3 u = vertices[first].Position - origin;
+    glm::vec3 v = vertices[second].Position - origin;
+    glm::vec3 w = glm::cross(u, v);
+    // vertices on a line (or a point) leave the rotation about it open
+    if (glm::length(u) <= 1e-3f * radius || glm::length(w) <= 1e-3f * radius * glm::length(u))
+        return false;
+    basis[0] = glm::normalize(u);
+    basis[2] = glm::normalize(w);
+    basis[1] = glm::cross(basis[2], basis[0]);
+    return true;
+}
+
+glm::vec3 getCentroid(const std::vector<Vertex> &vertices)
+{
+    glm::vec3 sum(0.0f);
+    for (const Vertex &vertex : vertices)
+        sum += vertex.Position;
+    return sum / static_cast<float>(vertices.size());
+}
+
+RigidFrame makeRigidFrame(const std::vector<Vertex> &vertices)
+{
+    RigidFrame frame;
+    if (vertices.empty())
+        return frame;
+    frame.origin = getCentroid(vertices);
+    // the farthest vertex and the one farthest off the line through it keep the basis well conditioned
+    glm::vec3 u(0.0f);
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        float distance = glm::length(vertices[i].Position - frame.origin);
+        if (distance > frame.radius)
+        {
+            frame.radius = distance;
+            frame.first = i;
+            u = vertices[i].Position - frame.origin;
+        }
+    }
+    float largest = 0.0f;
+    for (unsigned int i = 0; i < vertices.size(); i++)
+    {
+        float offLine = glm::length(glm::cross(u, vertices[i].Position - frame.origin));
+        if (offLine > largest)
+        {
+            largest = offLine;
+            frame.second = i;
+        }
+    }
+    frame.valid = makeBasis(vertices, frame.origin, frame.first, frame.second, frame.radius, frame.basis);
+    return frame;
+}
+
+// whether copy is the mesh moved by a rotation and a translation, which go to placement
+bool matchRigid(const MeshData &mesh, const RigidFrame &frame, const MeshData &copy, glm::mat4 &placement)
+{
+    if (!frame.valid || copy.vertices.size() != mesh.vertices.size() || copy.indices != mesh.indices ||
+        copy.textures.size() != mesh.textures.size())
+        return false;
+    for (size_t i = 0; i < mesh.textures.size(); i++)
+    {
+        if (copy.textures[i].type != mesh.textures[i].type || copy.textures[i].path != mesh.textures[i].path)
+            return false;
+    }
+
+    glm::vec3 origin = getCentroid(copy.vertices);
+    glm::mat3 basis;
+    if (!makeBasis(copy.vertices, origin, frame.first, frame.second, frame.radius, basis))
+        return false;
+    // both bases are right handed, so this is a rotation and mirrored copies fail the check below
+    glm::mat3 rotation = basis * glm::transpose(frame.basis);
+    glm::vec3 translation = origin - rotation * frame.origin;
+
+    float positionTolerance = DUPLICATE_POSITION_TOLERANCE * std::max(frame.radius, 1.0f);
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+        const Vertex &a = mesh.vertices[i];
+        const Vertex &b = copy.vertices[i];
+        if (glm::length(rotation * a.Position + translation - b.Position) > positionTolerance ||
+            glm::length(rotation * a.Normal - b.Normal) > DUPLICATE_DIRECTION_TOLERANCE ||
+            glm::length(rotation * a.Tangent - b.Tangent) > DUPLICATE_DIRECTION_TOLERANCE ||
+            glm::length(rotation * a.Bitangent - b.Bitangent) > DUPLICATE_DIRECTION_TOLERANCE ||
+            a.TexCoords != b.TexCoords)
+            return false;
+    }
+    placement = glm::mat4(rotation);
+    placement[3] = glm::vec4(translation, 1.0f);
+    return true;
+}
+} // namespace
+
+VertexCacheStatistics analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount,
+                                         unsigned int cacheSize)
+{
+    VertexCacheStatistics statistics;
+    VertexCacheSimulator cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+    statistics.triangles = indices.size() / 3;
+    for (size_t i = 0; i < statistics.triangles * 3; i++)
+    {
+        statistics.misses += cache.reference(indices[i]);
+        if (!referenced[indices[i]])
+        {
+            referenced[indices[i]] = true;
+            statistics.vertices++;
+        }
+    }
+    return statistics;
+}
+
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount, unsigned int cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // vertex -> triangle adjacency, liveTriangles counts the triangles of a vertex that weren't emitted yet
+    std::vector<unsigned int> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        liveTriangles[indices[i]]++;
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + liveTriangles[v];
+    std::vector<unsigned int> adjacency(offsets[vertexCount]);
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; i++)
+        adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnds;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> result;
+    result.reserve(triangleCount * 3);
+    unsigned int time = cacheSize + 1;
+    size_t cursor = 0;
+
+    // start with the first vertex that is used at all
+    while (cursor < vertexCount && liveTriangles[cursor] == 0)
+        cursor++;
+    long fanning = static_cast<long>(cursor);
+    while (fanning >= 0 && static_cast<size_t>(fanning) < vertexCount)
+    {
+        // emit all remaining triangles around the fanning vertex
+        candidates.clear();
+        for (unsigned int k = offsets[fanning]; k < offsets[fanning + 1]; k++)
+        {
+            unsigned int triangle = adjacency[k];
+            if (emitted[triangle])
+                continue;
+            emitted[triangle] = true;
+            for (unsigned int j = 0; j < 3; j++)
+            {
+                unsigned int v = indices[triangle * 3 + j];
+                result.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+        }
+
+        // continue with the candidate that stays in the cache longest while its remaining triangles get emitted
+        long next = -1;
+        long bestPriority = -1;
+        for (unsigned int v : candidates)
+        {
+            if (liveTriangles[v] == 0)
+                continue;
+            long priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+
+        if (next < 0)
+        {
+            // dead end: fall back to the most recently referenced vertex that has triangles left, or the next one in
+            // input order
+            while (!deadEnds.empty() && next < 0)
+            {
+                unsigned int v = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[v] > 0)
+                    next = v;
+            }
+            while (next < 0 && cursor < vertexCount)
+            {
+                if (liveTriangles[cursor] > 0)
+                    next = static_cast<long>(cursor);
+                else
+                    cursor++;
+            }
+        }
+        fanning = next;
+    }
+
+    // degenerate leftovers (e.g. a trailing partial triangle) are kept as they were
+    result.insert(result.end(), indices.begin() + result.size(), indices.end());
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices,
+                      float threshold, unsigned int cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // hard boundaries: triangles whose vertices all miss the cache, nothing is lost by starting over there
+    VertexCacheSimulator cache(vertices.size(), cacheSize);
+    std::vector<unsigned int> clusters(1, 0);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (cache.triangleMisses(indices, t) == 3 && t > 0)
+            clusters.push_back(static_cast<unsigned int>(t));
+    }
+
+    // soft boundaries: split every cluster into runs that each start with a cold cache, so they can be drawn in any
+    // order. A run ends as soon as its own ACMR drops to threshold times the ACMR of the whole cluster, which bounds
+    // what the split costs in vertex cache efficiency.
+    std::vector<unsigned int> runs;
+    for (size_t c = 0; c < clusters.size(); c++)
+    {
+        size_t start = clusters[c];
+        size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+        if (start >= end)
+            continue;
+
+        cache.flush();
+        unsigned int clusterMisses = 0;
+        for (size_t t = start; t < end; t++)
+            clusterMisses += cache.triangleMisses(indices, t);
+        float limit = threshold * clusterMisses / (end - start);
+
+        cache.flush();
+        runs.push_back(static_cast<unsigned int>(start));
+        size_t runStart = start;
+        unsigned int runMisses = 0;
+        for (size_t t = start; t < end; t++)
+        {
+            runMisses += cache.triangleMisses(indices, t);
+            if (t + 1 < end && runMisses <= limit * (t + 1 - runStart))
+            {
+                runs.push_back(static_cast<unsigned int>(t + 1));
+                runStart = t + 1;
+                runMisses = 0;
+                cache.flush();
+            }
+        }
+    }
+
+    // area weighted centroid and normal of every run and of the whole mesh
+    std::vector<glm::vec3> runCentroids(runs.size(), glm::vec3(0.0f));
+    std::vector<glm::vec3> runNormals(runs.size(), glm::vec3(0.0f));
+    std::vector<float> runAreas(runs.size(), 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t r = 0; r < runs.size(); r++)
+    {
+        size_t end = r + 1 < runs.size() ? runs[r + 1] : triangleCount;
+        for (size_t t = runs[r]; t < end; t++)
+        {
+            const glm::vec3 &p0 = vertices[indices[t * 3]].Position;
+            const glm::vec3 &p1 = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3 &p2 = vertices[indices[t * 3 + 2]].Position;
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(normal);
+            glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+            runCentroids[r] += centroid * area;
+            runNormals[r] += normal;
+            runAreas[r] += area;
+            meshCentroid += centroid * area;
+            meshArea += area;
+        }
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // runs facing away from the center are on the outside of the mesh, drawing them first occludes the inner ones
+    std::vector<float> sortKeys(runs.size(), 0.0f);
+    for (size_t r = 0; r < runs.size(); r++)
+    {
+        float normalLength = glm::length(runNormals[r]);
+        if (runAreas[r] > 0.0f && normalLength > 0.0f)
+            sortKeys[r] = glm::dot(runCentroids[r] / runAreas[r] - meshCentroid, runNormals[r] / normalLength);
+    }
+    std::vector<unsigned int> order(runs.size());
+    for (size_t r = 0; r < order.size(); r++)
+        order[r] = static_cast<unsigned int>(r);
+    std::stable_sort(order.begin(), order.end(),
+                     [&sortKeys](unsigned int a, unsigned int b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (unsigned int r : order)
+    {
+        size_t end = r + 1 < runs.size() ? runs[r + 1] : triangleCount;
+        result.insert(result.end(), indices.begin() + runs[r] * 3, indices.begin() + end * 3);
+    }
+    result.insert(result.end(), indices.begin() + triangleCount * 3, indices.end());
+    indices.swap(result);
+}
+
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    std::vector<unsigned int> remap(vertices.size(), UINT_MAX);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (unsigned int &index : indices)
+    {
+        if (remap[index] == UINT_MAX)
+        {
+            remap[index] = static_cast<unsigned int>(result.size());
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+}
+
+void buildMeshlets(MeshData &mesh, unsigned int maxVertices, unsigned int maxTriangles)
+{
+    mesh.meshlets.clear();
+    unsigned int begin = mesh.lods.empty() ? 0 : mesh.lods[0].indexOffset;
+    unsigned int end = mesh.lods.empty() ? static_cast<unsigned int>(mesh.indices.size())
+                                         : mesh.lods[0].indexOffset + mesh.lods[0].indexCount;
+    unsigned int triangleCount = (end - begin) / 3;
+    const unsigned int *indices = mesh.indices.data() + begin;
+
+    // unit face normals and the triangles around every vertex
+    std::vector<glm::vec3> normals(triangleCount);
+    std::vector<unsigned int> adjacencyOffsets(mesh.vertices.size() + 1, 0);
+    for (unsigned int t = 0; t < triangleCount; t++)
+    {
+        const glm::vec3 &a = mesh.vertices[indices[t * 3]].Position;
+        glm::vec3 normal = glm::cross(mesh.vertices[indices[t * 3 + 1]].Position - a,
+                                      mesh.vertices[indices[t * 3 + 2]].Position - a);
+        float length = glm::length(normal);
+        normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        for (unsigned int k = 0; k < 3; k++)
+            adjacencyOffsets[indices[t * 3 + k] + 1]++;
+    }
+    for (size_t v = 0; v < mesh.vertices.size(); v++)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    std::vector<unsigned int> adjacency(adjacencyOffsets.back());
+    std::vector<unsigned int> filled(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (unsigned int t = 0; t < triangleCount; t++)
+    {
+        for (unsigned int k = 0; k < 3; k++)
+            adjacency[filled[indices[t * 3 + k]]++] = t;
+    }
+
+    // the meshlet a vertex was last used by
+    std::vector<unsigned int> owner(mesh.vertices.size(), UINT_MAX);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> result;
+    result.reserve(end - begin);
+    std::vector<unsigned int> meshletVertices;
+    unsigned int seed = 0;
+    while (true)
+    {
+        // the next meshlet starts at the first triangle left in the current order, which keeps the cache order
+        while (seed < triangleCount && emitted[seed])
+            seed++;
+        if (seed == triangleCount)
+            break;
+        unsigned int id = static_cast<unsigned int>(mesh.meshlets.size());
+        unsigned int first = static_cast<unsigned int>(result.size());
+        meshletVertices.clear();
+        glm::vec3 normalSum(0.0f);
+        unsigned int triangle = seed;
+        unsigned int triangles = 0;
+        while (true)
+        {
+            emitted[triangle] = true;
+            for (unsigned int k = 0; k < 3; k++)
+            {
+                unsigned int vertex = indices[triangle * 3 + k];
+                result.push_back(vertex);
+                if (owner[vertex] != id)
+                {
+                    owner[vertex] = id;
+                    meshletVertices.push_back(vertex);
+                }
+            }
+            normalSum += normals[triangle];
+            if (++triangles == maxTriangles)
+                break;
+
+            // grow into the neighbour that adds the fewest vertices, ties go to the one facing most like the rest
+            glm::vec3 axis = glm::length(normalSum) > 0.0f ? glm::normalize(normalSum) : glm::vec3(0.0f);
+            unsigned int best = UINT_MAX;
+            unsigned int bestAdded = 4;
+            float bestDot = -2.0f;
+            for (unsigned int vertex : meshletVertices)
+            {
+                for (unsigned int j = adjacencyOffsets[vertex]; j < adjacencyOffsets[vertex + 1]; j++)
+                {
+                    unsigned int candidate = adjacency[j];
+                    if (emitted[candidate])
+                        continue;
+                    unsigned int added = 0;
+                    for (unsigned int k = 0; k < 3; k++)
+                        added += owner[indices[candidate * 3 + k]] != id ? 1 : 0;
+                    float alignment = glm::dot(normals[candidate], axis);
+                    if (meshletVertices.size() + added > maxVertices)
+                        continue;
+                    if (added < bestAdded || (added == bestAdded && alignment > bestDot))
+                    {
+                        best = candidate;
+                        bestAdded = added;
+                        bestDot = alignment;
+                    }
+                }
+            }
+            if (best == UINT_MAX)
+                break;
+            triangle = best;
+        }
+
+        // growing jumps around the post-transform cache, the meshlet's triangles are reordered for it on their own
+        // (numbered locally, so that it doesn't cost a pass over all vertices)
+        std::vector<unsigned int> local(result.begin() + first, result.end());
+        for (unsigned int &vertex : local)
+            vertex = static_cast<unsigned int>(std::find(meshletVertices.begin(), meshletVertices.end(), vertex) -
+                                               meshletVertices.begin());
+        optimizeVertexCache(local, meshletVertices.size());
+        for (size_t i = 0; i < local.size(); i++)
+            result[first + i] = meshletVertices[local[i]];
+        mesh.meshlets.push_back(
+            makeMeshlet(mesh.vertices, result, first, static_cast<unsigned int>(result.size()) - first));
+    }
+
+    std::copy(result.begin(), result.end(), mesh.indices.begin() + begin);
+    for (Meshlet &meshlet : mesh.meshlets)
+        meshlet.indexOffset += begin;
+}
+
+void deduplicateMeshes(std::vector<MeshData> &meshes)
+{
+    std::vector<MeshData> unique;
+    std::vector<RigidFrame> frames;
+    // unique meshes by the hash of their rigid invariants
+    std::unordered_map<uint64_t, std::vector<size_t>> candidates;
+    for (MeshData &mesh : meshes)
+    {
+        std::vector<size_t> &bucket = candidates[hashRigidInvariants(mesh)];
+        bool merged = false;
+        for (size_t j = 0; j < bucket.size() && !merged; j++)
+        {
+            MeshData &original = unique[bucket[j]];
+            glm::mat4 placement;
+            if (matchRigid(original, frames[bucket[j]], mesh, placement))
+            {
+                if (original.placements.empty())
+                    original.placements.push_back(glm::mat4(1.0f));
+                original.placements.push_back(placement);
+                merged = true;
+            }
+        }
+        if (merged)
+            continue;
+        bucket.push_back(unique.size());
+        frames.push_back(makeRigidFrame(mesh.vertices));
+        unique.push_back(std::move(mesh));
+    }
+    meshes.swap(unique);
+}
+
+void optimizeMeshes(std::vector<MeshData> &meshes, unsigned int flags, const std::string &name)
+{
+    VertexCacheStatistics original = analyzeMeshes(meshes);
+    std::cout << "MESH_OPTIMIZER:: " << name << ": " << meshes.size() << " meshes, " << original.triangles
+              << " triangles, cache size " << MESH_OPTIMIZER_CACHE_SIZE << std::endl;
+    printStatistics("original", original);
+
+    // first, the copies don't need any of the other passes
+    if (flags & MESH_OPTIMIZE_DEDUPLICATE)
+    {
+        size_t count = meshes.size();
+        deduplicateMeshes(meshes);
+        std::ostringstream line;
+        line << "    " << std::left << std::setw(14) << "duplicates" << count - meshes.size() << " of " << count
+             << " meshes merged into placements of " << meshes.size();
+        std::cout << line.str() << std::endl;
+    }
+
+    if (flags & MESH_OPTIMIZE_VERTEX_CACHE)
+    {
+        for (MeshData &mesh : meshes)
+            optimizeVertexCache(mesh.indices, mesh.vertices.size());
+        printStatistics("vertex cache", analyzeMeshes(meshes));
+
+        if (flags & MESH_OPTIMIZE_OVERDRAW)
+        {
+            for (MeshData &mesh : meshes)
+                optimizeOverdraw(mesh.indices, mesh.vertices);
+            printStatistics("overdraw", analyzeMeshes(meshes));
+        }
+    }
+
+    // before the LODs are appended, the meshlets are ranges of the first level
+    if (flags & MESH_OPTIMIZE_MESHLETS)
+    {
+        size_t meshlets = 0;
+        for (MeshData &mesh : meshes)
+        {
+            buildMeshlets(mesh);
+            meshlets += mesh.meshlets.size();
+        }
+        std::ostringstream line;
+        line << "    " << std::left << std::setw(14) << "meshlets" << meshlets;
+        std::cout << line.str() << std::endl;
+        printStatistics("meshlets", analyzeMeshes(meshes));
+    }
+
+    if (flags & MESH_OPTIMIZE_GENERATE_LODS)
+    {
+        std::vector<size_t> triangles;
+        for (MeshData &mesh : meshes)
+        {
+            generateLods(mesh);
+            for (size_t l = 0; l < mesh.lods.size(); l++)
+            {
+                if (triangles.size() <= l)
+                    triangles.resize(l + 1, 0);
+                triangles[l] += mesh.lods[l].indexCount / 3;
+            }
+        }
+        std::ostringstream line;
+        line << "    " << std::left << std::setw(14) << "lods" << "triangles";
+        for (size_t count : triangles)
+            line << " " << count;
+        std::cout << line.str() << std::endl;
+    }
+
+    if (flags & MESH_OPTIMIZE_VERTEX_FETCH)
+    {
+        for (MeshData &mesh : meshes)
+            optimizeVertexFetch(mesh.vertices, mesh.indices);
+        printStatistics("vertex fetch", analyzeMeshes(meshes));
+    }
+}
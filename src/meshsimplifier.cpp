@@ -0,0 +1,445 @@
+#include <rg/meshsimplifier.hpp>
+#include <rg/hash.hpp>
+#include <rg/meshoptimizer.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <unordered_map>
+
+namespace
+{
+const unsigned int NONE = UINT_MAX;
+// open edges pull harder than faces, otherwise borders and seams erode first
+const double EDGE_WEIGHT = 10.0;
+
+enum VertexKind
+{
+    KIND_MANIFOLD, // interior vertex, collapses anywhere
+    KIND_BORDER,   // on exactly one open border, collapses along it
+    KIND_SEAM,     // shared by exactly two vertices with different attributes, both collapse along the seam
+    KIND_LOCKED    // anything more complex, never moves
+};
+
+// symmetric 4x4 matrix of the sum of squared distances to a set of planes
+struct Quadric
+{
+    double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double weight = 0;
+
+    // plane n.p + d = 0 with a unit normal
+    void addPlane(const glm::vec3 &n, float d, double w)
+    {
+        a00 += w * n.x * n.x;
+        a11 += w * n.y * n.y;
+        a22 += w * n.z * n.z;
+        a01 += w * n.x * n.y;
+        a02 += w * n.x * n.z;
+        a12 += w * n.y * n.z;
+        b0 += w * n.x * d;
+        b1 += w * n.y * d;
+        b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    Quadric &operator+=(const Quadric &q)
+    {
+        a00 += q.a00, a11 += q.a11, a22 += q.a22, a01 += q.a01, a02 += q.a02, a12 += q.a12;
+        b0 += q.b0, b1 += q.b1, b2 += q.b2, c += q.c;
+        weight += q.weight;
+        return *this;
+    }
+
+    // weighted mean squared distance of the point to the planes
+    double evaluate(const glm::vec3 &p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double r = a00 * x * x + a11 * y * y + a22 * z * z + 2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                   2 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0 ? std::abs(r) / weight : 0.0;
+    }
+};
+
+struct PositionKey
+{
+    glm::vec3 position;
+
+    bool operator==(const PositionKey &other) const
+    {
+        return position.x == other.position.x && position.y == other.position.y && position.z == other.position.z;
+    }
+};
+
+struct PositionKeyHash
+{
+    size_t operator()(const PositionKey &key) const
+    {
+        return static_cast<size_t>(hashBytes(&key.position, sizeof(key.position)));
+    }
+};
+
+struct Collapse
+{
+    unsigned int from;
+    unsigned int to;
+    double error;
+};
+
+// outgoing half-edges of every vertex, to tell open edges from shared ones
+class EdgeAdjacency
+{
+  public:
+    EdgeAdjacency(const std::vector<unsigned int> &indices, size_t vertexCount) : offsets(vertexCount + 1, 0)
+    {
+        for (unsigned int index : indices)
+            offsets[index + 1]++;
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] += offsets[v];
+        targets.resize(indices.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (unsigned int e = 0; e < 3; e++)
+                targets[fill[indices[i + e]]++] = indices[i + (e + 1) % 3];
+        }
+    }
+
+    bool hasEdge(unsigned int a, unsigned int b) const
+    {
+        for (unsigned int k = offsets[a]; k < offsets[a + 1]; k++)
+        {
+            if (targets[k] == b)
+                return true;
+        }
+        return false;
+    }
+
+  private:
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> targets;
+};
+
+class Simplifier
+{
+  public:
+    Simplifier(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices)
+        : vertices(vertices), indices(indices), remap(vertices.size()), wedge(vertices.size()),
+          openIn(vertices.size(), NONE), openOut(vertices.size(), NONE), kinds(vertices.size(), KIND_LOCKED),
+          quadrics(vertices.size())
+    {
+        buildPositionRings();
+        classifyVertices();
+        computeQuadrics();
+    }
+
+    std::vector<unsigned int> run(size_t targetIndexCount, float &error)
+    {
+        double maxError = 0.0;
+        while (indices.size() > targetIndexCount)
+        {
+            if (!collapsePass(targetIndexCount, maxError))
+                break;
+        }
+        error = static_cast<float>(std::sqrt(maxError));
+        return indices;
+    }
+
+  private:
+    const std::vector<Vertex> &vertices;
+    std::vector<unsigned int> indices;
+    // remap: first vertex with the same position, wedge: ring of all vertices with that position
+    std::vector<unsigned int> remap;
+    std::vector<unsigned int> wedge;
+    // the single open edge ending/starting at a vertex, NONE if there is none and the vertex itself if there are more
+    std::vector<unsigned int> openIn;
+    std::vector<unsigned int> openOut;
+    std::vector<VertexKind> kinds;
+    // indexed by position (remap)
+    std::vector<Quadric> quadrics;
+
+    const glm::vec3 &position(unsigned int v) const
+    {
+        return vertices[v].Position;
+    }
+
+    void buildPositionRings()
+    {
+        std::unordered_map<PositionKey, unsigned int, PositionKeyHash> firstVertex;
+        for (unsigned int v = 0; v < vertices.size(); v++)
+        {
+            std::unordered_map<PositionKey, unsigned int, PositionKeyHash>::iterator it =
+                firstVertex.find(PositionKey{position(v)});
+            if (it == firstVertex.end())
+            {
+                firstVertex[PositionKey{position(v)}] = v;
+                remap[v] = v;
+                wedge[v] = v;
+            }
+            else
+            {
+                unsigned int r = it->second;
+                remap[v] = r;
+                wedge[v] = wedge[r];
+                wedge[r] = v;
+            }
+        }
+    }
+
+    void classifyVertices()
+    {
+        EdgeAdjacency adjacency(indices, vertices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (unsigned int e = 0; e < 3; e++)
+            {
+                unsigned int a = indices[i + e], b = indices[i + (e + 1) % 3];
+                if (a == b || adjacency.hasEdge(b, a))
+                    continue;
+                openOut[a] = openOut[a] == NONE ? b : a;
+                openIn[b] = openIn[b] == NONE ? a : b;
+            }
+        }
+
+        for (unsigned int v = 0; v < vertices.size(); v++)
+        {
+            if (remap[v] != v)
+                continue;
+            unsigned int w = wedge[v];
+            if (w == v)
+            {
+                // a single vertex at this position: interior, or on one open border
+                if (openIn[v] == NONE && openOut[v] == NONE)
+                    kinds[v] = KIND_MANIFOLD;
+                else if (openIn[v] != NONE && openOut[v] != NONE && openIn[v] != v && openOut[v] != v)
+                    kinds[v] = KIND_BORDER;
+            }
+            else if (wedge[w] == v)
+            {
+                // two vertices at this position: a seam if each has one open edge pair, mirrored by the other one
+                bool single = openIn[v] != NONE && openOut[v] != NONE && openIn[v] != v && openOut[v] != v &&
+                              openIn[w] != NONE && openOut[w] != NONE && openIn[w] != w && openOut[w] != w;
+                if (single && remap[openOut[v]] == remap[openIn[w]] && remap[openIn[v]] == remap[openOut[w]])
+                    kinds[v] = KIND_SEAM;
+            }
+        }
+        for (unsigned int v = 0; v < vertices.size(); v++)
+            kinds[v] = kinds[remap[v]];
+    }
+
+    void computeQuadrics()
+    {
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            const glm::vec3 &p0 = position(indices[i]), &p1 = position(indices[i + 1]), &p2 = position(indices[i + 2]);
+            glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+            float length = glm::length(normal);
+            if (length == 0.0f)
+                continue;
+            normal /= length;
+            float area = length * 0.5f;
+            for (unsigned int e = 0; e < 3; e++)
+                quadrics[remap[indices[i + e]]].addPlane(normal, -glm::dot(normal, p0), area);
+
+            // open edges get a plane through them, perpendicular to the face, that keeps them in place
+            for (unsigned int e = 0; e < 3; e++)
+            {
+                unsigned int a = indices[i + e], b = indices[i + (e + 1) % 3];
+                if (openOut[a] != b && !(openOut[a] == a && kinds[a] == KIND_LOCKED))
+                    continue;
+                glm::vec3 edge = position(b) - position(a);
+                float edgeLength = glm::length(edge);
+                if (edgeLength == 0.0f)
+                    continue;
+                glm::vec3 edgeNormal = glm::normalize(glm::cross(edge, normal));
+                double weight = EDGE_WEIGHT * edgeLength * edgeLength;
+                float d = -glm::dot(edgeNormal, position(a));
+                quadrics[remap[a]].addPlane(edgeNormal, d, weight);
+                quadrics[remap[b]].addPlane(edgeNormal, d, weight);
+            }
+        }
+    }
+
+    // vertex that the twin of seam vertex a moves to when a collapses onto b
+    unsigned int seamTarget(unsigned int a, unsigned int b) const
+    {
+        unsigned int w = wedge[a];
+        return openOut[a] == b ? openIn[w] : openOut[w];
+    }
+
+    bool canCollapse(unsigned int a, unsigned int b) const
+    {
+        switch (kinds[a])
+        {
+        case KIND_MANIFOLD:
+            return true;
+        case KIND_BORDER:
+            return (openOut[a] == b || openIn[a] == b) && kinds[b] != KIND_MANIFOLD;
+        case KIND_SEAM: {
+            if ((openOut[a] != b && openIn[a] != b) || kinds[b] == KIND_MANIFOLD)
+                return false;
+            unsigned int s = seamTarget(a, b);
+            return s != NONE && remap[s] == remap[b];
+        }
+        default:
+            return false;
+        }
+    }
+
+    // triangles around position ra must not turn over when ra moves onto the position of rb
+    bool hasFlips(const std::vector<unsigned int> &offsets, const std::vector<unsigned int> &triangles, unsigned int ra,
+                  unsigned int rb, unsigned int &removed) const
+    {
+        removed = 0;
+        for (unsigned int k = offsets[ra]; k < offsets[ra + 1]; k++)
+        {
+            size_t t = triangles[k] * 3;
+            unsigned int r[3] = {remap[indices[t]], remap[indices[t + 1]], remap[indices[t + 2]]};
+            if (r[0] == rb || r[1] == rb || r[2] == rb)
+            {
+                removed++;
+                continue;
+            }
+            glm::vec3 p[3] = {position(r[0]), position(r[1]), position(r[2])};
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            for (unsigned int j = 0; j < 3; j++)
+            {
+                if (r[j] == ra)
+                    p[j] = position(rb);
+            }
+            glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+            if (glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+
+    // collapses a batch of independent edges, cheapest first. Returns false when nothing could be collapsed.
+    bool collapsePass(size_t targetIndexCount, double &maxError)
+    {
+        std::vector<Collapse> collapses;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (unsigned int e = 0; e < 3; e++)
+            {
+                unsigned int a = indices[i + e], b = indices[i + (e + 1) % 3];
+                if (remap[a] == remap[b])
+                    continue;
+                Quadric q = quadrics[remap[a]];
+                q += quadrics[remap[b]];
+                if (canCollapse(a, b))
+                    collapses.push_back(Collapse{a, b, q.evaluate(position(b))});
+                if (canCollapse(b, a))
+                    collapses.push_back(Collapse{b, a, q.evaluate(position(a))});
+            }
+        }
+        if (collapses.empty())
+            return false;
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse &x, const Collapse &y) { return x.error < y.error; });
+
+        // triangles around every position
+        std::vector<unsigned int> offsets(vertices.size() + 1, 0);
+        for (unsigned int index : indices)
+            offsets[remap[index] + 1]++;
+        for (size_t v = 0; v < vertices.size(); v++)
+            offsets[v + 1] += offsets[v];
+        std::vector<unsigned int> triangles(indices.size());
+        std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            triangles[fill[remap[indices[i]]]++] = static_cast<unsigned int>(i / 3);
+
+        std::vector<unsigned int> collapseRemap(vertices.size());
+        for (unsigned int v = 0; v < vertices.size(); v++)
+            collapseRemap[v] = v;
+        // positions touched in this pass, their quadrics and neighbourhoods are stale until the next one
+        std::vector<bool> locked(vertices.size(), false);
+        size_t goal = (indices.size() - targetIndexCount) / 3;
+        size_t removedTotal = 0;
+        bool collapsed = false;
+        for (const Collapse &collapse : collapses)
+        {
+            if (removedTotal >= goal)
+                break;
+            unsigned int a = collapse.from, b = collapse.to;
+            unsigned int ra = remap[a], rb = remap[b];
+            if (locked[ra] || locked[rb])
+                continue;
+            unsigned int removed;
+            if (hasFlips(offsets, triangles, ra, rb, removed))
+                continue;
+
+            if (kinds[a] == KIND_SEAM)
+            {
+                collapseRemap[a] = b;
+                collapseRemap[wedge[a]] = seamTarget(a, b);
+            }
+            else
+                collapseRemap[a] = b;
+            quadrics[rb] += quadrics[ra];
+            locked[ra] = locked[rb] = true;
+            removedTotal += removed;
+            maxError = std::max(maxError, collapse.error);
+            collapsed = true;
+        }
+        if (!collapsed)
+            return false;
+
+        // move the collapsed vertices and drop the triangles that became degenerate
+        size_t write = 0;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            unsigned int i0 = collapseRemap[indices[i]], i1 = collapseRemap[indices[i + 1]],
+                         i2 = collapseRemap[indices[i + 2]];
+            if (remap[i0] == remap[i1] || remap[i1] == remap[i2] || remap[i0] == remap[i2])
+                continue;
+            indices[write++] = i0;
+            indices[write++] = i1;
+            indices[write++] = i2;
+        }
+        indices.resize(write);
+        return true;
+    }
+};
+} // namespace
+
+std::vector<unsigned int> simplifyMesh(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                                       size_t targetIndexCount, float &error)
+{
+    error = 0.0f;
+    if (indices.size() <= targetIndexCount)
+        return indices;
+    Simplifier simplifier(vertices, indices);
+    return simplifier.run(targetIndexCount, error);
+}
+
+void generateLods(MeshData &mesh, unsigned int maxLods, float ratio)
+{
+    if (mesh.lods.empty())
+        mesh.lods.push_back(MeshLod{0, static_cast<unsigned int>(mesh.indices.size()), 0.0f});
+    // every level is simplified from the full mesh, so its error is measured against the original surface
+    std::vector<unsigned int> base(mesh.indices.begin() + mesh.lods[0].indexOffset,
+                                   mesh.indices.begin() + mesh.lods[0].indexOffset + mesh.lods[0].indexCount);
+    size_t previousCount = base.size();
+    while (mesh.lods.size() < maxLods)
+    {
+        size_t target = static_cast<size_t>(previousCount / 3 * ratio) * 3;
+        if (target < 3)
+            break;
+        float error;
+        std::vector<unsigned int> lod = simplifyMesh(mesh.vertices, base, target, error);
+        // stop once seams, borders and flips keep the simplifier from making real progress
+        if (lod.empty() || lod.size() > previousCount * 9 / 10)
+            break;
+        optimizeVertexCache(lod, mesh.vertices.size());
+
+        MeshLod level;
+        level.indexOffset = static_cast<unsigned int>(mesh.indices.size());
+        level.indexCount = static_cast<unsigned int>(lod.size());
+        level.error = std::max(error, mesh.lods.back().error);
+        mesh.lods.push_back(level);
+        mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+        previousCount = lod.size();
+    }
+}
@@ -1,41 +1,406 @@
 #include <rg/model.hpp>
+#include <rg/assetregistry.hpp>
+#include <rg/assimpio.hpp>
+#include <rg/meshcache.hpp>
 
-void Model::Draw(Shader &shader)
+#include <algorithm>
+
+void Model::Draw(Shader &shader, const glm::mat4 &model)
+{
+    // streamed models are skipped until all their meshes and textures have been uploaded
+    if (!ready)
+        return;
+    samplers.apply(shader);
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        for (unsigned int p = 0; p < meshes[i].getPlacementCount(); p++)
+        {
+            glm::mat4 placed = model * meshes[i].getPlacement(p);
+            shader.setMat4("model", placed);
+            shader.setMat3("normalMatrix", getNormalMatrix(placed));
+            meshes[i].Draw(shader);
+        }
+    }
+}
+
+void Model::Draw(Shader &shader, const LodSelector &selector, const glm::mat4 &model, LodState &state)
+{
+    state.triangles = 0;
+    if (!ready)
+        return;
+    samplers.apply(shader);
+    state.levels.resize(meshes.size(), 0);
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        placedModels.clear();
+        placeModels(meshes[i], &model, 1, placedModels);
+        state.levels[i] = selector.select(meshes[i], placedModels.data(), placedModels.size(), state.levels[i]);
+        for (const glm::mat4 &placed : placedModels)
+        {
+            shader.setMat4("model", placed);
+            shader.setMat3("normalMatrix", getNormalMatrix(placed));
+            meshes[i].Draw(shader, state.levels[i]);
+        }
+        state.triangles += meshes[i].getLod(state.levels[i]).indexCount / 3 * placedModels.size();
+    }
+}
+
+void Model::submit(RenderQueue &queue, Shader &shader, const LodSelector &selector, const glm::mat4 &model,
+                   LodState &state, GLenum cullFace)
+{
+    state.triangles = 0;
+    if (!ready)
+        return;
+    samplers.apply(shader);
+    cull(queue, &model, 1);
+    state.levels.resize(meshes.size(), 0);
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        if (!meshVisible[i])
+            continue;
+        // without an instance buffer every visible copy is a packet of its own
+        const glm::mat4 *copies = &model;
+        size_t copyCount = 1;
+        if (meshes[i].getPlacementCount() > 1)
+        {
+            copies = &placedModels[placedFirst[i]];
+            copyCount = placedFirst[i + 1] - placedFirst[i];
+        }
+        state.levels[i] = selector.select(meshes[i], copies, copyCount, state.levels[i]);
+        for (size_t j = 0; j < copyCount; j++)
+        {
+            DrawPacket &packet = queue.submit(shader, meshes[i], copies[j]);
+            packet.lod = state.levels[i];
+            packet.cullFace = cullFace;
+            queue.cullMeshlets(packet, copies[j]);
+        }
+        state.triangles += meshes[i].getLod(state.levels[i]).indexCount / 3 * copyCount;
+    }
+}
+
+void Model::Draw(Shader &shader, InstanceBuffer &instances, const std::vector<glm::mat4> &models)
+{
+    if (!ready || models.empty())
+        return;
+    samplers.apply(shader);
+    unsigned int first = instances.append(models);
+    for (unsigned int i = 0; i < meshes.size(); i++)
+    {
+        if (meshes[i].getPlacementCount() == 1)
+        {
+            meshes[i].DrawInstanced(shader, instances, first, static_cast<unsigned int>(models.size()));
+            continue;
+        }
+        // the copies of a mesh are instances of it as well
+        placedModels.clear();
+        placeModels(meshes[i], models.data(), models.size(), placedModels);
+        meshes[i].DrawInstanced(shader, instances, instances.append(placedModels),
+                                static_cast<unsigned int>(placedModels.size()));
+    }
+}
+
+void Model::submit(RenderQueue &queue, Shader &shader, const LodSelector &selector, InstanceBuffer &instances,
+                   const std::vector<glm::mat4> &models, LodState &state, GLenum cullFace)
 {
+    state.triangles = 0;
+    if (!ready || models.empty())
+        return;
+    samplers.apply(shader);
+    cull(queue, models.data(), models.size());
+    if (visibleModels.empty())
+        return;
+    state.levels.resize(meshes.size(), 0);
+    state.copyLevels.resize(meshes.size());
+    // uploaded once for all meshes without placements whose visible instances all end up at the same level
+    bool visibleAppended = false;
+    unsigned int visibleFirst = 0;
     for (unsigned int i = 0; i < meshes.size(); i++)
-        meshes[i].Draw(shader);
+    {
+        if (!meshVisible[i])
+            continue;
+        const Mesh &mesh = meshes[i];
+        // a mesh without placements draws every visible instance, one with placements its visible copies
+        unsigned int placements = mesh.getPlacementCount();
+        const glm::mat4 *copies = visibleModels.data();
+        const size_t *copyIndices = visibleIndices.data();
+        size_t count = visibleModels.size();
+        if (placements > 1)
+        {
+            copies = &placedModels[placedFirst[i]];
+            copyIndices = &placedCopies[placedFirst[i]];
+            count = placedFirst[i + 1] - placedFirst[i];
+        }
+
+        // every copy continues from its own level of the last frame, the copies of a level become one packet
+        std::vector<unsigned int> &levels = state.copyLevels[i];
+        levels.resize(models.size() * placements, 0);
+        if (lodBuckets.size() < mesh.getLodCount())
+            lodBuckets.resize(mesh.getLodCount());
+        for (std::vector<glm::mat4> &bucket : lodBuckets)
+            bucket.clear();
+        for (size_t j = 0; j < count; j++)
+        {
+            unsigned int &level = levels[copyIndices[j]];
+            level = selector.select(mesh, copies[j], level);
+            lodBuckets[level].push_back(copies[j]);
+        }
+
+        state.levels[i] = mesh.getLodCount() - 1;
+        for (unsigned int lod = 0; lod < mesh.getLodCount(); lod++)
+        {
+            const std::vector<glm::mat4> &bucket = lodBuckets[lod];
+            if (bucket.empty())
+                continue;
+            state.levels[i] = std::min(state.levels[i], lod);
+            unsigned int first;
+            if (placements == 1 && bucket.size() == visibleModels.size())
+            {
+                if (!visibleAppended)
+                    visibleFirst = instances.append(visibleModels);
+                visibleAppended = true;
+                first = visibleFirst;
+            }
+            else
+            {
+                first = instances.append(bucket);
+            }
+            DrawPacket &packet = queue.submit(shader, meshes[i], bucket[0]);
+            // sorted by the nearest instance
+            for (const glm::mat4 &copy : bucket)
+            {
+                glm::vec3 center = glm::vec3(copy * glm::vec4(mesh.getBoundingCenter(), 1.0f));
+                packet.depth = std::min(packet.depth, queue.getViewDepth(center));
+            }
+            packet.lod = lod;
+            packet.cullFace = cullFace;
+            packet.instances = &instances;
+            packet.firstInstance = first;
+            packet.instanceCount = static_cast<unsigned int>(bucket.size());
+            // a single instance draws only its visible meshlets
+            queue.cullMeshlets(packet, bucket[0]);
+            state.triangles += mesh.getLod(lod).indexCount / 3 * static_cast<unsigned int>(bucket.size());
+        }
+    }
+}
+
+void Model::Draw(Shader &shader, GpuCuller &culler, const std::vector<glm::mat4> &models)
+{
+    if (!ready || models.empty())
+        return;
+    samplers.apply(shader);
+    culler.draw(shader, meshes, models);
+}
+
+void Model::placeModels(const Mesh &mesh, const glm::mat4 *models, size_t count, std::vector<glm::mat4> &placed)
+{
+    for (size_t j = 0; j < count; j++)
+    {
+        for (unsigned int p = 0; p < mesh.getPlacementCount(); p++)
+            placed.push_back(models[j] * mesh.getPlacement(p));
+    }
+}
+
+void Model::cull(RenderQueue &queue, const glm::mat4 *models, size_t count)
+{
+    const Frustum &frustum = queue.getFrustum();
+    CullingStats instanceStats, meshStats;
+
+    // instances first, by the box around all meshes
+    BoundingBox box = getBoundingBox();
+    cullingBoxes.clear();
+    for (size_t j = 0; j < count; j++)
+        cullingBoxes.add(box.minimum, box.maximum, models[j]);
+    instanceStats.visible = static_cast<unsigned int>(cullingBoxes.cull(frustum, cullingResults));
+    instanceStats.culled = static_cast<unsigned int>(count) - instanceStats.visible;
+    visibleModels.clear();
+    visibleIndices.clear();
+    for (size_t j = 0; j < count; j++)
+    {
+        if (cullingResults[j])
+        {
+            visibleModels.push_back(models[j]);
+            visibleIndices.push_back(j);
+        }
+    }
+
+    // then every copy of every mesh in the remaining instances, a mesh is drawn if any copy of it is visible
+    placedModels.clear();
+    cullingBoxes.clear();
+    size_t copyCount = 0;
+    for (const Mesh &mesh : meshes)
+    {
+        size_t first = placedModels.size();
+        placeModels(mesh, visibleModels.data(), visibleModels.size(), placedModels);
+        for (size_t j = first; j < placedModels.size(); j++)
+            cullingBoxes.add(mesh.getBoundingBoxMin(), mesh.getBoundingBoxMax(), placedModels[j]);
+        copyCount += mesh.getPlacementCount();
+    }
+    meshStats.visible = static_cast<unsigned int>(cullingBoxes.cull(frustum, cullingResults));
+    meshStats.culled = static_cast<unsigned int>(copyCount * visibleModels.size()) - meshStats.visible;
+    // only the visible copies of meshes with placements are kept
+    meshVisible.assign(meshes.size(), 0);
+    placedFirst.assign(meshes.size() + 1, 0);
+    placedCopies.clear();
+    size_t result = 0, kept = 0;
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        placedFirst[i] = kept;
+        size_t placements = meshes[i].getPlacementCount();
+        size_t copies = placements * visibleModels.size();
+        for (size_t j = 0; j < copies; j++, result++)
+        {
+            if (!cullingResults[result])
+                continue;
+            meshVisible[i] = 1;
+            if (placements > 1)
+            {
+                placedModels[kept++] = placedModels[result];
+                placedCopies.push_back(visibleIndices[j / placements] * placements + j % placements);
+            }
+        }
+    }
+    placedFirst[meshes.size()] = kept;
+    placedModels.resize(kept);
+    queue.addCullingStats(meshStats, instanceStats);
 }
 
 void Model::SetShaderTextureNamePrefix(std::string prefix)
 {
-    for (Mesh &mesh : meshes)
+    // the sampler names are hashed here once, drawing only compares the program's layout with them
+    samplers = MaterialSamplers(prefix);
+}
+
+BoundingBox Model::getBoundingBox() const
+{
+    BoundingBox box;
+    for (const Mesh &mesh : meshes)
     {
-        mesh.glslIdentifierPrefix = prefix;
+        BoundingBox meshBox(mesh.getBoundingBoxMin(), mesh.getBoundingBoxMax());
+        for (unsigned int p = 0; p < mesh.getPlacementCount(); p++)
+            box.expand(meshBox.transformed(mesh.getPlacement(p)));
     }
+    return box;
+}
+
+void Model::addOccluders(OcclusionCuller &culler, const glm::mat4 &model) const
+{
+    for (const Mesh &mesh : meshes)
+    {
+        if (mesh.getOccluder().isEmpty())
+            continue;
+        for (unsigned int p = 0; p < mesh.getPlacementCount(); p++)
+            culler.addOccluder(mesh.getOccluder(), model * mesh.getPlacement(p));
+    }
+}
+
+size_t Model::getGpuMemory() const
+{
+    size_t bytes = 0;
+    for (const Mesh &mesh : meshes)
+        bytes += mesh.getGpuMemory();
+    return bytes;
+}
+
+size_t Model::getCpuMemory() const
+{
+    size_t bytes = 0;
+    for (const Mesh &mesh : meshes)
+        bytes += mesh.getCpuMemory();
+    return bytes;
 }
 
 void Model::loadModel(std::string const &path)
 {
-    // read file via ASSIMP
+    // retrieve the directory path of the filepath
+    directory = path.substr(0, path.find_last_of('/'));
+
+    // warm start: skip ASSIMP entirely if an up to date mesh cache exists
+    if (!loadFromCache(path))
+        importModel(path);
+
+    // the images were decoded on worker threads while the meshes were built, only the upload is left
+    uploadPendingTextures();
+}
+
+void Model::importModel(std::string const &path)
+{
+    std::vector<MeshData> data;
+    if (!importMeshData(path, data))
+        return;
+
+    meshes.reserve(data.size());
+    for (MeshData &mesh : data)
+        addMesh(mesh);
+}
+
+bool Model::loadFromCache(std::string const &path)
+{
+    MeshCache cache;
+    if (!cache.open(path, ImportFlags, OptimizeFlags))
+        return false;
+
+    meshes.reserve(cache.getMeshes().size());
+    for (const CachedMesh &cached : cache.getMeshes())
+    {
+        std::vector<Texture> textures;
+        for (const Texture &ref : cached.textures)
+            textures.push_back(loadTexture(ref.path, ref.type));
+        std::vector<MeshLod> lods(cached.lods, cached.lods + cached.lodCount);
+        meshes.push_back(Mesh(cached.vertices, cached.vertexCount, cached.indices, cached.indexCount,
+                              std::move(textures), vertexFormat, std::move(lods), retention));
+        meshes.back().setMeshlets(std::vector<Meshlet>(cached.meshlets, cached.meshlets + cached.meshletCount));
+        meshes.back().setPlacements(
+            std::vector<glm::mat4>(cached.placements, cached.placements + cached.placementCount));
+    }
+    return true;
+}
+
+bool Model::importMeshData(std::string const &path, std::vector<MeshData> &data)
+{
+    // read file via ASSIMP, through the file system so it can come from an asset pack (the importer owns the handler)
     Assimp::Importer importer;
-    const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-                                                       aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    FileSystemIOSystem *files = new FileSystemIOSystem();
+    importer.SetIOHandler(files);
+    const aiScene *scene = importer.ReadFile(path, ImportFlags);
     // check for errors
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
     {
         std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
-        return;
+        return false;
     }
-    // retrieve the directory path of the filepath
-    directory = path.substr(0, path.find_last_of('/'));
 
     // process ASSIMP's root node recursively
-    processNode(scene->mRootNode, scene);
+    processNode(scene->mRootNode, scene, data);
+
+    // reorder for the vertex cache, overdraw and fetch locality and build the LOD chain once, the cache stores the
+    // result
+    optimizeMeshes(data, OptimizeFlags, path);
+
+    // the material libraries ASSIMP read go into the cache as well, editing one invalidates it
+    if (!MeshCache::write(path, ImportFlags, OptimizeFlags, data, files->getOpenedPaths()))
+        std::cout << "WARNING::MESH_CACHE:: failed to write " << MeshCache::getCachePath(path) << std::endl;
+    return true;
+}
+
+bool Model::readMeshData(std::string const &path, std::vector<MeshData> &data)
+{
+    return MeshCache::read(path, ImportFlags, OptimizeFlags, data) || importMeshData(path, data);
+}
+
+void Model::addMesh(MeshData &data)
+{
+    std::vector<Texture> textures;
+    for (const Texture &ref : data.textures)
+        textures.push_back(loadTexture(ref.path, ref.type));
+    meshes.push_back(Mesh(std::move(data.vertices), std::move(data.indices), std::move(textures), vertexFormat,
+                          std::move(data.lods), retention));
+    meshes.back().setMeshlets(std::move(data.meshlets));
+    meshes.back().setPlacements(std::move(data.placements));
 }
 
 // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this
 // process on its children nodes (if any).
-void Model::processNode(aiNode *node, const aiScene *scene)
+void Model::processNode(aiNode *node, const aiScene *scene, std::vector<MeshData> &data)
 {
     // process each mesh located at the current node
     for (unsigned int i = 0; i < node->mNumMeshes; i++)
@@ -43,21 +408,22 @@ void Model::processNode(aiNode *node, const aiScene *scene)
         // the node object only contains indices to index the actual objects in the scene.
         // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
         aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        data.push_back(processMesh(mesh, scene));
     }
     // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
     for (unsigned int i = 0; i < node->mNumChildren; i++)
     {
-        processNode(node->mChildren[i], scene);
+        processNode(node->mChildren[i], scene, data);
     }
 }
 
-Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
+MeshData Model::processMesh(aiMesh *mesh, const aiScene *scene)
 {
     // data to fill
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    std::vector<Texture> textures;
+    MeshData data;
+    std::vector<Vertex> &vertices = data.vertices;
+    std::vector<unsigned int> &indices = data.indices;
+    std::vector<Texture> &textures = data.textures;
 
     // walk through each of the mesh's vertices
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
@@ -125,57 +491,69 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
     material->Get(AI_MATKEY_COLOR_AMBIENT, color);
 
     // 1. diffuse maps
-    std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+    std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, TextureType::Diffuse);
     textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
     // 2. specular maps
-    std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+    std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, TextureType::Specular);
     textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
     // 3. normal maps
-    std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+    std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, TextureType::Normal);
     textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
     // 4. height maps
-    std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+    std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, TextureType::Height);
     textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
-    // return a mesh object created from the extracted mesh data
-    return Mesh(vertices, indices, textures);
+    // return the extracted mesh data, the GPU side is created in addMesh
+    return data;
 }
 
-// checks all material textures of a given type and loads the textures if they're not loaded yet.
-// the required info is returned as a Texture struct.
-std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, std::string typeName)
+// collects all material textures of a given type. Only the references are returned, the textures themselves are
+// loaded (once per path) when the mesh is added to the model.
+std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, TextureType typeName)
 {
     std::vector<Texture> textures;
     for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
     {
         aiString str;
         mat->GetTexture(type, i, &str);
-        // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-        bool skip = false;
-        for (unsigned int j = 0; j < textures_loaded.size(); j++)
-        {
-            if (std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-            {
-                textures.push_back(textures_loaded[j]);
-                skip = true; // a texture with the same filepath has already been loaded, continue to next one.
-                             // (optimization)
-                break;
-            }
-        }
-        if (!skip)
-        { // if texture hasn't been loaded already, load it
-            Texture texture;
-            texture.id = TextureFromFile(str.C_Str(), this->directory);
-            texture.type = typeName;
-            texture.path = str.C_Str();
-            textures.push_back(texture);
-            textures_loaded.push_back(texture); // store it as texture loaded for entire model, to ensure we won't
-                                                // unnecesery load duplicate textures.
-        }
+        Texture texture;
+        texture.type = typeName;
+        texture.path = str.C_Str();
+        textures.push_back(texture);
     }
     return textures;
 }
 
+Texture Model::loadTexture(const std::string &path, TextureType typeName)
+{
+    Texture texture;
+    texture.type = typeName;
+    texture.path = path;
+
+    // check if the texture was loaded before (by any model) and if so, share it
+    AssetRegistry &registry = AssetRegistry::global();
+    std::string key = AssetRegistry::getTextureKey(this->directory + '/' + path);
+    texture.object = registry.findTexture(key);
+    if (texture.object)
+        return texture;
+
+    // if texture hasn't been loaded already, start decoding it, the upload waits until all meshes are processed
+    texture.object = std::make_shared<TextureObject>(GL_TEXTURE_2D);
+    registry.addTexture(key, texture.object);
+    pendingTextures.push_back(std::make_pair(texture.object, loadImageAsync(this->directory + '/' + path)));
+    return texture;
+}
+
+void Model::uploadPendingTextures()
+{
+    for (const std::pair<std::shared_ptr<TextureObject>, ImageFuture> &pending : pendingTextures)
+    {
+        uploadTexture(pending.first->getTextureID(), *pending.second.get());
+        pending.first->setReady();
+    }
+    pendingTextures.clear();
+}
+
 unsigned int TextureFromFile(const char *path, const std::string &directory, bool gamma)
 {
     std::string filename = std::string(path);
@@ -183,35 +561,7 @@ unsigned int TextureFromFile(const char *path, const std::string &directory, boo
 
     unsigned int textureID;
     glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+    uploadTexture(textureID, *loadImage(filename));
 
     return textureID;
 }
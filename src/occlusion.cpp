@@ -0,0 +1,364 @@
+#include <rg/occlusion.hpp>
+#include <rg/threadpool.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <utility>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <emmintrin.h>
+#define RG_OCCLUSION_SSE 1
+#endif
+
+namespace
+{
+// clip space position to pixels, y goes up like in normalized device coordinates
+void toScreen(const glm::vec4 &clip, float &x, float &y, float &depth)
+{
+    depth = 1.0f / clip.w;
+    x = (clip.x * depth * 0.5f + 0.5f) * OcclusionCuller::WIDTH;
+    y = (clip.y * depth * 0.5f + 0.5f) * OcclusionCuller::HEIGHT;
+}
+
+// in front of the near plane
+bool isInFront(const glm::vec4 &clip)
+{
+    return clip.w > 0.0f && clip.z >= -clip.w;
+}
+
+// vertices of shrinkOccluder whose normal is further than this cosine from one of their faces would have to move
+// more than four times the distance, they make it give up
+const float MIN_OCCLUDER_NORMAL_COSINE = 0.25f;
+} // namespace
+
+bool shrinkOccluder(OccluderMesh &occluder, float distance)
+{
+    // seams split vertices that are one point of the surface, welded they are one again
+    std::map<std::tuple<float, float, float>, uint32_t> welded;
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t> indices;
+    for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3)
+    {
+        uint32_t corners[3];
+        for (int k = 0; k < 3; k++)
+        {
+            const glm::vec3 &position = occluder.vertices[occluder.indices[i + k]];
+            auto inserted = welded.insert(std::make_pair(std::make_tuple(position.x, position.y, position.z),
+                                                         static_cast<uint32_t>(positions.size())));
+            if (inserted.second)
+                positions.push_back(position);
+            corners[k] = inserted.first->second;
+        }
+        if (corners[0] == corners[1] || corners[1] == corners[2] || corners[2] == corners[0])
+            continue;
+        indices.insert(indices.end(), corners, corners + 3);
+    }
+    if (indices.empty())
+        return false;
+
+    // closed: every edge is used once in each direction
+    std::map<std::pair<uint32_t, uint32_t>, int> edges;
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        for (int k = 0; k < 3; k++)
+            edges[std::make_pair(indices[i + k], indices[i + (k + 1) % 3])]++;
+    }
+    for (const auto &edge : edges)
+    {
+        auto opposite = edges.find(std::make_pair(edge.first.second, edge.first.first));
+        if (edge.second != 1 || opposite == edges.end() || opposite->second != 1)
+            return false;
+    }
+
+    // the sign of the enclosed volume tells whether the winding makes the face normals point out
+    float volume = 0.0f;
+    std::vector<glm::vec3> faceNormals(indices.size() / 3);
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const glm::vec3 &a = positions[indices[i]];
+        const glm::vec3 &b = positions[indices[i + 1]];
+        const glm::vec3 &c = positions[indices[i + 2]];
+        faceNormals[i / 3] = glm::cross(b - a, c - a);
+        volume += glm::dot(a, glm::cross(b, c));
+    }
+    if (volume == 0.0f)
+        return false;
+    const float outward = volume > 0.0f ? 1.0f : -1.0f;
+
+    std::vector<glm::vec3> normals(positions.size(), glm::vec3(0.0f));
+    for (size_t i = 0; i < indices.size(); i++)
+        normals[indices[i]] += faceNormals[i / 3] * outward;
+    std::vector<float> cosines(positions.size(), 1.0f);
+    for (glm::vec3 &normal : normals)
+    {
+        float length = glm::length(normal);
+        if (length == 0.0f)
+            return false;
+        normal /= length;
+    }
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        float length = glm::length(faceNormals[i / 3]);
+        if (length > 0.0f)
+        {
+            float cosine = glm::dot(normals[indices[i]], faceNormals[i / 3] * (outward / length));
+            cosines[indices[i]] = std::min(cosines[indices[i]], cosine);
+        }
+    }
+
+    std::vector<glm::vec3> shrunk(positions.size());
+    for (size_t v = 0; v < positions.size(); v++)
+    {
+        if (cosines[v] < MIN_OCCLUDER_NORMAL_COSINE)
+            return false;
+        shrunk[v] = positions[v] - normals[v] * (distance / cosines[v]);
+    }
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        const glm::vec3 &a = shrunk[indices[i]];
+        glm::vec3 normal = glm::cross(shrunk[indices[i + 1]] - a, shrunk[indices[i + 2]] - a);
+        if (glm::dot(normal, faceNormals[i / 3]) <= 0.0f)
+            return false;
+    }
+
+    occluder.vertices = std::move(shrunk);
+    occluder.indices = std::move(indices);
+    return true;
+}
+
+OcclusionCuller::OcclusionCuller()
+    : viewProjection(1.0f), depth(WIDTH * HEIGHT, 0.0f), hiZ(BLOCKS_X * BLOCKS_Y, 0.0f), nextTile(0)
+{
+    // the calling thread rasterizes as well, one worker less than there are cores
+    unsigned int cores = std::thread::hardware_concurrency();
+    if (cores > 1)
+        workers.reset(new ThreadPool(std::min<unsigned int>(cores - 1, TILES_X * TILES_Y - 1)));
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+}
+
+void OcclusionCuller::begin(const glm::mat4 &viewProjection)
+{
+    this->viewProjection = viewProjection;
+    triangles.clear();
+    for (std::vector<uint32_t> &bin : bins)
+        bin.clear();
+    std::fill(depth.begin(), depth.end(), 0.0f);
+    std::fill(hiZ.begin(), hiZ.end(), 0.0f);
+}
+
+void OcclusionCuller::addOccluder(const OccluderMesh &occluder, const glm::mat4 &model)
+{
+    glm::mat4 transform = viewProjection * model;
+    std::vector<glm::vec4> clip(occluder.vertices.size());
+    for (size_t i = 0; i < clip.size(); i++)
+        clip[i] = transform * glm::vec4(occluder.vertices[i], 1.0f);
+
+    for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3)
+    {
+        const glm::vec4 *corners[3] = {&clip[occluder.indices[i]], &clip[occluder.indices[i + 1]],
+                                       &clip[occluder.indices[i + 2]]};
+        // clipping against the near plane would only make the occluder a bit bigger, dropping is conservative
+        if (!isInFront(*corners[0]) || !isInFront(*corners[1]) || !isInFront(*corners[2]))
+            continue;
+
+        float x[3], y[3], z[3];
+        for (int k = 0; k < 3; k++)
+            toScreen(*corners[k], x[k], y[k], z[k]);
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (std::fabs(area) < 1e-6f)
+            continue;
+
+        ScreenTriangle triangle;
+        triangle.minX = std::max(0, static_cast<int>(std::floor(std::min({x[0], x[1], x[2]}))));
+        triangle.minY = std::max(0, static_cast<int>(std::floor(std::min({y[0], y[1], y[2]}))));
+        triangle.maxX = std::min(WIDTH - 1, static_cast<int>(std::ceil(std::max({x[0], x[1], x[2]}))));
+        triangle.maxY = std::min(HEIGHT - 1, static_cast<int>(std::ceil(std::max({y[0], y[1], y[2]}))));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            continue;
+
+        // edge functions, positive inside whichever way the triangle winds (occluders are drawn from both sides)
+        float sign = area > 0.0f ? 1.0f : -1.0f;
+        for (int k = 0; k < 3; k++)
+        {
+            int next = (k + 1) % 3;
+            triangle.edgeA[k] = sign * (y[k] - y[next]);
+            triangle.edgeB[k] = sign * (x[next] - x[k]);
+            triangle.edgeC[k] = sign * (x[k] * y[next] - x[next] * y[k]);
+        }
+        // 1/w is linear in screen space, the plane through the three vertices
+        triangle.depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (z[2] - z[0])) / area;
+        triangle.depthB = ((x[1] - x[0]) * (z[2] - z[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+        triangle.depthC = z[0] - triangle.depthA * x[0] - triangle.depthB * y[0];
+
+        uint32_t index = static_cast<uint32_t>(triangles.size());
+        triangles.push_back(triangle);
+        for (int tileY = triangle.minY / TILE_HEIGHT; tileY <= triangle.maxY / TILE_HEIGHT; tileY++)
+        {
+            for (int tileX = triangle.minX / TILE_WIDTH; tileX <= triangle.maxX / TILE_WIDTH; tileX++)
+                bins[tileY * TILES_X + tileX].push_back(index);
+        }
+        stats.occluderTriangles++;
+    }
+}
+
+void OcclusionCuller::render()
+{
+    // tiles own their rows of the buffer so nothing is shared, whoever is free takes the next one
+    nextTile = 0;
+    std::vector<std::future<void>> jobs;
+    if (workers)
+    {
+        for (unsigned int job = 0; job < workers->getThreadCount(); job++)
+            jobs.push_back(workers->submit([this]() { rasterizeTiles(); }));
+    }
+    rasterizeTiles();
+    for (std::future<void> &job : jobs)
+        job.get();
+}
+
+void OcclusionCuller::rasterizeTiles()
+{
+    const int tileCount = TILES_X * TILES_Y;
+    for (int tile = nextTile++; tile < tileCount; tile = nextTile++)
+    {
+        if (!bins[tile].empty())
+            rasterizeTile(tile);
+    }
+}
+
+void OcclusionCuller::rasterizeTile(int tile)
+{
+    const int tileX = (tile % TILES_X) * TILE_WIDTH;
+    const int tileY = (tile / TILES_X) * TILE_HEIGHT;
+    for (uint32_t index : bins[tile])
+    {
+        const ScreenTriangle &triangle = triangles[index];
+        // the rows of the tile the triangle covers, columns widened to groups of four. Tiles are a multiple of four
+        // wide, so the extra pixels stay in the tile and the edge functions reject them.
+        const int minX = std::max(triangle.minX, tileX) & ~3;
+        const int maxX = std::min(triangle.maxX, tileX + TILE_WIDTH - 1);
+        const int minY = std::max(triangle.minY, tileY);
+        const int maxY = std::min(triangle.maxY, tileY + TILE_HEIGHT - 1);
+        for (int y = minY; y <= maxY; y++)
+        {
+            float *row = &depth[y * WIDTH];
+            // everything sampled at pixel centers
+            const float centerY = y + 0.5f;
+#ifdef RG_OCCLUSION_SSE
+            __m128 rowEdges[3];
+            for (int k = 0; k < 3; k++)
+                rowEdges[k] = _mm_set1_ps(triangle.edgeB[k] * centerY + triangle.edgeC[k]);
+            const __m128 rowDepth = _mm_set1_ps(triangle.depthB * centerY + triangle.depthC);
+            const __m128 zero = _mm_setzero_ps();
+            for (int x = minX; x <= maxX; x += 4)
+            {
+                __m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (int k = 0; k < 3; k++)
+                {
+                    __m128 edge = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.edgeA[k]), centerX), rowEdges[k]);
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(edge, zero));
+                }
+                if (_mm_movemask_ps(inside) == 0)
+                    continue;
+                __m128 pixelDepth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(triangle.depthA), centerX), rowDepth);
+                __m128 old = _mm_loadu_ps(row + x);
+                __m128 nearest = _mm_max_ps(old, pixelDepth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+            }
+#else
+            for (int x = minX; x <= maxX; x++)
+            {
+                const float centerX = x + 0.5f;
+                bool inside = true;
+                for (int k = 0; k < 3 && inside; k++)
+                    inside = triangle.edgeA[k] * centerX + triangle.edgeB[k] * centerY + triangle.edgeC[k] >= 0.0f;
+                if (inside)
+                    row[x] = std::max(row[x], triangle.depthA * centerX + triangle.depthB * centerY + triangle.depthC);
+            }
+#endif
+        }
+    }
+
+    // the Hi-Z blocks of the tile, tiles are a multiple of the block size
+    for (int blockY = tileY / BLOCK_SIZE; blockY < (tileY + TILE_HEIGHT) / BLOCK_SIZE; blockY++)
+    {
+        for (int blockX = tileX / BLOCK_SIZE; blockX < (tileX + TILE_WIDTH) / BLOCK_SIZE; blockX++)
+        {
+            float farthest = FLT_MAX;
+            for (int y = blockY * BLOCK_SIZE; y < (blockY + 1) * BLOCK_SIZE; y++)
+            {
+                const float *row = &depth[y * WIDTH + blockX * BLOCK_SIZE];
+                farthest = std::min(farthest, *std::min_element(row, row + BLOCK_SIZE));
+            }
+            hiZ[blockY * BLOCKS_X + blockX] = farthest;
+        }
+    }
+}
+
+bool OcclusionCuller::testBox(const BoundingBox &box)
+{
+    stats.tested++;
+    if (box.isEmpty())
+        return true;
+
+    // screen rectangle of the corners and the depth of the nearest one, the nearest point of a box is a corner
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    float nearest = 0.0f;
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec3 corner((i & 1) ? box.maximum.x : box.minimum.x, (i & 2) ? box.maximum.y : box.minimum.y,
+                         (i & 4) ? box.maximum.z : box.minimum.z);
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+        if (!isInFront(clip))
+            return true;
+        float x, y, z;
+        toScreen(clip, x, y, z);
+        minX = std::min(minX, x);
+        minY = std::min(minY, y);
+        maxX = std::max(maxX, x);
+        maxY = std::max(maxY, y);
+        nearest = std::max(nearest, z);
+    }
+    // every pixel the rectangle touches, widened by half a pixel: occluders cover the pixels whose centers they
+    // contain, so a box may reach up to half a pixel past an occluder's edge into a covered pixel
+    const int x0 = std::max(0, static_cast<int>(std::floor(minX - 0.5f)));
+    const int y0 = std::max(0, static_cast<int>(std::floor(minY - 0.5f)));
+    const int x1 = std::min(WIDTH - 1, static_cast<int>(std::floor(maxX + 0.5f)));
+    const int y1 = std::min(HEIGHT - 1, static_cast<int>(std::floor(maxY + 0.5f)));
+    if (x0 > x1 || y0 > y1)
+        return true;
+
+    for (int blockY = y0 / BLOCK_SIZE; blockY <= y1 / BLOCK_SIZE; blockY++)
+    {
+        for (int blockX = x0 / BLOCK_SIZE; blockX <= x1 / BLOCK_SIZE; blockX++)
+        {
+            // the whole block is nearer than the box
+            if (hiZ[blockY * BLOCKS_X + blockX] > nearest)
+                continue;
+            for (int y = std::max(y0, blockY * BLOCK_SIZE); y <= std::min(y1, (blockY + 1) * BLOCK_SIZE - 1); y++)
+            {
+                for (int x = std::max(x0, blockX * BLOCK_SIZE); x <= std::min(x1, (blockX + 1) * BLOCK_SIZE - 1); x++)
+                {
+                    if (depth[y * WIDTH + x] <= nearest)
+                        return true;
+                }
+            }
+        }
+    }
+    stats.occluded++;
+    return false;
+}
+
+OcclusionStats OcclusionCuller::takeStats()
+{
+    OcclusionStats taken = stats;
+    stats = OcclusionStats();
+    return taken;
+}
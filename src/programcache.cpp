@@ -0,0 +1,160 @@
+#include <rg/filesystem.hpp>
+#include <rg/glextensions.hpp>
+#include <rg/hash.hpp>
+#include <rg/programcache.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+
+namespace
+{
+const char PROGRAM_CACHE_MAGIC[4] = {'R', 'G', 'P', 'B'};
+
+struct ProgramCacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t binaryFormat;
+    uint32_t binarySize;
+};
+
+std::string cacheDirectory = "shader_cache";
+bool cacheEnabled = true;
+unsigned int hitCount = 0;
+unsigned int missCount = 0;
+
+// vendor, renderer and version, hashed once per run
+uint64_t getDriverHash()
+{
+    static uint64_t hash = 0;
+    if (hash == 0)
+    {
+        hash = FNV_OFFSET_BASIS;
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+        {
+            const char *value = reinterpret_cast<const char *>(glGetString(name));
+            hash = hashString(value ? value : "", hash);
+            hash = hashCombine(hash, 0);
+        }
+    }
+    return hash;
+}
+} // namespace
+
+void ProgramCache::setDirectory(const std::string &directory)
+{
+    cacheDirectory = directory;
+}
+
+void ProgramCache::setEnabled(bool enabled)
+{
+    cacheEnabled = enabled;
+}
+
+bool ProgramCache::isEnabled()
+{
+    return cacheEnabled && glExtensions.hasProgramBinary;
+}
+
+uint64_t ProgramCache::computeKey(const std::vector<std::string> &sources, const std::vector<std::string> &defines)
+{
+    uint64_t hash = hashCombine(getDriverHash(), PROGRAM_CACHE_VERSION);
+    // lengths are mixed in so that moving text from one stage to the next changes the key
+    for (const std::string &source : sources)
+        hash = hashCombine(hashString(source, hash), source.size());
+    for (const std::string &define : defines)
+        hash = hashCombine(hashString(define, hash), define.size());
+    return hash;
+}
+
+std::string ProgramCache::getCachePath(uint64_t key)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return cacheDirectory + '/' + name;
+}
+
+bool ProgramCache::load(uint64_t key, GLuint program)
+{
+    if (!isEnabled())
+        return false;
+    FileView file = FileSystem::readFile(getCachePath(key));
+    const ProgramCacheHeader *header = reinterpret_cast<const ProgramCacheHeader *>(file.data());
+    if (!file.isValid() || file.size() < sizeof(ProgramCacheHeader) ||
+        std::memcmp(header->magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) != 0 ||
+        header->version != PROGRAM_CACHE_VERSION || header->key != key ||
+        sizeof(ProgramCacheHeader) + header->binarySize > file.size())
+        return false;
+
+    glExtensions.programBinary(program, header->binaryFormat, file.data() + sizeof(ProgramCacheHeader),
+                               static_cast<GLsizei>(header->binarySize));
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked)
+    {
+        // a rejected binary raises GL_INVALID_ENUM on some drivers, that is not an error of whatever comes next
+        while (glGetError() != GL_NO_ERROR)
+            ;
+        return false;
+    }
+    hitCount++;
+    return true;
+}
+
+void ProgramCache::prepare(GLuint program)
+{
+    missCount++;
+    if (isEnabled())
+        glExtensions.programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+bool ProgramCache::store(uint64_t key, GLuint program)
+{
+    if (!isEnabled())
+        return false;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return false;
+    std::vector<unsigned char> binary(length);
+    GLenum binaryFormat = 0;
+    glExtensions.getProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+    ProgramCacheHeader header;
+    std::memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.key = key;
+    header.binaryFormat = binaryFormat;
+    header.binarySize = static_cast<uint32_t>(length);
+
+    // same procedure as the mesh cache: write to a temporary file and rename it into place
+    mkdir(cacheDirectory.c_str(), 0755);
+    std::string path = getCachePath(key);
+    std::string tmpPath = path + ".tmp";
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(binary.data()), length);
+    out.close();
+    if (!out)
+    {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+unsigned int ProgramCache::getHitCount()
+{
+    return hitCount;
+}
+
+unsigned int ProgramCache::getMissCount()
+{
+    return missCount;
+}
@@ -0,0 +1,247 @@
+#include <rg/renderqueue.hpp>
+#include <rg/glstate.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+const UniformName MODEL_UNIFORM("model");
+const UniformName NORMAL_MATRIX_UNIFORM("normalMatrix");
+
+const unsigned int PROGRAM_BITS = 12;
+const unsigned int MATERIAL_BITS = 16;
+const unsigned int DEPTH_BITS = 24;
+const uint64_t PROGRAM_MASK = (1ull << PROGRAM_BITS) - 1;
+const uint64_t DEPTH_MASK = (1ull << DEPTH_BITS) - 1;
+
+// The bits of a non-negative float compare like the float itself, so its top bits are a depth quantized finely
+// near the camera and coarsely far away, without knowing the depth range.
+uint64_t quantizeDepth(float depth)
+{
+    if (!(depth > 0.0f))
+        return 0;
+    uint32_t bits;
+    std::memcpy(&bits, &depth, sizeof(bits));
+    // the sign bit is 0, the other 31 bits are shifted down to DEPTH_BITS
+    return (bits >> (31 - DEPTH_BITS)) & DEPTH_MASK;
+}
+} // namespace
+
+FrameArena::FrameArena(size_t blockSize)
+{
+    addBlock(blockSize);
+}
+
+FrameArena::~FrameArena()
+{
+    for (Block &block : blocks)
+        delete[] block.data;
+}
+
+void FrameArena::addBlock(size_t size)
+{
+    blocks.push_back(Block{new unsigned char[size], size});
+}
+
+void *FrameArena::allocate(size_t size, size_t alignment)
+{
+    while (true)
+    {
+        if (current < blocks.size())
+        {
+            Block &block = blocks[current];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+            size_t start = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+            if (start + size <= block.size)
+            {
+                offset = start + size;
+                used += size;
+                return block.data + start;
+            }
+            current++;
+            offset = 0;
+            continue;
+        }
+        // out of space, the new block at least doubles what the arena has
+        addBlock(std::max(size + alignment, blocks.back().size * 2));
+    }
+}
+
+void FrameArena::reset()
+{
+    if (blocks.size() > 1)
+    {
+        size_t total = 0;
+        for (Block &block : blocks)
+        {
+            total += block.size;
+            delete[] block.data;
+        }
+        blocks.clear();
+        addBlock(total);
+    }
+    current = 0;
+    offset = 0;
+    used = 0;
+}
+
+uint64_t RenderQueue::makeKey(RenderLayer layer, unsigned int program, uint16_t material, float depth)
+{
+    uint64_t key = static_cast<uint64_t>(layer) << 62;
+    uint64_t programBits = program & PROGRAM_MASK;
+    uint64_t depthBits = quantizeDepth(depth);
+    if (layer == RenderLayer::Transparent)
+    {
+        // farthest first, ties grouped by state
+        key |= (DEPTH_MASK - depthBits) << (62 - DEPTH_BITS);
+        key |= programBits << (62 - DEPTH_BITS - PROGRAM_BITS);
+        key |= static_cast<uint64_t>(material) << (62 - DEPTH_BITS - PROGRAM_BITS - MATERIAL_BITS);
+    }
+    else
+    {
+        key |= programBits << (62 - PROGRAM_BITS);
+        key |= static_cast<uint64_t>(material) << (62 - PROGRAM_BITS - MATERIAL_BITS);
+        key |= depthBits << (62 - PROGRAM_BITS - MATERIAL_BITS - DEPTH_BITS);
+    }
+    return key;
+}
+
+void RenderQueue::begin(const glm::mat4 &view, const glm::mat4 &projection)
+{
+    this->view = view;
+    cameraPosition = glm::vec3(glm::inverse(view)[3]);
+    frustum = Frustum(projection * view);
+    entries.clear();
+    arena.reset();
+    sorted = false;
+}
+
+float RenderQueue::getViewDepth(const glm::vec3 &position) const
+{
+    // the camera looks down -z in view space
+    return -(view * glm::vec4(position, 1.0f)).z;
+}
+
+DrawPacket &RenderQueue::submit(Shader &shader, Mesh &mesh, const glm::mat4 &transform, RenderLayer layer)
+{
+    DrawPacket *packet = arena.allocate<DrawPacket>();
+    packet->shader = &shader;
+    packet->mesh = &mesh;
+    packet->transform = transform;
+    packet->depth = getViewDepth(glm::vec3(transform * glm::vec4(mesh.getBoundingCenter(), 1.0f)));
+    packet->layer = layer;
+    // the key is made in sort(), the caller may still change the packet
+    entries.push_back(Entry{0, packet});
+    sorted = false;
+    return *packet;
+}
+
+void RenderQueue::cullMeshlets(DrawPacket &packet, const glm::mat4 &model)
+{
+    const Mesh &mesh = *packet.mesh;
+    if (!meshletCulling || mesh.getMeshlets().empty() || packet.lod != 0 || packet.instanceCount > 1)
+        return;
+    size_t count = mesh.getMeshlets().size();
+    packet.rangeCounts = static_cast<GLsizei *>(arena.allocate(count * sizeof(GLsizei), alignof(GLsizei)));
+    packet.rangeOffsets = static_cast<const void **>(arena.allocate(count * sizeof(void *), alignof(void *)));
+    packet.rangeCount = mesh.cullMeshlets(frustum, model, cameraPosition, packet.cullFace, frontFace,
+                                          packet.rangeCounts, packet.rangeOffsets, stats.meshlets);
+}
+
+void RenderQueue::sort()
+{
+    for (Entry &entry : entries)
+    {
+        const DrawPacket &packet = *entry.packet;
+        const Material &material = packet.material ? *packet.material : packet.mesh->material;
+        entry.key = makeKey(packet.layer, packet.shader->ID, material.getSortKey(), packet.depth);
+    }
+    // stable, so packets with equal keys keep the order they were submitted in
+    std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.key < b.key; });
+    sorted = true;
+}
+
+void RenderQueue::execute(RenderLayer layer)
+{
+    if (!sorted)
+        sort();
+    uint64_t layerKey = static_cast<uint64_t>(layer) << 62;
+    auto first = std::lower_bound(entries.begin(), entries.end(), layerKey,
+                                  [](const Entry &entry, uint64_t key) { return entry.key < key; });
+    const Shader *program = nullptr;
+    const Material *material = nullptr;
+    for (auto it = first; it != entries.end() && (it->key >> 62) == static_cast<uint64_t>(layer); ++it)
+        draw(*it->packet, program, material);
+}
+
+void RenderQueue::execute()
+{
+    for (unsigned int layer = 0; layer < RENDER_LAYER_COUNT; layer++)
+        execute(static_cast<RenderLayer>(layer));
+}
+
+void RenderQueue::draw(const DrawPacket &packet, const Shader *&program, const Material *&material)
+{
+    GLState &state = GLState::global();
+    Shader &shader = *packet.shader;
+    if (program != &shader)
+    {
+        shader.use();
+        program = &shader;
+        stats.programChanges++;
+    }
+    const Material *packetMaterial = packet.material ? packet.material : &packet.mesh->material;
+    if (material != packetMaterial)
+    {
+        material = packetMaterial;
+        stats.materialChanges++;
+    }
+
+    state.setCullFace(packet.cullFace != 0);
+    if (packet.cullFace != 0)
+        state.setCullFaceMode(packet.cullFace);
+    for (unsigned int i = 0; i < packet.uniformCount; i++)
+        shader.setInt(UniformName(packet.uniforms[i].name), packet.uniforms[i].value);
+
+    // the mesh binds its own material, the units the GLState already has bound are skipped
+    if (packet.material)
+        packet.material->bind();
+    if (packet.rangeCounts)
+    {
+        if (!packet.instances)
+        {
+            shader.setMat4(MODEL_UNIFORM, packet.transform);
+            shader.setMat3(NORMAL_MATRIX_UNIFORM, getNormalMatrix(packet.transform));
+        }
+        packet.mesh->DrawRanges(shader, packet.rangeCounts, packet.rangeOffsets, packet.rangeCount, packet.instances,
+                                packet.firstInstance);
+    }
+    else if (packet.instances)
+    {
+        packet.mesh->DrawInstanced(shader, *packet.instances, packet.firstInstance, packet.instanceCount, packet.lod);
+    }
+    else
+    {
+        shader.setMat4(MODEL_UNIFORM, packet.transform);
+        shader.setMat3(NORMAL_MATRIX_UNIFORM, getNormalMatrix(packet.transform));
+        packet.mesh->Draw(shader, packet.lod);
+    }
+    stats.packets++;
+}
+
+void RenderQueue::addCullingStats(const CullingStats &meshes, const CullingStats &instances)
+{
+    stats.meshes.visible += meshes.visible;
+    stats.meshes.culled += meshes.culled;
+    stats.instances.visible += instances.visible;
+    stats.instances.culled += instances.culled;
+}
+
+RenderQueueStats RenderQueue::takeStats()
+{
+    RenderQueueStats result = stats;
+    stats = RenderQueueStats();
+    return result;
+}
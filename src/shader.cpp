@@ -1,157 +1,369 @@
+#include <rg/filesystem.hpp>
+#include <rg/glextensions.hpp>
+#include <rg/glstate.hpp>
+#include <rg/programcache.hpp>
 #include <rg/shader.hpp>
+#include <rg/uniformbuffer.hpp>
 
-Shader::Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath)
+#include <algorithm>
+
+namespace
+{
+// the #version directive has to stay first, so the defines go right after it
+void insertDefines(std::string &code, const std::vector<std::string> &defines)
+{
+    if (defines.empty())
+        return;
+    std::string block;
+    for (const std::string &define : defines)
+        block += "#define " + define + "\n";
+    size_t version = code.find("#version");
+    size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+    if (lineEnd == std::string::npos)
+        code.insert(0, block);
+    else
+        code.insert(lineEnd + 1, block);
+}
+
+bool isSamplerType(GLenum type)
+{
+    return (type >= GL_SAMPLER_1D && type <= GL_SAMPLER_2D_SHADOW) ||
+           (type >= GL_SAMPLER_2D_RECT && type <= GL_SAMPLER_2D_RECT_SHADOW) ||
+           (type >= GL_SAMPLER_1D_ARRAY && type <= GL_UNSIGNED_INT_SAMPLER_BUFFER) ||
+           (type >= GL_SAMPLER_2D_MULTISAMPLE && type <= GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY);
+}
+} // namespace
+
+UniformStats Shader::uniformStats;
+
+Shader::Shader(const char *vertexPath, const char *fragmentPath, const char *geometryPath,
+               const std::vector<std::string> &defines)
 {
     std::string vertexPathString(vertexPath);
     std::string fragmentPathString(fragmentPath);
 
     vertexPath = vertexPathString.c_str();
     fragmentPath = fragmentPathString.c_str();
-    // 1. retrieve the vertex/fragment source code from filePath
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::string geometryCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-    std::ifstream gShaderFile;
-    // ensure ifstream objects can throw exceptions:
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    gShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    try
-    {
-        // open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-        // read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-        // close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
-        // convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-        // if geometry shader path is present, also load a geometry shader
-        if (geometryPath != nullptr)
-        {
-            std::string geometryPathString(geometryPath);
-            geometryPath = geometryPathString.c_str();
-            gShaderFile.open(geometryPath);
-            std::stringstream gShaderStream;
-            gShaderStream << gShaderFile.rdbuf();
-            gShaderFile.close();
-            geometryCode = gShaderStream.str();
-        }
-    }
-    catch (std::ifstream::failure &e)
-    {
+    // 1. retrieve the vertex/fragment source code from filePath (or the mounted asset pack)
+    FileView vShaderFile = FileSystem::readFile(vertexPath);
+    FileView fShaderFile = FileSystem::readFile(fragmentPath);
+    FileView gShaderFile;
+    // if geometry shader path is present, also load a geometry shader
+    if (geometryPath != nullptr)
+        gShaderFile = FileSystem::readFile(geometryPath);
+    if (!vShaderFile.isValid() || !fShaderFile.isValid() || (geometryPath != nullptr && !gShaderFile.isValid()))
         std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    std::string vertexCode = vShaderFile.toString();
+    std::string fragmentCode = fShaderFile.toString();
+    std::string geometryCode = gShaderFile.toString();
+    insertDefines(vertexCode, defines);
+    insertDefines(fragmentCode, defines);
+    insertDefines(geometryCode, defines);
+    // 2. try the program binary cache, its key covers the final sources and the driver
+    ID = glCreateProgram();
+    cacheKey = ProgramCache::computeKey({vertexCode, fragmentCode, geometryCode}, defines);
+    if (ProgramCache::load(cacheKey, ID))
+    {
+        linked = true;
+        reflectUniforms();
+        bindUniformBlocks();
+        return;
     }
+    // 3. compile and link. Nothing is checked here: asking for a status waits for the driver, so that is left to
+    // finish() and the driver can work on this program (and the next ones) in the background
     const char *vShaderCode = vertexCode.c_str();
     const char *fShaderCode = fragmentCode.c_str();
-    // 2. compile shaders
-    unsigned int vertex, fragment;
     // vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
-    checkCompileErrors(vertex, "VERTEX");
+    stages[0] = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(stages[0], 1, &vShaderCode, NULL);
+    glCompileShader(stages[0]);
     // fragment Shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-    checkCompileErrors(fragment, "FRAGMENT");
+    stages[1] = glCreateShader(GL_FRAGMENT_SHADER);
+    glShaderSource(stages[1], 1, &fShaderCode, NULL);
+    glCompileShader(stages[1]);
     // if geometry shader is given, compile geometry shader
-    unsigned int geometry;
     if (geometryPath != nullptr)
     {
         const char *gShaderCode = geometryCode.c_str();
-        geometry = glCreateShader(GL_GEOMETRY_SHADER);
-        glShaderSource(geometry, 1, &gShaderCode, NULL);
-        glCompileShader(geometry);
-        checkCompileErrors(geometry, "GEOMETRY");
+        stages[2] = glCreateShader(GL_GEOMETRY_SHADER);
+        glShaderSource(stages[2], 1, &gShaderCode, NULL);
+        glCompileShader(stages[2]);
     }
     // shader Program
+    for (unsigned int stage : stages)
+    {
+        if (stage)
+            glAttachShader(ID, stage);
+    }
+    ProgramCache::prepare(ID);
+    glLinkProgram(ID);
+    pending = true;
+}
+
+Shader::Shader(const char *computePath, const std::vector<std::string> &defines) : compute(true)
+{
+    FileView cShaderFile = FileSystem::readFile(computePath);
+    if (!cShaderFile.isValid())
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    std::string computeCode = cShaderFile.toString();
+    insertDefines(computeCode, defines);
     ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    if (geometryPath != nullptr)
-        glAttachShader(ID, geometry);
+    cacheKey = ProgramCache::computeKey({computeCode}, defines);
+    if (ProgramCache::load(cacheKey, ID))
+    {
+        linked = true;
+        reflectUniforms();
+        bindUniformBlocks();
+        return;
+    }
+    const char *cShaderCode = computeCode.c_str();
+    stages[0] = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(stages[0], 1, &cShaderCode, NULL);
+    glCompileShader(stages[0]);
+    glAttachShader(ID, stages[0]);
+    ProgramCache::prepare(ID);
     glLinkProgram(ID);
-    checkCompileErrors(ID, "PROGRAM");
+    pending = true;
+}
+
+Shader::~Shader()
+{
+    deleteStages();
+    GLState::global().deleteProgram(ID);
+}
+
+bool Shader::isReady() const
+{
+    if (!pending || !glExtensions.hasParallelShaderCompile)
+        return true;
+    GLint completed = GL_FALSE;
+    glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &completed);
+    return completed == GL_TRUE;
+}
+
+bool Shader::finish()
+{
+    if (!pending)
+        return linked;
+    pending = false;
+    static const char *const stageNames[3] = {"VERTEX", "FRAGMENT", "GEOMETRY"};
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        if (stages[i])
+            checkCompileErrors(stages[i], compute ? "COMPUTE" : stageNames[i]);
+    }
+    linked = checkCompileErrors(ID, "PROGRAM");
+    if (linked)
+    {
+        ProgramCache::store(cacheKey, ID);
+        reflectUniforms();
+        bindUniformBlocks();
+    }
     // delete the shaders as they're linked into our program now and no longer necessery
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
-    if (geometryPath != nullptr)
-        glDeleteShader(geometry);
+    deleteStages();
+    return linked;
+}
+
+void Shader::deleteStages()
+{
+    for (unsigned int &stage : stages)
+    {
+        if (stage)
+            glDeleteShader(stage);
+        stage = 0;
+    }
 }
 
 void Shader::use()
 {
-    glUseProgram(ID);
+    if (pending)
+        finish();
+    GLState::global().useProgram(ID);
 }
+void Shader::reflectUniforms()
+{
+    uniforms.clear();
+    GLint count = 0, maxLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<GLchar> buffer(std::max(maxLength, 1));
+    auto addUniform = [this](const std::string &name, GLenum type) {
+        // members of uniform blocks have no location, they're set through their buffer
+        GLint location = glGetUniformLocation(ID, name.c_str());
+        if (location < 0)
+            return;
+        Uniform uniform;
+        uniform.hash = hashString(name);
+        uniform.location = location;
+        uniform.type = type;
+        uniform.hasValue = false;
+        uniforms.push_back(uniform);
+    };
+    for (GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()), &length, &size, &type,
+                           buffer.data());
+        std::string name(buffer.data(), static_cast<size_t>(length));
+        // arrays are reported once as "name[0]", every element gets its own entry. There's deliberately no entry for
+        // the bare "name", it would be a second cached value for the location of the first element.
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+        {
+            std::string base = name.substr(0, name.size() - 3);
+            for (GLint element = 0; element < size; element++)
+                addUniform(base + "[" + std::to_string(element) + "]", type);
+        }
+        else
+            addUniform(name, type);
+    }
+    std::sort(uniforms.begin(), uniforms.end(),
+              [](const Uniform &a, const Uniform &b) { return a.hash < b.hash; });
+    for (size_t i = 1; i < uniforms.size(); i++)
+    {
+        if (uniforms[i].hash == uniforms[i - 1].hash)
+            std::cout << "ERROR::SHADER::UNIFORM_HASH_COLLISION in program " << ID << std::endl;
+    }
+}
+
+void Shader::bindUniformBlocks()
+{
+    for (const SharedUniformBlock &block : SHARED_UNIFORM_BLOCKS)
+    {
+        GLuint index = glGetUniformBlockIndex(ID, block.name);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, index, block.binding);
+    }
+}
+
+int Shader::findUniform(uint64_t hash) const
+{
+    std::vector<Uniform>::const_iterator it =
+        std::lower_bound(uniforms.begin(), uniforms.end(), hash,
+                         [](const Uniform &uniform, uint64_t value) { return uniform.hash < value; });
+    if (it == uniforms.end() || it->hash != hash)
+        return -1;
+    return static_cast<int>(it - uniforms.begin());
+}
+
+int Shader::resolveUniform(uint64_t hash, GLenum type)
+{
+    if (pending)
+        finish();
+    int index = findUniform(hash);
+    if (index < 0)
+        return -1;
+    GLenum actual = uniforms[index].type;
+    if (actual != type && !(type == GL_INT && isSamplerType(actual)))
+    {
+        std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH in program " << ID << ": the uniform is of type 0x"
+                  << std::hex << actual << ", not 0x" << type << std::dec << std::endl;
+        return -1;
+    }
+    return index;
+}
+
+UniformStats Shader::takeUniformStats()
+{
+    UniformStats stats = uniformStats;
+    uniformStats = UniformStats();
+    return stats;
+}
+
 // utility uniform functions
 // ------------------------------------------------------------------------
-void Shader::setBool(const std::string &name, bool value) const
+void Shader::setBool(UniformName name, bool value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    setUniform(name, static_cast<int>(value));
 }
 // ------------------------------------------------------------------------
-void Shader::setInt(const std::string &name, int value) const
+void Shader::setInt(UniformName name, int value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    setUniform(name, value);
 }
 // ------------------------------------------------------------------------
-void Shader::setFloat(const std::string &name, float value) const
+void Shader::setFloat(UniformName name, float value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    setUniform(name, value);
 }
 // ------------------------------------------------------------------------
-void Shader::setVec2(const std::string &name, const glm::vec2 &value) const
+void Shader::setVec2(UniformName name, const glm::vec2 &value) const
 {
-    glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    setUniform(name, value);
 }
-void Shader::setVec2(const std::string &name, float x, float y) const
+void Shader::setVec2(UniformName name, float x, float y) const
 {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    setUniform(name, glm::vec2(x, y));
 }
 // ------------------------------------------------------------------------
-void Shader::setVec3(const std::string &name, const glm::vec3 &value) const
+void Shader::setVec3(UniformName name, const glm::vec3 &value) const
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    setUniform(name, value);
 }
-void Shader::setVec3(const std::string &name, float x, float y, float z) const
+void Shader::setVec3(UniformName name, float x, float y, float z) const
 {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    setUniform(name, glm::vec3(x, y, z));
 }
 // ------------------------------------------------------------------------
-void Shader::setVec4(const std::string &name, const glm::vec4 &value) const
+void Shader::setVec4(UniformName name, const glm::vec4 &value) const
 {
-    glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    setUniform(name, value);
 }
-void Shader::setVec4(const std::string &name, float x, float y, float z, float w)
+void Shader::setVec4(UniformName name, float x, float y, float z, float w)
 {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    setUniform(name, glm::vec4(x, y, z, w));
 }
 // ------------------------------------------------------------------------
-void Shader::setMat2(const std::string &name, const glm::mat2 &mat) const
+void Shader::setMat2(UniformName name, const glm::mat2 &mat) const
 {
-    glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    setUniform(name, mat);
 }
 // ------------------------------------------------------------------------
-void Shader::setMat3(const std::string &name, const glm::mat3 &mat) const
+void Shader::setMat3(UniformName name, const glm::mat3 &mat) const
 {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    setUniform(name, mat);
 }
 // ------------------------------------------------------------------------
-void Shader::setMat4(const std::string &name, const glm::mat4 &mat) const
+void Shader::setMat4(UniformName name, const glm::mat4 &mat) const
+{
+    setUniform(name, mat);
+}
+
+void Shader::upload(GLint location, int value)
+{
+    glUniform1i(location, value);
+}
+void Shader::upload(GLint location, float value)
+{
+    glUniform1f(location, value);
+}
+void Shader::upload(GLint location, const glm::vec2 &value)
+{
+    glUniform2fv(location, 1, &value[0]);
+}
+void Shader::upload(GLint location, const glm::vec3 &value)
+{
+    glUniform3fv(location, 1, &value[0]);
+}
+void Shader::upload(GLint location, const glm::vec4 &value)
+{
+    glUniform4fv(location, 1, &value[0]);
+}
+void Shader::upload(GLint location, const glm::mat2 &value)
+{
+    glUniformMatrix2fv(location, 1, GL_FALSE, &value[0][0]);
+}
+void Shader::upload(GLint location, const glm::mat3 &value)
+{
+    glUniformMatrix3fv(location, 1, GL_FALSE, &value[0][0]);
+}
+void Shader::upload(GLint location, const glm::mat4 &value)
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
 }
 
-void Shader::checkCompileErrors(GLuint shader, std::string type)
+bool Shader::checkCompileErrors(GLuint shader, std::string type)
 {
     GLint success;
     GLchar infoLog[1024];
@@ -175,4 +387,30 @@ void Shader::checkCompileErrors(GLuint shader, std::string type)
                       << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
         }
     }
+    return success;
+}
+
+ShaderBatch::ShaderBatch(std::vector<std::shared_ptr<Shader>> shaders) : shaders(std::move(shaders))
+{
+}
+
+void ShaderBatch::add(const std::shared_ptr<Shader> &shader)
+{
+    shaders.push_back(shader);
+}
+
+size_t ShaderBatch::getPendingCount() const
+{
+    size_t count = 0;
+    for (const std::shared_ptr<Shader> &shader : shaders)
+        count += shader->isReady() ? 0 : 1;
+    return count;
+}
+
+bool ShaderBatch::finish()
+{
+    bool success = true;
+    for (const std::shared_ptr<Shader> &shader : shaders)
+        success = shader->finish() && success;
+    return success;
 }
@@ -0,0 +1,403 @@
+#include <rg/texturecompression.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+struct Color
+{
+    float r, g, b;
+};
+
+Color operator+(Color a, Color b)
+{
+    return Color{a.r + b.r, a.g + b.g, a.b + b.b};
+}
+Color operator-(Color a, Color b)
+{
+    return Color{a.r - b.r, a.g - b.g, a.b - b.b};
+}
+Color operator*(Color a, float s)
+{
+    return Color{a.r * s, a.g * s, a.b * s};
+}
+float dot(Color a, Color b)
+{
+    return a.r * b.r + a.g * b.g + a.b * b.b;
+}
+
+uint16_t packColor565(Color c)
+{
+    int r = std::min(31, std::max(0, static_cast<int>(c.r * 31.0f / 255.0f + 0.5f)));
+    int g = std::min(63, std::max(0, static_cast<int>(c.g * 63.0f / 255.0f + 0.5f)));
+    int b = std::min(31, std::max(0, static_cast<int>(c.b * 31.0f / 255.0f + 0.5f)));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+// what the hardware decodes a 565 color to
+Color unpackColor565(uint16_t c)
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    return Color{float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)), float((b << 3) | (b >> 2))};
+}
+
+// the 4x4 block at (bx, by) as RGBA8, pixels outside the image repeat the last row/column
+void fetchBlock(const unsigned char *rgba, unsigned int width, unsigned int height, unsigned int bx, unsigned int by,
+                unsigned char block[16][4])
+{
+    for (unsigned int y = 0; y < 4; y++)
+    {
+        unsigned int sy = std::min(by * 4 + y, height - 1);
+        for (unsigned int x = 0; x < 4; x++)
+        {
+            unsigned int sx = std::min(bx * 4 + x, width - 1);
+            std::memcpy(block[y * 4 + x], rgba + (static_cast<size_t>(sy) * width + sx) * 4, 4);
+        }
+    }
+}
+
+// 4 color palette of c0 > c1 (BC1 four color mode, always used by BC3)
+void colorPalette(uint16_t c0, uint16_t c1, Color palette[4])
+{
+    palette[0] = unpackColor565(c0);
+    palette[1] = unpackColor565(c1);
+    palette[2] = (palette[0] * 2.0f + palette[1]) * (1.0f / 3.0f);
+    palette[3] = (palette[0] + palette[1] * 2.0f) * (1.0f / 3.0f);
+}
+
+// picks the nearest palette entry for every pixel, returns the squared error
+float assignColorIndices(const Color pixels[16], uint16_t c0, uint16_t c1, unsigned char indices[16])
+{
+    Color palette[4];
+    colorPalette(c0, c1, palette);
+    float error = 0.0f;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        float best = 1e30f;
+        for (unsigned char p = 0; p < 4; p++)
+        {
+            Color d = pixels[i] - palette[p];
+            float distance = dot(d, d);
+            if (distance < best)
+            {
+                best = distance;
+                indices[i] = p;
+            }
+        }
+        error += best;
+    }
+    return error;
+}
+
+// least squares endpoints for fixed indices, returns false if the indices don't determine them
+bool refineEndpoints(const Color pixels[16], const unsigned char indices[16], Color &a, Color &b)
+{
+    static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    Color ax{0.0f, 0.0f, 0.0f}, bx{0.0f, 0.0f, 0.0f};
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        float w = weights[indices[i]];
+        aa += w * w;
+        ab += w * (1.0f - w);
+        bb += (1.0f - w) * (1.0f - w);
+        ax = ax + pixels[i] * w;
+        bx = bx + pixels[i] * (1.0f - w);
+    }
+    float determinant = aa * bb - ab * ab;
+    if (std::abs(determinant) < 1e-6f)
+        return false;
+    float inverse = 1.0f / determinant;
+    a = (ax * bb - bx * ab) * inverse;
+    b = (bx * aa - ax * ab) * inverse;
+    return true;
+}
+
+// BC1 color block (8 bytes) in four color mode: endpoints at the extremes of the principal axis, inset a little,
+// then refined once by least squares
+void encodeColorBlock(const unsigned char block[16][4], unsigned char *out)
+{
+    Color pixels[16];
+    Color mean{0.0f, 0.0f, 0.0f};
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        pixels[i] = Color{float(block[i][0]), float(block[i][1]), float(block[i][2])};
+        mean = mean + pixels[i] * (1.0f / 16.0f);
+    }
+
+    // principal axis of the covariance by power iteration
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        Color d = pixels[i] - mean;
+        cov[0] += d.r * d.r, cov[1] += d.r * d.g, cov[2] += d.r * d.b;
+        cov[3] += d.g * d.g, cov[4] += d.g * d.b, cov[5] += d.b * d.b;
+    }
+    Color axis{1.0f, 1.0f, 1.0f};
+    for (unsigned int iteration = 0; iteration < 8; iteration++)
+    {
+        Color next{cov[0] * axis.r + cov[1] * axis.g + cov[2] * axis.b,
+                   cov[1] * axis.r + cov[3] * axis.g + cov[4] * axis.b,
+                   cov[2] * axis.r + cov[4] * axis.g + cov[5] * axis.b};
+        float length = std::sqrt(dot(next, next));
+        if (length < 1e-6f)
+            break;
+        axis = next * (1.0f / length);
+    }
+
+    float minimum = 1e30f, maximum = -1e30f;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        float t = dot(pixels[i] - mean, axis);
+        minimum = std::min(minimum, t);
+        maximum = std::max(maximum, t);
+    }
+    float inset = (maximum - minimum) / 16.0f;
+    Color a = mean + axis * (maximum - inset);
+    Color b = mean + axis * (minimum + inset);
+
+    uint16_t c0 = packColor565(a), c1 = packColor565(b);
+    unsigned char indices[16];
+    float error = assignColorIndices(pixels, std::max(c0, c1), std::min(c0, c1), indices);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    Color refinedA, refinedB;
+    if (c0 != c1 && refineEndpoints(pixels, indices, refinedA, refinedB))
+    {
+        uint16_t r0 = packColor565(refinedA), r1 = packColor565(refinedB);
+        unsigned char refinedIndices[16];
+        if (r0 != r1)
+        {
+            float refinedError = assignColorIndices(pixels, std::max(r0, r1), std::min(r0, r1), refinedIndices);
+            if (refinedError < error)
+            {
+                c0 = std::max(r0, r1);
+                c1 = std::min(r0, r1);
+                std::memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+    }
+
+    uint32_t bits = 0;
+    if (c0 == c1)
+        std::memset(indices, 0, sizeof(indices)); // a solid block, three color mode but only color 0 is used
+    for (unsigned int i = 0; i < 16; i++)
+        bits |= uint32_t(indices[i]) << (i * 2);
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    std::memcpy(out + 4, &bits, sizeof(bits));
+}
+
+// BC4 block (8 bytes) of one channel: 8 value mode between the channel's minimum and maximum, also the alpha
+// block of BC3 and both halves of BC5
+void encodeChannelBlock(const unsigned char block[16][4], unsigned int channel, unsigned char *out)
+{
+    int minimum = 255, maximum = 0;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        minimum = std::min(minimum, int(block[i][channel]));
+        maximum = std::max(maximum, int(block[i][channel]));
+    }
+
+    int palette[8];
+    palette[0] = maximum;
+    palette[1] = minimum;
+    for (int i = 2; i < 8; i++)
+        palette[i] = ((8 - i) * maximum + (i - 1) * minimum + 3) / 7;
+
+    uint64_t bits = 0;
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        int value = block[i][channel];
+        unsigned int best = 0;
+        for (unsigned int p = 1; p < 8; p++)
+        {
+            if (std::abs(palette[p] - value) < std::abs(palette[best] - value))
+                best = p;
+        }
+        bits |= uint64_t(best) << (i * 3);
+    }
+    out[0] = static_cast<unsigned char>(maximum);
+    out[1] = static_cast<unsigned char>(minimum);
+    for (unsigned int i = 0; i < 6; i++)
+        out[2 + i] = static_cast<unsigned char>(bits >> (i * 8));
+}
+} // namespace
+
+BlockFormat chooseBlockFormat(const unsigned char *pixels, int width, int height, int components)
+{
+    if (components == 1)
+        return BlockFormat::BC4;
+    if (components == 2)
+        return BlockFormat::BC5;
+    if (components == 4)
+    {
+        size_t count = static_cast<size_t>(width) * height;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (pixels[i * 4 + 3] != 255)
+                return BlockFormat::BC3;
+        }
+    }
+    return BlockFormat::BC1;
+}
+
+size_t getBlockSize(BlockFormat format)
+{
+    return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+GLenum getCompressedInternalFormat(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BlockFormat::BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BlockFormat::BC4:
+        return GL_COMPRESSED_RED_RGTC1;
+    default:
+        return GL_COMPRESSED_RG_RGTC2;
+    }
+}
+
+size_t getCompressedSize(BlockFormat format, unsigned int width, unsigned int height)
+{
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+}
+
+std::vector<unsigned char> compressImage(const unsigned char *rgba, unsigned int width, unsigned int height,
+                                         BlockFormat format)
+{
+    std::vector<unsigned char> result(getCompressedSize(format, width, height));
+    unsigned char *out = result.data();
+    unsigned char block[16][4];
+    for (unsigned int by = 0; by < (height + 3) / 4; by++)
+    {
+        for (unsigned int bx = 0; bx < (width + 3) / 4; bx++)
+        {
+            fetchBlock(rgba, width, height, bx, by, block);
+            switch (format)
+            {
+            case BlockFormat::BC1:
+                encodeColorBlock(block, out);
+                break;
+            case BlockFormat::BC3:
+                encodeChannelBlock(block, 3, out);
+                encodeColorBlock(block, out + 8);
+                break;
+            case BlockFormat::BC4:
+                encodeChannelBlock(block, 0, out);
+                break;
+            case BlockFormat::BC5:
+                encodeChannelBlock(block, 0, out);
+                encodeChannelBlock(block, 1, out + 8);
+                break;
+            }
+            out += getBlockSize(format);
+        }
+    }
+    return result;
+}
+
+std::vector<unsigned char> downsampleImage(const unsigned char *rgba, unsigned int width, unsigned int height)
+{
+    unsigned int halfWidth = std::max(1u, width / 2), halfHeight = std::max(1u, height / 2);
+    std::vector<unsigned char> result(static_cast<size_t>(halfWidth) * halfHeight * 4);
+    for (unsigned int y = 0; y < halfHeight; y++)
+    {
+        unsigned int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+        for (unsigned int x = 0; x < halfWidth; x++)
+        {
+            unsigned int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+            for (unsigned int c = 0; c < 4; c++)
+            {
+                unsigned int sum = rgba[(static_cast<size_t>(y0) * width + x0) * 4 + c] +
+                                   rgba[(static_cast<size_t>(y0) * width + x1) * 4 + c] +
+                                   rgba[(static_cast<size_t>(y1) * width + x0) * 4 + c] +
+                                   rgba[(static_cast<size_t>(y1) * width + x1) * 4 + c];
+                result[(static_cast<size_t>(y) * halfWidth + x) * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<unsigned char> expandToRGBA(const unsigned char *pixels, unsigned int width, unsigned int height,
+                                        int components)
+{
+    size_t count = static_cast<size_t>(width) * height;
+    std::vector<unsigned char> result(count * 4);
+    for (size_t i = 0; i < count; i++)
+    {
+        const unsigned char *in = pixels + i * components;
+        unsigned char *out = result.data() + i * 4;
+        out[0] = in[0];
+        out[1] = components > 1 ? in[1] : 0;
+        out[2] = components > 2 ? in[2] : 0;
+        out[3] = components > 3 ? in[3] : 255;
+    }
+    return result;
+}
+
+KtxTexture cookTexture(const std::vector<const unsigned char *> &faces, unsigned int width, unsigned int height,
+                       BlockFormat format, bool mipmaps)
+{
+    KtxTexture texture;
+    texture.internalFormat = getCompressedInternalFormat(format);
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        texture.baseInternalFormat = GL_RGB;
+        break;
+    case BlockFormat::BC3:
+        texture.baseInternalFormat = GL_RGBA;
+        break;
+    case BlockFormat::BC4:
+        texture.baseInternalFormat = GL_RED;
+        break;
+    case BlockFormat::BC5:
+        texture.baseInternalFormat = GL_RG;
+        break;
+    }
+    texture.width = width;
+    texture.height = height;
+    texture.faces = static_cast<unsigned int>(faces.size());
+
+    // every face is downsampled from its previous level, level 0 is read straight from the input
+    std::vector<std::vector<unsigned char>> current(faces.size());
+    unsigned int levelWidth = width, levelHeight = height;
+    for (unsigned int level = 0;; level++)
+    {
+        KtxLevel entry;
+        entry.width = levelWidth;
+        entry.height = levelHeight;
+        entry.faceSize = getCompressedSize(format, levelWidth, levelHeight);
+        entry.offset = texture.data.size();
+        for (size_t face = 0; face < faces.size(); face++)
+        {
+            const unsigned char *pixels = level == 0 ? faces[face] : current[face].data();
+            std::vector<unsigned char> blocks = compressImage(pixels, levelWidth, levelHeight, format);
+            texture.data.insert(texture.data.end(), blocks.begin(), blocks.end());
+        }
+        texture.levels.push_back(entry);
+
+        if (!mipmaps || (levelWidth == 1 && levelHeight == 1))
+            break;
+        for (size_t face = 0; face < faces.size(); face++)
+        {
+            const unsigned char *pixels = level == 0 ? faces[face] : current[face].data();
+            current[face] = downsampleImage(pixels, levelWidth, levelHeight);
+        }
+        levelWidth = std::max(1u, levelWidth / 2);
+        levelHeight = std::max(1u, levelHeight / 2);
+    }
+    return texture;
+}
@@ -0,0 +1,29 @@
+#include <rg/uniformbuffer.hpp>
+
+#include <cstring>
+
+UniformBuffer::UniformBuffer(GLuint binding, size_t size) : binding(binding)
+{
+    glGenBuffers(1, &buffer);
+    // binding to an indexed point binds the generic GL_UNIFORM_BUFFER target as well
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+    glDeleteBuffers(1, &buffer);
+}
+
+void UniformBuffer::update(const void *data, size_t size)
+{
+    // binding it every time keeps the point right if another buffer was bound there in between
+    glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+    if (contents.size() == size && std::memcmp(contents.data(), data, size) == 0)
+        return;
+    // orphan the old storage so the driver doesn't wait for draws of the last frame that still read it
+    glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    contents.assign(bytes, bytes + size);
+}
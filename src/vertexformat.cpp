@@ -0,0 +1,135 @@
+#include <rg/vertexformat.hpp>
+#include <rg/mesh.hpp>
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+float signNotZero(float value)
+{
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+void packOctahedral(const glm::vec3 &v, int16_t out[2])
+{
+    glm::vec2 e = encodeOctahedral(v);
+    out[0] = static_cast<int16_t>(glm::packSnorm1x16(e.x));
+    out[1] = static_cast<int16_t>(glm::packSnorm1x16(e.y));
+}
+} // namespace
+
+glm::vec2 encodeOctahedral(glm::vec3 n)
+{
+    float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    // degenerate vectors (e.g. the tangent of a mesh without texture coordinates) decode to +Z
+    if (sum == 0.0f)
+        return glm::vec2(0.0f);
+    n /= sum;
+    glm::vec2 e(n.x, n.y);
+    // fold the lower hemisphere over the diagonals
+    if (n.z < 0.0f)
+        e = glm::vec2((1.0f - std::abs(n.y)) * signNotZero(n.x), (1.0f - std::abs(n.x)) * signNotZero(n.y));
+    return e;
+}
+
+glm::vec3 decodeOctahedral(glm::vec2 e)
+{
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+std::vector<CompactVertex> compressVertices(const Vertex *vertices, size_t count, glm::vec3 &positionOffset,
+                                            glm::vec3 &positionScale)
+{
+    glm::vec3 minimum(0.0f), maximum(0.0f);
+    if (count > 0)
+        minimum = maximum = vertices[0].Position;
+    for (size_t i = 1; i < count; i++)
+    {
+        minimum = glm::min(minimum, vertices[i].Position);
+        maximum = glm::max(maximum, vertices[i].Position);
+    }
+    positionOffset = minimum;
+    positionScale = maximum - minimum;
+    // flat axes keep a scale of 0 and encode as 0
+    glm::vec3 inverseScale(positionScale.x > 0.0f ? 1.0f / positionScale.x : 0.0f,
+                           positionScale.y > 0.0f ? 1.0f / positionScale.y : 0.0f,
+                           positionScale.z > 0.0f ? 1.0f / positionScale.z : 0.0f);
+
+    std::vector<CompactVertex> compact(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const Vertex &vertex = vertices[i];
+        CompactVertex &out = compact[i];
+        glm::vec3 position = (vertex.Position - positionOffset) * inverseScale;
+        out.Position[0] = glm::packUnorm1x16(position.x);
+        out.Position[1] = glm::packUnorm1x16(position.y);
+        out.Position[2] = glm::packUnorm1x16(position.z);
+        // handedness of the tangent frame, right handed unless the bitangent says otherwise
+        float handedness = glm::dot(glm::cross(vertex.Normal, vertex.Tangent), vertex.Bitangent);
+        out.Position[3] = handedness < 0.0f ? 0 : 65535;
+
+        packOctahedral(vertex.Normal, out.Normal);
+        packOctahedral(vertex.Tangent, out.Tangent);
+        out.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+        out.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    }
+    return compact;
+}
+
+std::vector<uint16_t> compressIndices(const unsigned int *indices, size_t count)
+{
+    return std::vector<uint16_t>(indices, indices + count);
+}
+
+size_t getVertexSize(VertexFormat format)
+{
+    return format == VertexFormat::Compact ? sizeof(CompactVertex) : sizeof(Vertex);
+}
+
+void setupVertexAttributes(VertexFormat format)
+{
+    if (format == VertexFormat::Compact)
+    {
+        // same locations as the full format, the shader decodes the attributes when COMPACT_VERTEX is defined.
+        // position (normalized to the bounds) with the bitangent sign in w
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex),
+                              (void *)offsetof(CompactVertex, Position));
+        // octahedral normal
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex),
+                              (void *)offsetof(CompactVertex, Normal));
+        // half float texture coords
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex),
+                              (void *)offsetof(CompactVertex, TexCoords));
+        // octahedral tangent, the bitangent is reconstructed from normal, tangent and sign
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex),
+                              (void *)offsetof(CompactVertex, Tangent));
+        return;
+    }
+
+    // vertex Positions
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)0);
+    // vertex normals
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Normal));
+    // vertex texture coords
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, TexCoords));
+    // vertex tangent
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Tangent));
+    // vertex bitangent
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, Bitangent));
+}
@@ -0,0 +1,96 @@
+// Bundles asset files into one pack that FileSystem mounts (see AssetPack). Run it from the project root so the
+// packed paths match the ones the program asks for:
+//
+//   pack_builder <output.rgpack> <file or directory>...   directories are added recursively
+#include <rg/assetpack.hpp>
+#include <rg/filesystem.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace
+{
+bool hasSuffix(const std::string &path, const std::string &suffix)
+{
+    return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// leftovers of interrupted writes and other packs don't belong in a pack
+bool isPackable(const std::string &path)
+{
+    return !hasSuffix(path, ".tmp") && !hasSuffix(path, ".rgpack");
+}
+
+bool collect(const std::string &path, std::vector<std::string> &files)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        std::cout << "ERROR::PACK_BUILDER:: " << path << " doesn't exist" << std::endl;
+        return false;
+    }
+    if (S_ISREG(st.st_mode))
+    {
+        if (isPackable(path))
+            files.push_back(FileSystem::normalizePath(path));
+        return true;
+    }
+    if (!S_ISDIR(st.st_mode))
+        return true;
+
+    DIR *directory = opendir(path.c_str());
+    if (!directory)
+    {
+        std::cout << "ERROR::PACK_BUILDER:: failed to open " << path << std::endl;
+        return false;
+    }
+    std::vector<std::string> children;
+    while (dirent *entry = readdir(directory))
+    {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..")
+            children.push_back(path + '/' + name);
+    }
+    closedir(directory);
+    std::sort(children.begin(), children.end());
+
+    bool success = true;
+    for (const std::string &child : children)
+        success = collect(child, files) && success;
+    return success;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cout << "usage: pack_builder <output.rgpack> <file or directory>..." << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> files;
+    for (int i = 2; i < argc; i++)
+    {
+        if (!collect(argv[i], files))
+            return 1;
+    }
+    if (!AssetPack::write(argv[1], files))
+    {
+        std::cout << "ERROR::PACK_BUILDER:: failed to write " << argv[1] << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<AssetPack> pack = AssetPack::open(argv[1]);
+    if (!pack)
+        return 1;
+    struct stat st;
+    stat(argv[1], &st);
+    std::cout << argv[1] << ": " << pack->getEntryCount() << " files, " << st.st_size / 1024 << " KB" << std::endl;
+    return 0;
+}
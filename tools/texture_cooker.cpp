@@ -0,0 +1,158 @@
+// Offline texture cooker: compresses images into BC1/BC3/BC4/BC5 KTX files with precomputed mip chains, which the
+// renderer loads instead of the source images (see loadImage).
+//
+//   texture_cooker [--no-mips] [--normal-map] <image>...   writes <image>.ktx next to every image
+//   texture_cooker [--no-mips] --cubemap <+X> <-X> <+Y> <-Y> <+Z> <-Z>   writes cubemap.ktx next to the +X face
+#include <rg/image.hpp>
+#include <rg/texturecompression.hpp>
+
+#include <stb_image.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Options
+{
+    bool mipmaps = true;
+    bool normalMap = false;
+    bool cubemap = false;
+    std::vector<std::string> inputs;
+};
+
+// decoded source image expanded to RGBA8
+struct Source
+{
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    std::vector<unsigned char> rgba;
+};
+
+bool readSource(const std::string &path, Source &source)
+{
+    unsigned char *data = stbi_load(path.c_str(), &source.width, &source.height, &source.components, 0);
+    if (!data)
+    {
+        std::cout << "ERROR::TEXTURE_COOKER:: failed to load " << path << ": " << stbi_failure_reason() << std::endl;
+        return false;
+    }
+    source.rgba = expandToRGBA(data, source.width, source.height, source.components);
+    stbi_image_free(data);
+    return true;
+}
+
+BlockFormat pickFormat(const Source &source, const Options &options)
+{
+    // normal maps keep x and y in two independent channels, z is left for whoever samples them to reconstruct
+    if (options.normalMap)
+        return BlockFormat::BC5;
+    // grey + alpha sources have been spread to RGBA by now, they only need BC3 if the alpha is used
+    return chooseBlockFormat(source.rgba.data(), source.width, source.height,
+                             source.components == 2 ? 4 : source.components);
+}
+
+const char *getFormatName(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        return "BC1";
+    case BlockFormat::BC3:
+        return "BC3";
+    case BlockFormat::BC4:
+        return "BC4";
+    default:
+        return "BC5";
+    }
+}
+
+bool writeCooked(const std::string &path, const KtxTexture &texture, BlockFormat format, size_t sourceSize)
+{
+    if (!writeKtx(path, texture))
+        return false;
+    std::cout << path << ": " << texture.width << "x" << texture.height << " " << getFormatName(format) << ", "
+              << texture.levels.size() << " levels, " << sourceSize / 1024 << " KB as RGBA8 -> "
+              << texture.getSize() / 1024 << " KB" << std::endl;
+    return true;
+}
+
+bool cookImage(const std::string &path, const Options &options)
+{
+    Source source;
+    if (!readSource(path, source))
+        return false;
+    // 2 component images are read as (grey, alpha), spread them over RGB so the RGBA expansion keeps them grey
+    if (source.components == 2)
+    {
+        for (size_t i = 0; i < source.rgba.size(); i += 4)
+        {
+            source.rgba[i + 3] = source.rgba[i + 1];
+            source.rgba[i + 1] = source.rgba[i + 2] = source.rgba[i];
+        }
+    }
+    BlockFormat format = pickFormat(source, options);
+    KtxTexture texture = cookTexture({source.rgba.data()}, source.width, source.height, format, options.mipmaps);
+    return writeCooked(getCookedTexturePath(path), texture, format, source.rgba.size());
+}
+
+bool cookCubemap(const Options &options)
+{
+    if (options.inputs.size() != 6)
+    {
+        std::cout << "ERROR::TEXTURE_COOKER:: a cubemap needs 6 faces (+X, -X, +Y, -Y, +Z, -Z)" << std::endl;
+        return false;
+    }
+    std::vector<Source> sources(6);
+    std::vector<const unsigned char *> faces;
+    for (size_t i = 0; i < 6; i++)
+    {
+        if (!readSource(options.inputs[i], sources[i]))
+            return false;
+        if (sources[i].width != sources[0].width || sources[i].height != sources[0].height)
+        {
+            std::cout << "ERROR::TEXTURE_COOKER:: cubemap faces differ in size: " << options.inputs[i] << std::endl;
+            return false;
+        }
+        faces.push_back(sources[i].rgba.data());
+    }
+    // the skybox is sampled as RGB, so alpha never decides the format of a cubemap
+    BlockFormat format = options.normalMap ? BlockFormat::BC5 : BlockFormat::BC1;
+    KtxTexture texture = cookTexture(faces, sources[0].width, sources[0].height, format, options.mipmaps);
+    return writeCooked(getCookedCubemapPath(options.inputs), texture, format, sources[0].rgba.size() * 6);
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--no-mips")
+            options.mipmaps = false;
+        else if (argument == "--normal-map")
+            options.normalMap = true;
+        else if (argument == "--cubemap")
+            options.cubemap = true;
+        else
+            options.inputs.push_back(argument);
+    }
+    if (options.inputs.empty())
+    {
+        std::cout << "usage: texture_cooker [--no-mips] [--normal-map] <image>...\n"
+                     "       texture_cooker [--no-mips] --cubemap <+X> <-X> <+Y> <-Y> <+Z> <-Z>"
+                  << std::endl;
+        return 1;
+    }
+
+    if (options.cubemap)
+        return cookCubemap(options) ? 0 : 1;
+
+    bool success = true;
+    for (const std::string &path : options.inputs)
+        success = cookImage(path, options) && success;
+    return success ? 0 : 1;
+}